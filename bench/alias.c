@@ -0,0 +1,60 @@
+//
+// alias.c - alias expansion benchmark
+//
+// With NALIASES aliases defined, the command line below, whose command
+// names are all aliases, is parsed ITERATIONS times, and so is the same
+// line with the aliases replaced by their values, as the text a shell
+// that expands aliases by substituting text lexes again. The former only
+// reads the tokens lexed when the aliases were defined.
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "alias.h"
+#include "lex.h"
+#include "parse.h"
+#include "bench.h"
+
+#define NALIASES 1000
+#define ITERATIONS 200000
+
+static const char *line = "ll /tmp; gs; ga -p && gc -m msg | tee log\n";
+static const char *expanded = "ls -l --color=auto /tmp; git status --short; "
+    "git add -p && git commit -v -m msg | tee log\n";
+
+// ---------------------------------------------------------------------------
+
+int main(void)
+{
+    char name[32];
+    for (int i = 0; i < NALIASES; i++) {
+	snprintf(name, sizeof(name), "alias%d", i);
+	alias_set(name, strlen(name), "echo some words");
+    }
+
+    alias_set("ll", 2, "ls -l --color=auto");
+    alias_set("gs", 2, "git status --short");
+    alias_set("ga", 2, "git add");
+    alias_set("gc", 2, "git commit -v");
+
+    double t[2];
+    for (int i = 0; i < 2; i++) {
+	const char *text = i ? expanded : line;
+	double t0 = bench_now();
+
+	for (int j = 0; j < ITERATIONS; j++) {
+	    Node *prog;
+	    if (parser_parse_text(text, &prog)) {
+		return 1;
+	    }
+	}
+
+	t[i] = bench_now() - t0;
+    }
+
+    printf("%d aliases: aliased line %.3f us, expanded line %.3f us "
+	   "(%.2fx)\n", NALIASES, t[0] / ITERATIONS * 1e6,
+	   t[1] / ITERATIONS * 1e6, t[1] / t[0]);
+    return 0;
+}
@@ -0,0 +1,19 @@
+//
+// bench.c - helpers shared by the benchmarks
+//
+
+#include <time.h>
+
+#include "bench.h"
+
+double bench_now(void);
+
+// ---------------------------------------------------------------------------
+
+// bench_now returns the monotonic time in seconds.
+double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,10 @@
+//
+// bench.h - helpers shared by the benchmarks
+//
+
+#ifndef BENCH_H
+#define BENCH_H
+
+double bench_now(void);
+
+#endif
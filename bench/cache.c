@@ -0,0 +1,152 @@
+//
+// cache.c - parsed-script cache benchmark
+//
+// A script of LINES lines is parsed and saved to a fresh cache directory
+// (cold start), then loaded from it (warm start). Both are repeated RUNS
+// times. Last, the image is truncated and then corrupted, and must be
+// rejected both times.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "lex.h"
+#include "parse.h"
+#include "cache.h"
+#include "bench.h"
+
+#define LINES 20000
+#define RUNS 10
+
+static char *script(size_t *);
+static char *image(const char *);
+
+// ---------------------------------------------------------------------------
+
+int main(void)
+{
+    char dir[] = "/tmp/xsh-cache-XXXXXX";
+    if (!mkdtemp(dir)) {
+	perror("mkdtemp");
+	return 1;
+    }
+
+    size_t len;
+    char *buf = script(&len);
+
+    Lex *lex = lex_make();
+    Parser *parser = parser_make(lex);
+
+    double parse = 0;
+    double store = 0;
+    for (int i = 0; i < RUNS; i++) {
+	double t0 = bench_now();
+	lex_readfrom(buf);
+	Node *prog = parser_parse();
+	if (parser->nerr) {
+	    return 1;
+	}
+
+	double t1 = bench_now();
+	cache_store(dir, buf, len, prog);
+	parse += t1 - t0;
+	store += bench_now() - t1;
+    }
+
+    double warm = 0;
+    for (int i = 0; i < RUNS; i++) {
+	double t0 = bench_now();
+	if (!cache_load(dir, buf, len)) {
+	    fprintf(stderr, "cache: miss on a warm start\n");
+	    return 1;
+	}
+	warm += bench_now() - t0;
+    }
+
+    printf("script: %d lines, %zu bytes\n", LINES, len);
+    printf("cold:   %.3f ms (lex and parse) + %.3f ms (store)\n",
+	   parse / RUNS * 1e3, store / RUNS * 1e3);
+    printf("warm:   %.3f ms (load), %.1fx faster than lex and parse\n",
+	   warm / RUNS * 1e3, parse / warm);
+
+    // A truncated image and a corrupted image must both be rejected.
+    char *file = image(dir);
+    truncate(file, 100);
+    if (cache_load(dir, buf, len)) {
+	fprintf(stderr, "cache: truncated image accepted\n");
+	return 1;
+    }
+
+    lex_readfrom(buf);
+    cache_store(dir, buf, len, parser_parse());
+    free(file);
+    file = image(dir);
+
+    int fd = open(file, O_WRONLY);
+    pwrite(fd, "\xff\xff\xff\xff", 4, 4096);
+    close(fd);
+    if (cache_load(dir, buf, len)) {
+	fprintf(stderr, "cache: corrupted image accepted\n");
+	return 1;
+    }
+
+    printf("stale:  truncated and corrupted images rejected\n");
+    free(file);
+    rmdir(dir);
+    return 0;
+}
+
+// script returns a script of LINES lines made of varied commands.
+static char *script(size_t *len)
+{
+    static const char *lines[] = {
+	"for f in a b c d e; do echo $f > /dev/null; done\n",
+	"if test -f /etc/passwd; then cat /etc/passwd | wc -l; fi\n",
+	"case $1 in start) echo start;; stop|halt) echo stop;; esac\n",
+	"while false; do : && break || continue 2; done\n",
+	"ls -l /tmp 2>&1 >/dev/null | grep -v total &\n",
+    };
+
+    size_t n = sizeof(lines) / sizeof(lines[0]);
+    size_t cap = 1 << 20;
+    char *buf = malloc(cap);
+    *len = 0;
+
+    for (int i = 0; i < LINES; i++) {
+	const char *line = lines[i % n];
+	size_t m = strlen(line);
+
+	if (*len + m + 1 > cap) {
+	    cap *= 2;
+	    buf = realloc(buf, cap);
+	}
+
+	memcpy(buf + *len, line, m);
+	*len += m;
+    }
+
+    buf[*len] = '\0';
+    return buf;
+}
+
+// image returns the name of the only image in dir.
+static char *image(const char *dir)
+{
+    DIR *d = opendir(dir);
+    struct dirent *e;
+    char *file = NULL;
+
+    while ((e = readdir(d))) {
+	if (e->d_name[0] != '.') {
+	    file = malloc(strlen(dir) + strlen(e->d_name) + 2);
+	    sprintf(file, "%s/%s", dir, e->d_name);
+	}
+    }
+
+    closedir(d);
+    return file;
+}
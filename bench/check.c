@@ -0,0 +1,206 @@
+//
+// check.c - syntax check benchmark
+//
+// The script below is parsed PARSES times with its tokens and trees taken
+// from the heap, as the shell does when it runs a script, then as many
+// times from an arena reset after each parse, as check_run() does. Then a
+// tree of DIRS directories holding FILES copies of it, a few of them with
+// errors, is checked by check_run() with one thread and with one thread
+// for each CPU, which must report the same errors.
+//
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "arena.h"
+#include "check.h"
+#include "lex.h"
+#include "parse.h"
+#include "bench.h"
+
+#define PARSES 5000
+#define DIRS 40
+#define FILES 20000
+#define BAD 97			// one file in BAD has errors
+
+static const char *script =
+    "#!/bin/sh\n"
+    "for i in 1 2 3 4 5; do\n"
+    "    if test \"$i\" = 3; then\n"
+    "        echo three >> /tmp/log 2>&1\n"
+    "    elif test \"$i\" = 4; then echo four | tr a-z A-Z\n"
+    "    else\n"
+    "        x=$((i * 2)) y=\"$(echo $i)\" env | grep -q x && echo $x\n"
+    "    fi\n"
+    "done\n"
+    "case $1 in\n"
+    "    start|restart) { echo start; } ;;\n"
+    "    *) (cd /tmp && ls -l) ;;\n"
+    "esac\n";
+
+static int tree(const char *);
+static bool same(const char *, const char *);
+static char *slurp(const char *, size_t *);
+static void unlink_tree(const char *);
+
+// ---------------------------------------------------------------------------
+
+int main(void)
+{
+    parser_make(lex_make());
+
+    Arena arena = { 0 };
+    double t[2];
+    for (int i = 0; i < 2; i++) {
+	arena_use(i ? &arena : NULL);
+	double t0 = bench_now();
+
+	for (int j = 0; j < PARSES; j++) {
+	    lex_readfrom(script);
+	    parser_parse();
+	    if (i) {
+		arena_reset(&arena);
+	    }
+	}
+
+	t[i] = bench_now() - t0;
+    }
+
+    arena_use(NULL);
+    arena_release(&arena);
+    printf("parse: heap %.3f us, arena %.3f us (%.2fx)\n",
+	   t[0] / PARSES * 1e6, t[1] / PARSES * 1e6, t[0] / t[1]);
+
+    char dir[] = "/tmp/xsh-check-XXXXXX";
+    if (!mkdtemp(dir) || tree(dir)) {
+	perror(dir);
+	return 1;
+    }
+
+    // The errors are written to the standard error, so they are only
+    // compared here.
+    char out[2][64];
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads[2] = { 1, ncpu };
+    int status = 0;
+    int saved = dup(2);
+
+    for (int i = 0; i < 2; i++) {
+	snprintf(out[i], sizeof(out[i]), "%s.%d", dir, i);
+	int fd = open(out[i], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	dup2(fd, 2);
+	close(fd);
+
+	char *paths[] = { dir };
+	double t0 = bench_now();
+	status |= check_run(paths, 1, threads[i]) != 2;
+	double t1 = bench_now();
+
+	dup2(saved, 2);
+	printf("check: %d files, %d threads, %.3f s, %.0f files/s\n", FILES,
+	       threads[i], t1 - t0, FILES / (t1 - t0));
+    }
+
+    if (status) {
+	fprintf(stderr, "check: the errors were not found\n");
+    } else if (!same(out[0], out[1])) {
+	fprintf(stderr, "check: not the same errors with %d threads\n",
+		threads[1]);
+	status = 1;
+    }
+
+    unlink(out[0]);
+    unlink(out[1]);
+    unlink_tree(dir);
+    return status;
+}
+
+// tree writes the FILES scripts of the benchmark under dir.
+static int tree(const char *dir)
+{
+    char path[128];
+    size_t len = strlen(script);
+
+    for (int i = 0; i < FILES; i++) {
+	snprintf(path, sizeof(path), "%s/d%02d", dir, i % DIRS);
+	mkdir(path, 0755);
+	snprintf(path, sizeof(path), "%s/d%02d/f%05d.sh", dir, i % DIRS, i);
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || write(fd, script, len) != (ssize_t) len) {
+	    return -1;
+	}
+
+	if (i % BAD == 0 && write(fd, "echo )\nif true\n", 15) != 15) {
+	    return -1;
+	}
+
+	close(fd);
+    }
+
+    return 0;
+}
+
+// same checks whether the files a and b are the same but for their last
+// line, the time the check took.
+static bool same(const char *a, const char *b)
+{
+    size_t n[2];
+    char *s[2] = { slurp(a, &n[0]), slurp(b, &n[1]) };
+    bool ok = s[0] && s[1] && n[0] == n[1] && !memcmp(s[0], s[1], n[0]);
+
+    free(s[0]);
+    free(s[1]);
+    return ok;
+}
+
+// slurp returns the file path but for its last line, and sets *n to its
+// length.
+static char *slurp(const char *path, size_t *n)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+	return NULL;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    rewind(fp);
+
+    char *s = malloc(len + 1);
+    *n = fread(s, 1, len, fp);
+    fclose(fp);
+
+    while (*n > 0 && s[*n - 1] == '\n') {
+	(*n)--;
+    }
+
+    while (*n > 0 && s[*n - 1] != '\n') {
+	(*n)--;
+    }
+
+    return s;
+}
+
+// unlink_tree removes the files and the directories made by tree().
+static void unlink_tree(const char *dir)
+{
+    char path[128];
+
+    for (int i = 0; i < FILES; i++) {
+	snprintf(path, sizeof(path), "%s/d%02d/f%05d.sh", dir, i % DIRS, i);
+	unlink(path);
+    }
+
+    for (int i = 0; i < DIRS; i++) {
+	snprintf(path, sizeof(path), "%s/d%02d", dir, i);
+	rmdir(path);
+    }
+
+    rmdir(dir);
+}
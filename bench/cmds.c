@@ -0,0 +1,167 @@
+//
+// cmds.c - command name completion benchmark
+//
+// A directory of NAMES executables is put first in PATH. Each of the
+// prefixes below is completed RUNS times: once by reading every directory
+// of PATH and checking every name, as done without a trie, and once with
+// cmds_complete(). Last, CHANGES executables are added to the directory
+// and removed from it, and the time cmds_refresh() takes to see them is
+// measured.
+//
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "cmds.h"
+#include "var.h"
+#include "bench.h"
+
+#define NAMES 20000
+#define RUNS 20
+#define FASTRUNS 100000
+#define CHANGES 1000
+
+static const char *prefixes[] = { "tool1234", "tool12", "tool", "zz" };
+
+static size_t baseline(const char *, const char *, size_t);
+static int change(const char *, bool);
+
+// ---------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    char dir[] = "/tmp/xsh-cmds-XXXXXX";
+    if (!mkdtemp(dir)) {
+	perror("mkdtemp");
+	return 1;
+    }
+
+    char path[64];
+    for (int i = 0; i < NAMES; i++) {
+	snprintf(path, sizeof(path), "%s/tool%05d", dir, i);
+	close(open(path, O_WRONLY | O_CREAT, 0755));
+    }
+
+    var_init(argc, argv);
+    const char *old = var_get("PATH");
+    char *search = malloc(strlen(dir) + (old ? strlen(old) : 0) + 2);
+    sprintf(search, "%s:%s", dir, old ? old : "");
+    var_set("PATH", search);
+
+    double t0 = bench_now();
+    cmds_refresh();
+    double t1 = bench_now();
+    printf("PATH: %d names in %s first, built in %.3f ms\n", NAMES, dir,
+	   (t1 - t0) * 1e3);
+
+    int status = 0;
+    for (size_t p = 0; p < sizeof(prefixes) / sizeof(*prefixes); p++) {
+	const char *s = prefixes[p];
+	size_t n = strlen(s);
+
+	t0 = bench_now();
+	size_t want = 0;
+	for (int i = 0; i < RUNS; i++) {
+	    want = baseline(search, s, n);
+	}
+
+	t1 = bench_now();
+	size_t got = 0;
+	Str ext;
+	str_init(&ext);
+	for (int i = 0; i < FASTRUNS; i++) {
+	    ext.len = 0;
+	    got = cmds_complete(s, n, &ext);
+	}
+	double t2 = bench_now();
+
+	// The executables also found later in PATH are counted twice.
+	if (got > want) {
+	    fprintf(stderr, "%s: %zu names, want at most %zu\n", s, got, want);
+	    status = 1;
+	}
+
+	printf("%-9s %6zu names, +'%.*s': scan %.3f ms, trie %.3f us "
+	       "(%.0fx)\n", s, got, (int) ext.len, ext.s,
+	       (t1 - t0) / RUNS * 1e3, (t2 - t1) / FASTRUNS * 1e6,
+	       (t1 - t0) / RUNS / ((t2 - t1) / FASTRUNS));
+	str_free(&ext);
+    }
+
+    status |= change(dir, true);
+    status |= change(dir, false);
+
+    for (int i = 0; i < NAMES; i++) {
+	snprintf(path, sizeof(path), "%s/tool%05d", dir, i);
+	unlink(path);
+    }
+    rmdir(dir);
+
+    return status;
+}
+
+// baseline returns the number of executables of the directories of the
+// PATH search that start with the n bytes of s.
+static size_t baseline(const char *search, const char *s, size_t n)
+{
+    char *copy = strdup(search);
+    size_t count = 0;
+
+    for (char *d = strtok(copy, ":"); d; d = strtok(NULL, ":")) {
+	DIR *dp = opendir(d);
+	if (!dp) {
+	    continue;
+	}
+
+	for (struct dirent *e; (e = readdir(dp));) {
+	    struct stat st;
+	    count += !strncmp(e->d_name, s, n)
+		&& fstatat(dirfd(dp), e->d_name, &st, 0) == 0
+		&& S_ISREG(st.st_mode) && st.st_mode & 0111;
+	}
+
+	closedir(dp);
+    }
+
+    free(copy);
+    return count;
+}
+
+// change adds CHANGES executables to dir if add is set, or removes them,
+// and checks that the completion sees it once refreshed.
+static int change(const char *dir, bool add)
+{
+    char path[64];
+    for (int i = 0; i < CHANGES; i++) {
+	snprintf(path, sizeof(path), "%s/xshnew%05d", dir, i);
+	if (add) {
+	    close(open(path, O_WRONLY | O_CREAT, 0755));
+	} else {
+	    unlink(path);
+	}
+    }
+
+    double t0 = bench_now();
+    cmds_refresh();
+    double t1 = bench_now();
+    printf("%d names %s: refreshed in %.3f ms\n", CHANGES,
+	   add ? "added" : "removed", (t1 - t0) * 1e3);
+
+    Str ext;
+    str_init(&ext);
+    size_t got = cmds_complete("xshnew", 6, &ext);
+    str_free(&ext);
+
+    if (got != (add ? CHANGES : 0)) {
+	fprintf(stderr, "xshnew: %zu names, want %d\n", got, add ? CHANGES : 0);
+	return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,211 @@
+//
+// copy.c - bulk data movement benchmark
+//
+// A file of SIZE bytes is fed RUNS times to 'wc -c' through a pipe, as by
+// 'cat file | wc -c', and copied to another file, as by 'cat file > copy':
+// with copy_fd(), which the cat builtin uses, with a read and write loop
+// through a buffer, as done before, and by the cat of GNU coreutils. The
+// best run of each is kept.
+//
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "copy.h"
+#include "bench.h"
+
+#define SIZE (512L << 20)
+#define RUNS 5
+#define BUFSIZE (128 * 1024)
+
+enum {
+    CopyFd,
+    Loop,
+    Coreutils,
+};
+
+static const char *names[] = { "copy_fd", "read/write", "coreutils cat" };
+
+static double to_pipe(const char *, int, long *);
+static double to_file(const char *, const char *, int, long *);
+static void move(const char *, int, int);
+static void loop(int, int);
+
+// ---------------------------------------------------------------------------
+
+int main(void)
+{
+    char path[] = "/tmp/xsh-copy-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+	perror(path);
+	return 1;
+    }
+
+    char *buf = malloc(BUFSIZE);
+    for (size_t i = 0; i < BUFSIZE; i++) {
+	buf[i] = 'a' + i % 26;
+    }
+
+    for (long n = 0; n < SIZE; n += BUFSIZE) {
+	if (write(fd, buf, BUFSIZE) != BUFSIZE) {
+	    perror(path);
+	    return 1;
+	}
+    }
+
+    close(fd);
+    free(buf);
+
+    char copy[64];
+    snprintf(copy, sizeof(copy), "%s.copy", path);
+
+    int status = 0;
+    for (int dest = 0; dest < 2; dest++) {
+	double best[3];
+
+	for (int how = CopyFd; how <= Coreutils; how++) {
+	    best[how] = 0;
+
+	    for (int i = 0; i < RUNS; i++) {
+		long got = 0;
+		double t = dest ? to_file(path, copy, how, &got)
+		    : to_pipe(path, how, &got);
+
+		if (got != SIZE) {
+		    fprintf(stderr, "%s: %ld bytes, want %ld\n", names[how],
+			    got, SIZE);
+		    status = 1;
+		}
+
+		if (best[how] == 0 || t < best[how]) {
+		    best[how] = t;
+		}
+	    }
+
+	    printf("%-6s %-14s %8.1f MB/s\n", dest ? "file" : "pipe",
+		   names[how], SIZE / best[how] / (1 << 20));
+	}
+
+	printf("%-6s copy_fd is %.2fx read/write, %.2fx coreutils\n",
+	       dest ? "file" : "pipe", best[Loop] / best[CopyFd],
+	       best[Coreutils] / best[CopyFd]);
+    }
+
+    unlink(copy);
+    unlink(path);
+    return status;
+}
+
+// to_pipe moves the file path to 'wc -c' the way how, sets *got to the
+// count of wc, and returns how long it took.
+static double to_pipe(const char *path, int how, long *got)
+{
+    int in[2];
+    int out[2];
+    if (pipe(in) < 0 || pipe(out) < 0) {
+	perror("pipe");
+	exit(1);
+    }
+
+    double t0 = bench_now();
+    pid_t pid = fork();
+    if (pid == 0) {
+	dup2(in[0], 0);
+	dup2(out[1], 1);
+	close(in[0]);
+	close(in[1]);
+	close(out[0]);
+	close(out[1]);
+	execlp("wc", "wc", "-c", (char *) NULL);
+	_exit(127);
+    }
+
+    close(in[0]);
+    close(out[1]);
+    move(path, in[1], how);
+    close(in[1]);
+
+    char count[32] = "";
+    ssize_t n = read(out[0], count, sizeof(count) - 1);
+    count[n > 0 ? n : 0] = '\0';
+    close(out[0]);
+    waitpid(pid, NULL, 0);
+
+    double t = bench_now() - t0;
+    *got = atol(count);
+    return t;
+}
+
+// to_file copies the file path to the file copy the way how, sets *got to
+// the size of the copy, and returns how long it took.
+static double to_file(const char *path, const char *copy, int how,
+		      long *got)
+{
+    int fd = open(copy, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+	perror(copy);
+	exit(1);
+    }
+
+    double t0 = bench_now();
+    move(path, fd, how);
+    close(fd);
+    double t = bench_now() - t0;
+
+    struct stat st;
+    *got = stat(copy, &st) < 0 ? -1 : st.st_size;
+    return t;
+}
+
+// move writes the file path to out the way how.
+static void move(const char *path, int out, int how)
+{
+    if (how == Coreutils) {
+	pid_t pid = fork();
+	if (pid == 0) {
+	    dup2(out, 1);
+	    execlp("cat", "cat", path, (char *) NULL);
+	    _exit(127);
+	}
+
+	waitpid(pid, NULL, 0);
+	return;
+    }
+
+    int in = open(path, O_RDONLY);
+    if (how == CopyFd) {
+	copy_fd(in, out);
+    } else {
+	loop(in, out);
+    }
+
+    close(in);
+}
+
+// loop moves in to out through a buffer.
+static void loop(int in, int out)
+{
+    char *buf = malloc(BUFSIZE);
+
+    for (ssize_t n; (n = read(in, buf, BUFSIZE)) > 0;) {
+	for (ssize_t off = 0; off < n;) {
+	    ssize_t m = write(out, buf + off, n - off);
+	    if (m < 0) {
+		perror("write");
+		exit(1);
+	    }
+
+	    off += m;
+	}
+    }
+
+    free(buf);
+}
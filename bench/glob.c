@@ -0,0 +1,107 @@
+//
+// glob.c - pathname expansion benchmark
+//
+// A fresh directory of ENTRIES files is globbed RUNS times with each of
+// the patterns below: once by reading it with readdir and matching every
+// name with fnmatch, as done without a listing cache, and once with
+// glob_expand(), which only reads it on the first run.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <unistd.h>
+
+#include "glob.h"
+#include "bench.h"
+
+#define ENTRIES 100000
+#define RUNS 20
+
+static const char *pats[] = { "*.c", "f0123*", "f?????7.[ch]" };
+
+static int baseline(const char *, const char *);
+
+// ---------------------------------------------------------------------------
+
+int main(void)
+{
+    char dir[] = "/tmp/xsh-glob-XXXXXX";
+    if (!mkdtemp(dir)) {
+	perror("mkdtemp");
+	return 1;
+    }
+
+    char path[64];
+    for (int i = 0; i < ENTRIES; i++) {
+	snprintf(path, sizeof(path), "%s/f%06d.%c", dir, i, "ch"[i & 1]);
+	close(open(path, O_WRONLY | O_CREAT, 0644));
+    }
+
+    // Let the clock tick past the last change, so that the first listing
+    // is not racy.
+    nanosleep(&(struct timespec) {.tv_nsec = 50000000 }, NULL);
+
+    printf("directory: %d entries\n", ENTRIES);
+
+    int status = 0;
+    for (size_t p = 0; p < sizeof(pats) / sizeof(*pats); p++) {
+	char pat[64];
+	snprintf(pat, sizeof(pat), "%s/%s", dir, pats[p]);
+
+	double t0 = bench_now();
+	int want = 0;
+	for (int i = 0; i < RUNS; i++) {
+	    want = baseline(dir, pats[p]);
+	}
+
+	double t1 = bench_now();
+	Str out;
+	str_init(&out);
+	int got = glob_expand(pat, &out);
+	double t2 = bench_now();
+	for (int i = 1; i < RUNS; i++) {
+	    out.len = 0;
+	    glob_expand(pat, &out);
+	}
+	double t3 = bench_now();
+	str_free(&out);
+
+	if (got != want) {
+	    fprintf(stderr, "%s: %d matches, want %d\n", pats[p], got, want);
+	    status = 1;
+	}
+
+	printf("%-14s %6d matches: readdir+fnmatch %.3f ms, "
+	       "glob %.3f ms first, %.3f ms cached (%.1fx)\n",
+	       pats[p], got, (t1 - t0) / RUNS * 1e3, (t2 - t1) * 1e3,
+	       (t3 - t2) / (RUNS - 1) * 1e3,
+	       (t1 - t0) / RUNS / ((t3 - t2) / (RUNS - 1)));
+    }
+
+    for (int i = 0; i < ENTRIES; i++) {
+	snprintf(path, sizeof(path), "%s/f%06d.%c", dir, i, "ch"[i & 1]);
+	unlink(path);
+    }
+    rmdir(dir);
+
+    return status;
+}
+
+// baseline returns the number of names of dir matched by pat.
+static int baseline(const char *dir, const char *pat)
+{
+    DIR *d = opendir(dir);
+    int n = 0;
+
+    for (struct dirent *e; (e = readdir(d));) {
+	n += e->d_name[0] != '.' && fnmatch(pat, e->d_name, 0) == 0;
+    }
+
+    closedir(d);
+    return n;
+}
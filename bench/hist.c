@@ -0,0 +1,266 @@
+//
+// hist.c - command history benchmark
+//
+// A history of ENTRIES commands is written and opened, which indexes it.
+// Each of the queries below is then looked up RUNS times as a prefix and
+// as a substring: once by scanning the whole log, as done without an
+// index, and once with hist_prefix() and hist_search(). A prefix lookup
+// is for the SHOWN most recent entries, as recalled with Up. Last, WRITERS
+// processes add entries at once while the log is searched, and the log
+// is checked to have all of them, whole.
+//
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "hist.h"
+#include "bench.h"
+
+#define ENTRIES 2000000
+#define RUNS 20
+#define WRITERS 4
+#define ADDS 20000
+#define SHOWN 64
+
+static const char *queries[] = { "git commit -m 'fix 1234", "make -j8",
+    "ssh host4242", "zzz"
+};
+
+static size_t baseline_prefix(const char *, size_t, const char *, size_t,
+			      uint64_t *);
+static uint64_t baseline_search(const char *, size_t, const char *);
+static int writers(void);
+static int compare(const void *, const void *);
+static int compare_recent(const void *, const void *);
+
+// ---------------------------------------------------------------------------
+
+int main(void)
+{
+    char path[] = "/tmp/xsh-hist-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+	perror("mkstemp");
+	return 1;
+    }
+
+    FILE *f = fdopen(fd, "w");
+    srand(1);
+    for (int i = 0; i < ENTRIES; i++) {
+	int r = rand();
+	switch (r % 4) {
+	case 0:
+	    fprintf(f, "git commit -m 'fix %d'", r / 4 % 100000);
+	    break;
+	case 1:
+	    fprintf(f, "make -j%d target%d", r / 4 % 16, r / 64 % 1000);
+	    break;
+	case 2:
+	    fprintf(f, "ssh host%d uptime", r / 4 % 50000);
+	    break;
+	default:
+	    fprintf(f, "ls -l /usr/src/project%d | grep -v tmp", r / 4 % 999);
+	    break;
+	}
+	fputc('\0', f);
+    }
+    fclose(f);
+
+    char idx[64];
+    snprintf(idx, sizeof(idx), "%s.idx", path);
+
+    // The log is opened, and indexed, on first use.
+    double t0 = bench_now();
+    hist_open(path);
+    size_t size = hist_end();
+    double t1 = bench_now();
+
+    const char *data = hist_text(0);
+    printf("history: %d entries, %.1f MB, indexed in %.3f s\n", ENTRIES,
+	   size / 1e6, t1 - t0);
+
+    int status = 0;
+    for (size_t q = 0; q < sizeof(queries) / sizeof(*queries); q++) {
+	const char *s = queries[q];
+	size_t n = strlen(s);
+
+	t0 = bench_now();
+	size_t want = 0;
+	uint64_t wantoffs[SHOWN];
+	uint64_t wantat = HIST_NONE;
+	for (int i = 0; i < RUNS; i++) {
+	    want = baseline_prefix(data, size, s, n, wantoffs);
+	}
+	t1 = bench_now();
+	for (int i = 0; i < RUNS; i++) {
+	    wantat = baseline_search(data, size, s);
+	}
+	double t2 = bench_now();
+
+	size_t got = 0;
+	uint64_t offs[SHOWN];
+	for (int i = 0; i < RUNS; i++) {
+	    got = hist_prefix(s, n, SHOWN, offs);
+	}
+	double t3 = bench_now();
+	uint64_t gotat = HIST_NONE;
+	for (int i = 0; i < RUNS; i++) {
+	    gotat = hist_search(s, n, HIST_NONE);
+	}
+	double t4 = bench_now();
+
+	if (got != want || memcmp(offs, wantoffs, sizeof(uint64_t) * got)
+	    || gotat != wantat) {
+	    fprintf(stderr, "%s: %zu prefixed, last at %ld, want %zu, %ld\n",
+		    s, got, (long) gotat, want, (long) wantat);
+	    status = 1;
+	}
+
+	printf("%-24s prefix %6zu: scan %.3f ms, index %.3f ms (%.0fx)\n", s,
+	       got, (t1 - t0) / RUNS * 1e3, (t3 - t2) / RUNS * 1e3,
+	       (t1 - t0) / (t3 - t2));
+	printf("%-24s search:        scan %.3f ms, index %.3f ms (%.0fx)\n",
+	       "", (t2 - t1) / RUNS * 1e3, (t4 - t3) / RUNS * 1e3,
+	       (t2 - t1) / (t4 - t3));
+    }
+
+    if (writers()) {
+	status = 1;
+    }
+
+    unlink(path);
+    unlink(idx);
+    return status;
+}
+
+// baseline_prefix sets offs to the offsets of the SHOWN most recent
+// different entries of the log data of size bytes that start with the n
+// bytes of s, the most recent first, and returns how many there are.
+static size_t baseline_prefix(const char *data, size_t size, const char *s,
+			      size_t n, uint64_t *offs)
+{
+    size_t count = 0;
+    size_t cap = 1024;
+    const char **v = malloc(sizeof(char *) * cap);
+
+    for (const char *p = data; p < data + size; p += strlen(p) + 1) {
+	if (strncmp(p, s, n)) {
+	    continue;
+	}
+
+	if (count == cap) {
+	    cap *= 2;
+	    v = realloc(v, sizeof(char *) * cap);
+	}
+	v[count++] = p;
+    }
+
+    qsort(v, count, sizeof(char *), compare);
+    size_t m = 0;
+    for (size_t i = 0; i < count; i++) {
+	if (!m || strcmp(v[m - 1], v[i])) {
+	    v[m++] = v[i];
+	}
+    }
+
+    qsort(v, m, sizeof(char *), compare_recent);
+    m = m < SHOWN ? m : SHOWN;
+    for (size_t i = 0; i < m; i++) {
+	offs[i] = v[i] - data;
+    }
+
+    free(v);
+    return m;
+}
+
+// baseline_search returns the offset in the log data of size bytes of the
+// last entry that has s in it, or HIST_NONE.
+static uint64_t baseline_search(const char *data, size_t size,
+				const char *s)
+{
+    uint64_t last = HIST_NONE;
+
+    for (const char *p = data; p < data + size; p += strlen(p) + 1) {
+	if (strstr(p, s)) {
+	    last = p - data;
+	}
+    }
+
+    return last;
+}
+
+// writers has WRITERS processes add ADDS entries each to the history
+// while it is searched, and checks that the log has them all, whole.
+static int writers(void)
+{
+    uint64_t before = hist_end();
+    double t0 = bench_now();
+
+    for (int w = 0; w < WRITERS; w++) {
+	if (fork() == 0) {
+	    char buf[64];
+	    for (int i = 0; i < ADDS; i++) {
+		int n = snprintf(buf, sizeof(buf), "writer %d entry %d", w, i);
+		hist_add(buf, n);
+	    }
+	    _exit(0);
+	}
+    }
+
+    int searches = 0;
+    for (int done = 0; done < WRITERS;) {
+	if (waitpid(-1, NULL, WNOHANG) > 0) {
+	    done++;
+	    continue;
+	}
+	hist_search("writer", 6, HIST_NONE);
+	searches++;
+    }
+
+    double t1 = bench_now();
+    hist_end();
+
+    int seen[WRITERS] = { 0 };
+    int bad = 0;
+    for (uint64_t o = before; o != HIST_NONE; o = hist_next(o)) {
+	int w, i;
+	if (sscanf(hist_text(o), "writer %d entry %d", &w, &i) != 2
+	    || w < 0 || w >= WRITERS || i != seen[w]++) {
+	    bad++;
+	}
+    }
+
+    for (int w = 0; w < WRITERS; w++) {
+	bad += ADDS - seen[w];
+    }
+
+    printf("%d writers: %d entries added in %.3f s, %d searches meanwhile, "
+	   "%d out of place\n", WRITERS, WRITERS * ADDS, t1 - t0, searches,
+	   bad);
+    return bad != 0;
+}
+
+// compare orders two entries by text, and the latest first if the same,
+// for qsort.
+static int compare(const void *a, const void *b)
+{
+    const char *x = *(const char **) a;
+    const char *y = *(const char **) b;
+    int c = strcmp(x, y);
+    return c ? c : (x < y) - (x > y);
+}
+
+// compare_recent orders two entries the most recent first, for qsort.
+static int compare_recent(const void *a, const void *b)
+{
+    const char *x = *(const char **) a;
+    const char *y = *(const char **) b;
+    return (x < y) - (x > y);
+}
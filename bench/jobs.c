@@ -0,0 +1,118 @@
+//
+// jobs.c - background job benchmark
+//
+// Scripts start N background jobs and then wait for all of them, for N
+// growing up to 16000. The jobs run ':' in a subshell, so the time is
+// spent forking, tracking and reaping them; the time per job should not
+// grow with N.
+//
+// Then BUSY jobs that each keep a CPU busy run with a limit of one job at
+// a time, of one job per CPU, and without a limit. One job per CPU should
+// be about as fast as no limit, with far fewer jobs running at once.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lex.h"
+#include "parse.h"
+#include "exec.h"
+#include "var.h"
+#include "jobs.h"
+#include "bench.h"
+
+#define BUSY 64
+
+static const char *busy =
+    "for i in $jobs; do (\n"
+    "  for a in 0 1 2 3 4 5 6 7 8 9; do for b in 0 1 2 3 4 5 6 7 8 9; do\n"
+    "    for c in 0 1 2 3 4 5 6 7 8 9; do for d in 0 1 2 3 4 5 6 7 8 9; do\n"
+    "      :\n"
+    "    done; done\n"
+    "  done; done\n"
+    ") & done; wait\n";
+
+static char *script(int);
+
+// ---------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    Lex *lex = lex_make();
+    Parser *parser = parser_make(lex);
+    var_init(argc, argv);
+
+    for (int n = 1000; n <= 16000; n *= 2) {
+	char *buf = script(n);
+	lex_readfrom(buf);
+	Node *prog = parser_parse();
+	if (parser->nerr) {
+	    return 1;
+	}
+
+	double t0 = bench_now();
+	if (exec_node(prog) != 0) {
+	    fprintf(stderr, "jobs: wait failed\n");
+	    return 1;
+	}
+	double t = bench_now() - t0;
+
+	printf("%5d jobs: %8.3f ms, %.2f us per job\n", n, t * 1e3,
+	       t / n * 1e6);
+	free(buf);
+    }
+
+    Str jobs;
+    str_init(&jobs);
+    for (int i = 0; i < BUSY; i++) {
+	str_puts(&jobs, i ? " x" : "x");
+    }
+    var_set("jobs", str_cstr(&jobs));
+
+    lex_readfrom(busy);
+    Node *prog = parser_parse();
+    if (parser->nerr) {
+	return 1;
+    }
+
+    int ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int limits[] = { 1, ncpus, 0 };
+    double base = 0;
+
+    for (int i = 0; i < 3; i++) {
+	jobs_limit(limits[i]);
+
+	double t0 = bench_now();
+	exec_node(prog);
+	double t = bench_now() - t0;
+
+	if (i == 0) {
+	    base = t;
+	}
+
+	printf("%d busy jobs, ", BUSY);
+	printf(limits[i] ? "limit %2d: " : "no limit: ", limits[i]);
+	printf("%8.3f ms, %.1fx\n", t * 1e3, base / t);
+    }
+
+    str_free(&jobs);
+    return 0;
+}
+
+// script returns a script that starts n background jobs, n a multiple of
+// ten, and waits for them.
+static char *script(int n)
+{
+    size_t len = 64 + n / 10 * 2;
+    char *buf = malloc(len + 64);
+    char *p = buf;
+
+    p += sprintf(p, "for a in");
+    for (int i = 0; i < n / 10; i++) {
+	p += sprintf(p, " %d", i % 10);
+    }
+    sprintf(p, "; do for b in 0 1 2 3 4 5 6 7 8 9; do : & done; done; wait");
+    return buf;
+}
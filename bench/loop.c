@@ -0,0 +1,69 @@
+//
+// loop.c - loop-heavy interpreter benchmark
+//
+// The script below runs the body of its innermost loop 10^6 times: six
+// nested for_clauses of ten words each, around a while_clause that breaks
+// on its first iteration. It is lexed and parsed once; the times reported
+// are the time spent walking the tree and the time spent running the same
+// tree compiled to bytecode.
+//
+
+#include <stdio.h>
+
+#include "lex.h"
+#include "parse.h"
+#include "exec.h"
+#include "vm.h"
+#include "bench.h"
+
+#define ITERATIONS 1000000
+
+static const char *script =
+    "for a in 0 1 2 3 4 5 6 7 8 9; do\n"
+    "  for b in 0 1 2 3 4 5 6 7 8 9; do\n"
+    "    for c in 0 1 2 3 4 5 6 7 8 9; do\n"
+    "      for d in 0 1 2 3 4 5 6 7 8 9; do\n"
+    "        for e in 0 1 2 3 4 5 6 7 8 9; do\n"
+    "          for f in 0 1 2 3 4 5 6 7 8 9; do\n"
+    "            while :; do\n"
+    "              : && break\n"
+    "            done\n"
+    "          done\n"
+    "        done\n"
+    "      done\n"
+    "    done\n"
+    "  done\n"
+    "done\n";
+
+// ---------------------------------------------------------------------------
+
+int main(void)
+{
+    Lex *lex = lex_make();
+    Parser *parser = parser_make(lex);
+
+    double t0 = bench_now();
+    lex_readfrom(script);
+    Node *prog = parser_parse();
+    double t1 = bench_now();
+
+    if (parser->nerr) {
+	return 1;
+    }
+
+    exec_node(prog);
+    double t2 = bench_now();
+
+    Code *code = vm_compile(prog);
+    double t3 = bench_now();
+    vm_run(code);
+    double t4 = bench_now();
+
+    printf("parse: %.6f s\n", t1 - t0);
+    printf("tree:  %d iterations in %.3f s, %.0f iterations/s\n",
+	   ITERATIONS, t2 - t1, ITERATIONS / (t2 - t1));
+    printf("vm:    %d iterations in %.3f s, %.0f iterations/s, %.2fx\n",
+	   ITERATIONS, t4 - t3, ITERATIONS / (t4 - t3),
+	   (t2 - t1) / (t4 - t3));
+    return 0;
+}
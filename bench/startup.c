@@ -0,0 +1,76 @@
+//
+// startup.c - startup latency benchmark
+//
+// Each shell named on the command line runs 'sh -c true' RUNS times, one
+// after the other, and the time from the spawn of each to its exit is
+// measured. The shells that can't be run are skipped.
+//
+//   startup shell...
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+
+#define RUNS 2000
+
+extern char **environ;
+
+static int compare(const void *, const void *);
+
+// ---------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    static double t[RUNS];
+    double first = 0;
+
+    for (int i = 1; i < argc; i++) {
+	char *args[] = { argv[i], "-c", "true", NULL };
+	int j = 0;
+
+	for (; j < RUNS; j++) {
+	    pid_t pid;
+	    int status;
+	    double t0 = bench_now();
+
+	    if (posix_spawnp(&pid, argv[i], NULL, NULL, args, environ)
+		|| waitpid(pid, &status, 0) < 0 || status) {
+		break;
+	    }
+
+	    t[j] = bench_now() - t0;
+	}
+
+	if (j < RUNS) {
+	    printf("%-16s skipped, it can't run\n", argv[i]);
+	    continue;
+	}
+
+	double sum = 0;
+	for (j = 0; j < RUNS; j++) {
+	    sum += t[j];
+	}
+
+	qsort(t, RUNS, sizeof(double), compare);
+	double mean = sum / RUNS;
+	first = first ? first : mean;
+
+	printf("%-16s mean %7.1f us  p50 %7.1f us  p99 %7.1f us  (%.2fx)\n",
+	       argv[i], mean * 1e6, t[RUNS / 2] * 1e6,
+	       t[RUNS * 99 / 100] * 1e6, mean / first);
+    }
+
+    return 0;
+}
+
+// compare orders two times for qsort.
+static int compare(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
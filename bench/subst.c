@@ -0,0 +1,67 @@
+//
+// subst.c - command substitution benchmark
+//
+// Each script below runs a command substitution ITERATIONS times in a
+// loop. The first one only runs a builtin, which needs no subshell; the
+// redirection of the second one makes it fork for the very same output.
+// Both are checked to leave the same value behind.
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "lex.h"
+#include "parse.h"
+#include "exec.h"
+#include "var.h"
+#include "bench.h"
+
+#define ITERATIONS 2000
+
+static const char *scripts[] = {
+    "for a in 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9; do\n"
+    "  for b in 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9; do\n"
+    "    for c in 0 1 2 3 4; do x=$(echo $a$b$c); done\n"
+    "  done\n"
+    "done\n",
+    "for a in 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9; do\n"
+    "  for b in 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9; do\n"
+    "    for c in 0 1 2 3 4; do x=$(echo $a$b$c 2>/dev/null); done\n"
+    "  done\n"
+    "done\n",
+};
+
+// ---------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    Lex *lex = lex_make();
+    Parser *parser = parser_make(lex);
+    var_init(argc, argv);
+
+    double times[2];
+    for (int i = 0; i < 2; i++) {
+	lex_readfrom(scripts[i]);
+	Node *prog = parser_parse();
+	if (parser->nerr) {
+	    return 1;
+	}
+
+	double t0 = bench_now();
+	exec_node(prog);
+	times[i] = bench_now() - t0;
+
+	const char *x = var_get("x");
+	if (!x || strcmp(x, "994")) {
+	    fprintf(stderr, "subst: x is %s, want 994\n", x ? x : "unset");
+	    return 1;
+	}
+    }
+
+    printf("substitutions: %d\n", ITERATIONS);
+    printf("builtin: %.3f ms, %.2f us each\n", times[0] * 1e3,
+	   times[0] / ITERATIONS * 1e6);
+    printf("forked:  %.3f ms, %.2f us each, %.1fx slower\n", times[1] * 1e3,
+	   times[1] / ITERATIONS * 1e6, times[1] / times[0]);
+    return 0;
+}
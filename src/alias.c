@@ -0,0 +1,260 @@
+//
+// alias.c - aliases
+//
+// The aliases are kept in a trie of their names, each with the tokens of
+// its value. The value is lexed once, when the alias is defined, and the
+// parser reads its tokens in place of the alias name as they are, so that
+// using an alias costs no more than reading the tokens it stands for.
+// Since scripts are parsed one complete command at a time, an alias is
+// used from the complete command after the one that defines it.
+//
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "alias.h"
+#include "lex.h"
+#include "str.h"
+
+typedef struct __sEntry Entry;
+
+bool alias_set(const char *, size_t, const char *);
+Alias *alias_get(const char *);
+bool alias_unset(const char *);
+void alias_clear(void);
+void alias_done(Alias *);
+bool alias_print(Str *, const char *);
+void alias_print_all(Str *);
+static Entry *walk(const char *, size_t, bool);
+static void release(Alias *);
+static void drop(Alias *);
+static void clear(Entry *);
+static void print(Str *, Str *, Entry *);
+static void format(Str *, const char *, size_t, const Alias *);
+
+// ---------------------------------------------------------------------------
+
+// Entry is a node of the trie of the alias names, one per byte.
+struct __sEntry {
+    unsigned char c;		// last byte of the name
+    Entry *child;		// first child, by their byte
+    Entry *next;		// next sibling
+    Alias *alias;		// NULL if the name is not an alias
+};
+
+static Entry root;
+
+// alias_set makes the name of n bytes an alias of value, and returns false
+// if it cannot be the name of an alias.
+bool alias_set(const char *name, size_t n, const char *value)
+{
+    if (n == 0) {
+	return false;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+	if (!isgraph((unsigned char) name[i])
+	    || strchr("|&;<>()$`\\\"'=", name[i])) {
+	    return false;
+	}
+    }
+
+    Entry *e = walk(name, n, true);
+    Alias *old = e->alias;
+    if (old && !old->busy) {
+	release(old);
+    } else {
+	e->alias = calloc(1, sizeof(Alias));
+    }
+
+    // The name is not replaced again within the tokens of the alias it
+    // had, until they are all read.
+    if (old && old->busy) {
+	drop(old);
+	old->heir = e->alias;
+	e->alias->busy = true;
+    }
+
+    Alias *a = e->alias;
+    size_t len = strlen(value);
+    a->value = strdup(value);
+    a->toks = lex_tokens(a->value, &a->ntoks);
+    a->blank = len > 0 && (value[len - 1] == ' ' || value[len - 1] == '\t');
+    return true;
+}
+
+// alias_get returns the alias called name, or NULL if there is none.
+Alias *alias_get(const char *name)
+{
+    Entry *e = walk(name, strlen(name), false);
+    return e ? e->alias : NULL;
+}
+
+// alias_unset removes the alias called name, and returns false if there is
+// none.
+bool alias_unset(const char *name)
+{
+    Entry *e = walk(name, strlen(name), false);
+    if (!e || !e->alias) {
+	return false;
+    }
+
+    drop(e->alias);
+    e->alias = NULL;
+    return true;
+}
+
+// alias_clear removes every alias.
+void alias_clear(void)
+{
+    clear(&root);
+}
+
+// alias_done tells that the tokens of a are no longer being parsed. If a was
+// redefined or removed while they were, it is freed, and the alias that
+// replaced it may be used from now on.
+void alias_done(Alias *a)
+{
+    while (a) {
+	Alias *heir = a->gone ? a->heir : NULL;
+	a->busy = false;
+
+	if (a->gone) {
+	    release(a);
+	    free(a);
+	}
+
+	a = heir;
+    }
+}
+
+// alias_print appends the definition of the alias called name to out, in a
+// form that can be read back, and returns false if there is none.
+bool alias_print(Str *out, const char *name)
+{
+    Alias *a = alias_get(name);
+    if (!a) {
+	return false;
+    }
+
+    format(out, name, strlen(name), a);
+    return true;
+}
+
+// alias_print_all appends the definition of every alias to out, sorted by
+// name.
+void alias_print_all(Str *out)
+{
+    Str name;
+    str_init(&name);
+    print(out, &name, &root);
+    str_free(&name);
+}
+
+// walk returns the entry of the name of n bytes, made if make is set, or
+// NULL if there is none.
+static Entry *walk(const char *name, size_t n, bool make)
+{
+    Entry *e = &root;
+
+    for (size_t i = 0; i < n; i++) {
+	unsigned char c = name[i];
+	Entry **l = &e->child;
+	while (*l && (*l)->c < c) {
+	    l = &(*l)->next;
+	}
+
+	if (!*l || (*l)->c != c) {
+	    if (!make) {
+		return NULL;
+	    }
+
+	    Entry *new = calloc(1, sizeof(Entry));
+	    new->c = c;
+	    new->next = *l;
+	    *l = new;
+	}
+
+	e = *l;
+    }
+
+    return e;
+}
+
+// release frees the value and the tokens of a.
+static void release(Alias *a)
+{
+    for (size_t i = 0; i < a->ntoks; i++) {
+	free(a->toks[i].text);
+    }
+
+    free(a->toks);
+    free(a->value);
+}
+
+// drop frees a, taken out of the trie, or only marks it gone while its
+// tokens are being parsed, for alias_done() to free it.
+static void drop(Alias *a)
+{
+    if (a->busy) {
+	a->gone = true;
+	return;
+    }
+
+    release(a);
+    free(a);
+}
+
+// clear removes the aliases of e and under it, and the entries under it.
+static void clear(Entry *e)
+{
+    for (Entry *c = e->child, *next; c; c = next) {
+	next = c->next;
+	clear(c);
+	free(c);
+    }
+
+    if (e->alias) {
+	drop(e->alias);
+    }
+
+    e->child = NULL;
+    e->alias = NULL;
+}
+
+// print appends the definitions of the aliases of e and under it to out,
+// name being the name of e.
+static void print(Str *out, Str *name, Entry *e)
+{
+    if (e->alias) {
+	format(out, name->s, name->len, e->alias);
+    }
+
+    for (Entry *c = e->child; c; c = c->next) {
+	str_putc(name, c->c);
+	print(out, name, c);
+	name->len--;
+    }
+}
+
+// format appends to out the definition of the alias a called by the name
+// of n bytes.
+static void format(Str *out, const char *name, size_t n, const Alias *a)
+{
+    str_puts(out, "alias ");
+    str_putn(out, name, n);
+    str_puts(out, "='");
+
+    for (const char *p = a->value; *p; p++) {
+	if (*p == '\'') {
+	    str_puts(out, "'\\''");
+	} else {
+	    str_putc(out, *p);
+	}
+    }
+
+    str_puts(out, "'\n");
+}
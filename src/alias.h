@@ -0,0 +1,34 @@
+//
+// alias.h - aliases
+//
+
+#ifndef ALIAS_H
+#define ALIAS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "lex.h"
+#include "str.h"
+
+// Alias is a name standing for the tokens of a command, lexed once when it
+// is defined.
+typedef struct __sAlias {
+    char *value;		// text the tokens are lexed from
+    Token *toks;
+    size_t ntoks;
+    bool blank;			// whether value ends with a blank
+    bool busy;			// whether its tokens, or those of the alias
+				// it replaced, are being parsed
+    bool gone;			// whether it was redefined or removed since
+    struct __sAlias *heir;	// alias that replaced it, if gone
+} Alias;
+
+bool alias_set(const char *, size_t, const char *);
+Alias *alias_get(const char *);
+bool alias_unset(const char *);
+void alias_clear(void);
+void alias_done(Alias *);
+bool alias_print(Str *, const char *);
+void alias_print_all(Str *);
+
+#endif
@@ -0,0 +1,128 @@
+//
+// arena.c - allocation arenas
+//
+// The tokens of the lexer and the trees of the parser are allocated with
+// arena_alloc(). By default it is calloc(3), and arena_free() is free(3).
+// Once a thread calls arena_use(), its allocations are carved instead from
+// the blocks of that arena and arena_free() does nothing; arena_reset()
+// then frees all of them at once, keeping the blocks for the next use.
+// This is what a thread parsing many inputs in a row, and throwing their
+// trees away, does to avoid a malloc and a free for every token and node.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define BLOCK (64 * 1024)
+#define ALIGN 16
+
+void arena_use(Arena *);
+void *arena_alloc(size_t);
+void *arena_grow(void *, size_t, size_t);
+void arena_free(void *);
+void arena_reset(Arena *);
+void arena_release(Arena *);
+
+// ---------------------------------------------------------------------------
+
+// Block is a piece of memory of an arena.
+struct __sBlock {
+    Block *next;
+    size_t cap;			// bytes of data
+    size_t used;
+    _Alignas(ALIGN) char data[];
+};
+
+static _Thread_local Arena *arena;
+
+// arena_use makes the allocations of the calling thread come from a, or
+// from the heap again if a is NULL.
+void arena_use(Arena *a)
+{
+    arena = a;
+}
+
+// arena_alloc returns n zeroed bytes.
+void *arena_alloc(size_t n)
+{
+    if (!arena) {
+	return calloc(1, n);
+    }
+
+    n = (n + ALIGN - 1) & ~(size_t) (ALIGN - 1);
+
+    // The blocks after the current one are those kept by arena_reset(),
+    // unused yet.
+    Block *b = arena->cur;
+    while (b && b->used + n > b->cap) {
+	b = b->next;
+    }
+
+    if (!b) {
+	size_t cap = n > BLOCK ? n : BLOCK;
+	b = malloc(sizeof(Block) + cap);
+	b->cap = cap;
+	b->used = 0;
+
+	if (arena->cur) {
+	    b->next = arena->cur->next;
+	    arena->cur->next = b;
+	} else {
+	    b->next = arena->head;
+	    arena->head = b;
+	}
+    }
+
+    arena->cur = b;
+    void *p = b->data + b->used;
+    b->used += n;
+    return memset(p, 0, n);
+}
+
+// arena_grow returns p, of old bytes, made new bytes long. The bytes added
+// are not zeroed.
+void *arena_grow(void *p, size_t old, size_t new)
+{
+    if (!arena) {
+	return realloc(p, new);
+    }
+
+    void *q = arena_alloc(new);
+    if (p) {
+	memcpy(q, p, old < new ? old : new);
+    }
+
+    return q;
+}
+
+// arena_free frees p, unless it comes from an arena.
+void arena_free(void *p)
+{
+    if (!arena) {
+	free(p);
+    }
+}
+
+// arena_reset frees everything allocated from a, and keeps its blocks.
+void arena_reset(Arena *a)
+{
+    for (Block *b = a->head; b; b = b->next) {
+	b->used = 0;
+    }
+
+    a->cur = a->head;
+}
+
+// arena_release frees everything allocated from a, and its blocks.
+void arena_release(Arena *a)
+{
+    for (Block *b = a->head, *next; b; b = next) {
+	next = b->next;
+	free(b);
+    }
+
+    a->head = NULL;
+    a->cur = NULL;
+}
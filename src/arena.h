@@ -0,0 +1,25 @@
+//
+// arena.h - allocation arenas
+//
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct __sBlock Block;
+
+// Arena is a list of blocks memory is carved from, all freed at once.
+typedef struct __sArena {
+    Block *head;
+    Block *cur;			// block being carved from
+} Arena;
+
+void arena_use(Arena *);
+void *arena_alloc(size_t);
+void *arena_grow(void *, size_t, size_t);
+void arena_free(void *);
+void arena_reset(Arena *);
+void arena_release(Arena *);
+
+#endif
@@ -0,0 +1,145 @@
+//
+// ast.c - abstract syntax tree
+//
+
+#include <stdlib.h>
+
+#include "ast.h"
+#include "arena.h"
+#include "pat.h"
+
+Node *ast_make(NodeType);
+void ast_push_word(Node *, char *);
+void ast_push_assign(Node *, char *);
+Redir *ast_push_redir(Node *);
+CaseItem *ast_push_item(Node *);
+void ast_push_pattern(CaseItem *, char *);
+void ast_free(Node *);
+static char **grow(char **, size_t);
+static void free_words(char **, size_t);
+
+// ---------------------------------------------------------------------------
+
+// ast_make allocates and returns a zeroed node of the given type.
+Node *ast_make(NodeType type)
+{
+    Node *n = arena_alloc(sizeof(Node));
+    n->type = type;
+    return n;
+}
+
+// ast_push_word appends word to Node->argv. Node->argv is always kept
+// NULL-terminated so it can be handed to execvp as is.
+void ast_push_word(Node *n, char *word)
+{
+    n->argv = grow(n->argv, n->argc);
+    n->argv[n->argc++] = word;
+    n->argv[n->argc] = NULL;
+}
+
+// ast_push_assign appends the ASSIGNMENT_WORD word to Node->assigns.
+void ast_push_assign(Node *n, char *word)
+{
+    n->assigns = grow(n->assigns, n->nassigns);
+    n->assigns[n->nassigns++] = word;
+    n->assigns[n->nassigns] = NULL;
+}
+
+// ast_push_redir appends a new redirection to Node->redir and returns it.
+Redir *ast_push_redir(Node *n)
+{
+    Redir *r = arena_alloc(sizeof(Redir));
+    r->fd = -1;
+
+    Redir **tail = &n->redir;
+    while (*tail) {
+	tail = &(*tail)->next;
+    }
+
+    *tail = r;
+    return r;
+}
+
+// ast_push_item appends a new case_item to Node->items and returns it.
+CaseItem *ast_push_item(Node *n)
+{
+    CaseItem *item = arena_alloc(sizeof(CaseItem));
+
+    CaseItem **tail = &n->items;
+    while (*tail) {
+	tail = &(*tail)->next;
+    }
+
+    *tail = item;
+    return item;
+}
+
+// ast_free frees the tree n, its words, and the automata compiled for its
+// case_clauses. The nodes of a list are freed in a loop, so that a long
+// script does not take a deep recursion.
+void ast_free(Node *n)
+{
+    while (n) {
+	Node *next = n->right;
+
+	free_words(n->assigns, n->nassigns);
+	free_words(n->argv, n->argc);
+	for (Redir *r = n->redir, *rn; r; r = rn) {
+	    rn = r->next;
+	    arena_free(r->word);
+	    arena_free(r);
+	}
+
+	ast_free(n->left);
+	ast_free(n->els);
+	arena_free(n->name);
+
+	for (CaseItem *i = n->items, *in; i; i = in) {
+	    in = i->next;
+	    free_words(i->pats, i->npats);
+	    ast_free(i->body);
+	    arena_free(i);
+	}
+
+	if (n->pat) {
+	    pat_free(n->pat);
+	}
+
+	arena_free(n);
+	n = next;
+    }
+}
+
+// ast_push_pattern appends pat to CaseItem->pats.
+void ast_push_pattern(CaseItem *item, char *pat)
+{
+    item->pats = grow(item->pats, item->npats);
+    item->pats[item->npats++] = pat;
+    item->pats[item->npats] = NULL;
+}
+
+// grow makes room in a NULL-terminated vector of n words for one more word
+// and its terminator. The capacity doubles on every power of two.
+static char **grow(char **v, size_t n)
+{
+    if (n == 0) {
+	return arena_grow(v, 0, sizeof(char *) * 2);
+    }
+
+    if ((n + 1) & n) {
+	return v;
+    }
+
+    return arena_grow(v, sizeof(char *) * (n + 1),
+		      sizeof(char *) * (n + 1) * 2);
+}
+
+// free_words frees the n words of v, and v.
+static void free_words(char **v, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+	arena_free(v[i]);
+    }
+
+    arena_free(v);
+}
@@ -0,0 +1,115 @@
+//
+// ast.h - abstract syntax tree
+//
+
+#ifndef AST_H
+#define AST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "lex.h"
+
+typedef enum {
+    NSimple,			// simple_command
+    NPipe,			// pipe_sequence
+    NNot,			// Bang pipe_sequence
+    NAnd,			// and_or AND_IF
+    NOr,			// and_or OR_IF
+    NList,			// list, term
+    NBrace,			// brace_group
+    NSubshell,			// subshell
+    NIf,			// if_clause, else_part
+    NWhile,			// while_clause
+    NUntil,			// until_clause
+    NFor,			// for_clause
+    NCase,			// case_clause
+    NTime,			// Time pipeline
+} NodeType;
+
+// Redir represents a single io_redirect.
+typedef struct __sRedir {
+
+    // type is the token type of the redirection operator, TLess to TLobber.
+    TokenType type;
+
+    // fd is the IO_NUMBER in front of the operator, or -1 when it was
+    // omitted and the default descriptor of the operator applies.
+    int fd;
+
+    // word is the filename, the descriptor to duplicate or the here_end.
+    char *word;
+
+    struct __sRedir *next;
+
+} Redir;
+
+typedef struct __sNode Node;
+struct __sPat;
+
+// CaseItem represents a single case_item of a case_clause.
+typedef struct __sCaseItem {
+
+    // pats holds the patterns separated by '|' in front of ')'.
+    char **pats;
+    size_t npats;
+
+    // body is the compound_list run on a match. It is NULL for an empty
+    // case_item.
+    Node *body;
+
+    struct __sCaseItem *next;
+
+} CaseItem;
+
+// Node is a node of the abstract syntax tree built by the parser. Which
+// fields are meaningful depends on the node type:
+//
+//   NSimple    assigns, argv, redir
+//   NPipe      left is the command, right is the next NPipe or NULL
+//   NNot       left
+//   NAnd, NOr  left, right
+//   NList      left is the and_or, right is the next NList or NULL, bg is
+//              set when left is followed by '&'
+//   NBrace     left
+//   NSubshell  left
+//   NIf        left is the condition, right the then part, els the
+//              else_part (either a NIf for elif, a NList or NULL)
+//   NWhile     left is the condition, right the do_group
+//   NUntil     left is the condition, right the do_group
+//   NFor       name, argv is the wordlist when in is set, right the do_group
+//   NCase      name is the subject word, items, pat the automaton matching
+//              the patterns of items, compiled on first use
+//   NTime      left is the pipeline timed, or NULL
+//
+// Every node but NSimple keeps in redir the redirect_list that follows a
+// compound_command.
+struct __sNode {
+    NodeType type;
+
+    char **assigns;		// ASSIGNMENT_WORD of the cmd_prefix
+    size_t nassigns;
+    char **argv;
+    size_t argc;
+    Redir *redir;
+
+    Node *left;
+    Node *right;
+    Node *els;
+
+    char *name;
+    bool bg;
+    bool in;
+
+    CaseItem *items;
+    struct __sPat *pat;
+};
+
+Node *ast_make(NodeType);
+void ast_push_word(Node *, char *);
+void ast_push_assign(Node *, char *);
+Redir *ast_push_redir(Node *);
+CaseItem *ast_push_item(Node *);
+void ast_push_pattern(CaseItem *, char *);
+void ast_free(Node *);
+
+#endif
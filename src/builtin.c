@@ -0,0 +1,693 @@
+//
+// builtin.c - builtin utilities
+//
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <sys/stat.h>
+
+#include "builtin.h"
+#include "exec.h"
+#include "var.h"
+#include "str.h"
+#include "jobs.h"
+#include "alias.h"
+#include "copy.h"
+
+#define LENGTH 15
+
+extern char **environ;
+
+Builtin builtin_lookup(const char *);
+const char *builtin_name(int);
+bool builtin_special(Builtin);
+bool builtin_pure(Builtin);
+Str *builtin_capture(Str *);
+static int builtin_colon(int, char **);
+static int builtin_true(int, char **);
+static int builtin_false(int, char **);
+static int builtin_exit(int, char **);
+static int builtin_break(int, char **);
+static int builtin_continue(int, char **);
+static int builtin_echo(int, char **);
+static int builtin_cd(int, char **);
+static int builtin_export(int, char **);
+static int builtin_unset(int, char **);
+static int builtin_wait(int, char **);
+static int builtin_alias(int, char **);
+static int builtin_unalias(int, char **);
+static int builtin_cat(int, char **);
+static int builtin_dot(int, char **);
+static char *search(const char *);
+static int concat(int, char **);
+static int cat(int, const char *);
+static bool caught(int);
+static int utility(char **);
+static ssize_t output(const char *, size_t);
+static int count(int, char **);
+static bool isname(const char *, size_t);
+
+// The tables of the builtins are constant data. The names are kept in place
+// rather than pointed to, so that they need no relocation when the program
+// starts.
+static const char names[LENGTH][9] = {
+    ":",
+    "true",
+    "false",
+    "exit",
+    "break",
+    "continue",
+    "echo",
+    "cd",
+    "export",
+    "unset",
+    "wait",
+    "alias",
+    "unalias",
+    "cat",
+    ".",
+};
+
+// The flags of a builtin are found from its function, so no two of them
+// share one.
+static const Builtin funcs[LENGTH] = {
+    builtin_colon,
+    builtin_true,
+    builtin_false,
+    builtin_exit,
+    builtin_break,
+    builtin_continue,
+    builtin_echo,
+    builtin_cd,
+    builtin_export,
+    builtin_unset,
+    builtin_wait,
+    builtin_alias,
+    builtin_unalias,
+    builtin_cat,
+    builtin_dot,
+};
+
+// specials tells the special builtins, after which the assignments in
+// front of them last.
+static const bool specials[LENGTH] = {
+    true,
+    false,
+    false,
+    true,
+    true,
+    true,
+    false,
+    false,
+    true,
+    true,
+    false,
+    false,
+    false,
+    false,
+    true,
+};
+
+// pures tells the builtins that change nothing in the shell but their
+// output, which a command substitution may run without a subshell.
+static const bool pures[LENGTH] = {
+    true,
+    true,
+    true,
+    false,
+    false,
+    false,
+    true,
+    false,
+    false,
+    false,
+    false,
+    false,
+    false,
+    false,
+    false,
+};
+
+// capture is the buffer the standard output of the builtins goes to, or
+// NULL if it goes to descriptor 1.
+static Str *capture;
+
+// ---------------------------------------------------------------------------
+
+// builtin_lookup returns the builtin utility called name, or NULL if name
+// is not a builtin.
+Builtin builtin_lookup(const char *name)
+{
+    for (int i = 0; i < LENGTH; i++) {
+	if (!strcmp(name, names[i])) {
+	    return funcs[i];
+	}
+    }
+
+    return NULL;
+}
+
+// builtin_name returns the name of the i-th builtin utility, or NULL past
+// the last one.
+const char *builtin_name(int i)
+{
+    return i >= 0 && i < LENGTH ? names[i] : NULL;
+}
+
+// builtin_special checks whether fn is a special builtin.
+bool builtin_special(Builtin fn)
+{
+    for (int i = 0; i < LENGTH; i++) {
+	if (fn == funcs[i]) {
+	    return specials[i];
+	}
+    }
+
+    return false;
+}
+
+// builtin_pure checks whether fn has no effect but its output.
+bool builtin_pure(Builtin fn)
+{
+    for (int i = 0; i < LENGTH; i++) {
+	if (fn == funcs[i]) {
+	    return pures[i];
+	}
+    }
+
+    return false;
+}
+
+// builtin_capture makes the builtins append their standard output to out,
+// or write it to descriptor 1 again if out is NULL, and returns the buffer
+// it went to until now.
+Str *builtin_capture(Str *out)
+{
+    Str *old = capture;
+    capture = out;
+    return old;
+}
+
+// builtin_colon implements ':'.
+static int builtin_colon(int argc, char **argv)
+{
+    return 0;
+}
+
+// builtin_true implements 'true'. It is ':' but for being a regular
+// builtin rather than a special one.
+static int builtin_true(int argc, char **argv)
+{
+    return 0;
+}
+
+// builtin_false implements 'false'.
+static int builtin_false(int argc, char **argv)
+{
+    return 1;
+}
+
+// builtin_exit implements 'exit [n]'.
+static int builtin_exit(int argc, char **argv)
+{
+    exit(argc > 1 ? atoi(argv[1]) : exec_status());
+}
+
+// builtin_break implements 'break [n]'.
+static int builtin_break(int argc, char **argv)
+{
+    int n = count(argc, argv);
+    if (n < 0) {
+	return 1;
+    }
+
+    exec_break(n);
+    return 0;
+}
+
+// builtin_continue implements 'continue [n]'.
+static int builtin_continue(int argc, char **argv)
+{
+    int n = count(argc, argv);
+    if (n < 0) {
+	return 1;
+    }
+
+    exec_continue(n);
+    return 0;
+}
+
+// builtin_echo implements 'echo [-n] [string...]'. The output is written
+// with a single write(2), so it is not interleaved with other processes.
+static int builtin_echo(int argc, char **argv)
+{
+    bool newline = true;
+    int i = 1;
+
+    if (argc > 1 && !strcmp(argv[1], "-n")) {
+	newline = false;
+	i++;
+    }
+
+    size_t len = 1;
+    for (int j = i; j < argc; j++) {
+	len += strlen(argv[j]) + 1;
+    }
+
+    char *buf = malloc(len);
+    size_t n = 0;
+
+    for (; i < argc; i++) {
+	size_t m = strlen(argv[i]);
+	memcpy(buf + n, argv[i], m);
+	n += m;
+
+	if (i + 1 < argc) {
+	    buf[n++] = ' ';
+	}
+    }
+
+    if (newline) {
+	buf[n++] = '\n';
+    }
+
+    ssize_t rc = output(buf, n);
+    free(buf);
+    return rc < 0;
+}
+
+// builtin_cd implements 'cd [directory]'.
+static int builtin_cd(int argc, char **argv)
+{
+    const char *dir = argc > 1 ? argv[1] : var_get("HOME");
+
+    if (!dir || chdir(dir) < 0) {
+	fprintf(stderr, "cd: can't cd to %s\n", dir ? dir : "");
+	return 1;
+    }
+
+    return 0;
+}
+
+// builtin_export implements 'export name[=value]...' and 'export -p'. The
+// latter prints the exported variables in a form that can be read back.
+static int builtin_export(int argc, char **argv)
+{
+    if (argc == 1 || (argc == 2 && !strcmp(argv[1], "-p"))) {
+	Str out;
+	str_init(&out);
+
+	for (char **e = var_environ(); *e; e++) {
+	    const char *eq = strchr(*e, '=');
+
+	    str_puts(&out, "export ");
+	    str_putn(&out, *e, eq - *e);
+	    str_puts(&out, "='");
+	    for (const char *p = eq + 1; *p; p++) {
+		if (*p == '\'') {
+		    str_puts(&out, "'\\''");
+		} else {
+		    str_putc(&out, *p);
+		}
+	    }
+	    str_puts(&out, "'\n");
+	}
+
+	ssize_t rc = output(out.s, out.len);
+	str_free(&out);
+	return rc < 0;
+    }
+
+    int st = 0;
+    for (int i = 1; i < argc; i++) {
+	const char *eq = strchr(argv[i], '=');
+	size_t len = eq ? (size_t) (eq - argv[i]) : strlen(argv[i]);
+
+	if (!isname(argv[i], len)) {
+	    fprintf(stderr, "export: %s: bad variable name\n", argv[i]);
+	    st = 1;
+	    continue;
+	}
+
+	char *name = strndup(argv[i], len);
+	if (eq) {
+	    var_set(name, eq + 1);
+	}
+	var_export(name);
+	free(name);
+    }
+
+    return st;
+}
+
+// builtin_unset implements 'unset [-v] name...'.
+static int builtin_unset(int argc, char **argv)
+{
+    int i = 1;
+    if (argc > 1 && !strcmp(argv[1], "-v")) {
+	i++;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "-f")) {
+	fprintf(stderr, "unset: functions are not supported\n");
+	return 1;
+    }
+
+    int st = 0;
+    for (; i < argc; i++) {
+	if (!isname(argv[i], strlen(argv[i]))) {
+	    fprintf(stderr, "unset: %s: bad variable name\n", argv[i]);
+	    st = 1;
+	    continue;
+	}
+
+	var_unset(argv[i]);
+    }
+
+    return st;
+}
+
+// builtin_wait implements 'wait [pid...]'. Without operands, it waits for
+// every background job and its status is zero; otherwise it is the status
+// of the last pid, 127 if it is not a job of the shell.
+static int builtin_wait(int argc, char **argv)
+{
+    if (argc < 2) {
+	return jobs_waitall();
+    }
+
+    int st = 0;
+    for (int i = 1; i < argc; i++) {
+	char *end;
+	long pid = strtol(argv[i], &end, 10);
+
+	if (!*argv[i] || *end || pid <= 0) {
+	    fprintf(stderr, "wait: %s: no such job\n", argv[i]);
+	    st = 127;
+	    continue;
+	}
+
+	st = jobs_wait(pid, NULL);
+    }
+
+    return st;
+}
+
+// builtin_alias implements 'alias [name[=value]...]'. Without operands,
+// it prints every alias in a form that can be read back.
+static int builtin_alias(int argc, char **argv)
+{
+    Str out;
+    str_init(&out);
+    int st = 0;
+
+    if (argc == 1) {
+	alias_print_all(&out);
+    }
+
+    for (int i = 1; i < argc; i++) {
+	const char *eq = strchr(argv[i], '=');
+
+	if (!eq && !alias_print(&out, argv[i])) {
+	    fprintf(stderr, "alias: %s: not found\n", argv[i]);
+	    st = 1;
+	} else if (eq && !alias_set(argv[i], eq - argv[i], eq + 1)) {
+	    fprintf(stderr, "alias: %s: bad alias name\n", argv[i]);
+	    st = 1;
+	}
+    }
+
+    if (out.len && output(out.s, out.len) < 0) {
+	st = 1;
+    }
+
+    str_free(&out);
+    return st;
+}
+
+// builtin_unalias implements 'unalias name...' and 'unalias -a', which
+// removes every alias.
+static int builtin_unalias(int argc, char **argv)
+{
+    if (argc == 2 && !strcmp(argv[1], "-a")) {
+	alias_clear();
+	return 0;
+    }
+
+    int st = 0;
+    for (int i = 1; i < argc; i++) {
+	if (!alias_unset(argv[i])) {
+	    fprintf(stderr, "unalias: %s: not found\n", argv[i]);
+	    st = 1;
+	}
+    }
+
+    return st;
+}
+
+// builtin_dot implements '. file', which runs the commands of file in the
+// shell, one at a time, so that the aliases it defines apply to it and to
+// the commands after it. A file named without a '/' is searched for in
+// PATH, and needs only to be readable.
+static int builtin_dot(int argc, char **argv)
+{
+    if (argc < 2) {
+	fprintf(stderr, ".: file name required\n");
+	return 2;
+    }
+
+    char *path = strchr(argv[1], '/') ? strdup(argv[1]) : search(argv[1]);
+    if (!path) {
+	fprintf(stderr, ".: %s: not found\n", argv[1]);
+	return 1;
+    }
+
+    int st = exec_file(path);
+    if (st < 0) {
+	fprintf(stderr, ".: %s: %s\n", path, strerror(errno));
+	st = 1;
+    }
+
+    free(path);
+    return st;
+}
+
+// builtin_cat implements 'cat [-u] [file...]', '-' standing for the
+// standard input. The data is moved by copy_fd(), without going through
+// the shell when the kernel can, so it is never buffered: -u changes
+// nothing. With any other option, the cat utility of PATH runs instead.
+//
+// The interactive shell catches SIGINT to outlive it, so there the data is
+// moved by a child process, which ^C stops, rather than by the shell. A
+// reader that went away stops cat with the status SIGPIPE would give it,
+// and the shell goes on.
+static int builtin_cat(int argc, char **argv)
+{
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+	if (!strcmp(argv[i], "--")) {
+	    i++;
+	    break;
+	}
+
+	if (strcmp(argv[i], "-u")) {
+	    return utility(argv);
+	}
+    }
+
+    if (!caught(SIGINT)) {
+	return concat(argc - i, argv + i);
+    }
+
+    pid_t pid = jobs_fork(false);
+    if (pid < 0) {
+	perror("fork");
+	return 1;
+    }
+
+    if (pid == 0) {
+	_exit(concat(argc - i, argv + i));
+    }
+
+    return jobs_wait(pid, NULL);
+}
+
+// concat writes the data of the n files of names, or of the standard input
+// if there are none, to the standard output, and returns the exit status
+// of cat. SIGPIPE is blocked meanwhile, so that a write to a pipe with no
+// reader fails with EPIPE instead of killing the shell.
+static int concat(int n, char **names)
+{
+    sigset_t set;
+    sigset_t old;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    sigprocmask(SIG_BLOCK, &set, &old);
+
+    int st = n == 0 ? cat(0, "-") : 0;
+    for (int i = 0; i < n && st <= 1; i++) {
+	int fd = 0;
+	if (strcmp(names[i], "-")
+	    && (fd = open(names[i], O_RDONLY | O_CLOEXEC)) < 0) {
+	    fprintf(stderr, "cat: %s: %s\n", names[i], strerror(errno));
+	    st = 1;
+	    continue;
+	}
+
+	int s = cat(fd, names[i]);
+	st = s > 1 ? s : st | s;
+	if (fd > 0) {
+	    close(fd);
+	}
+    }
+
+    // The SIGPIPE of a failed write is taken before it can be delivered.
+    if (st == 128 + SIGPIPE && !sigismember(&old, SIGPIPE)) {
+	sigtimedwait(&set, NULL, &(struct timespec) {0});
+    }
+
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    return st;
+}
+
+// cat writes the data of fd, the file called name, to the standard output,
+// and returns the exit status of cat: 128 plus SIGPIPE if the output is a
+// pipe with no reader, as the utility would be killed by it.
+static int cat(int fd, const char *name)
+{
+    // Appending a file to itself would never end.
+    struct stat si;
+    struct stat so;
+    if (fstat(fd, &si) == 0 && fstat(1, &so) == 0 && S_ISREG(si.st_mode)
+	&& si.st_dev == so.st_dev && si.st_ino == so.st_ino) {
+	fprintf(stderr, "cat: %s: input file is output file\n", name);
+	return 1;
+    }
+
+    if (copy_fd(fd, 1) < 0) {
+	// The utility would be killed by SIGPIPE, unless it is ignored.
+	int err = errno;
+	struct sigaction sa;
+	if (err == EPIPE && sigaction(SIGPIPE, NULL, &sa) == 0
+	    && sa.sa_handler != SIG_IGN) {
+	    return 128 + SIGPIPE;
+	}
+
+	fprintf(stderr, "cat: %s: %s\n", name, strerror(err));
+	return 1;
+    }
+
+    return 0;
+}
+
+// utility runs the utility of PATH called argv[0] with argv, for what its
+// builtin does not do, and returns its exit status.
+static int utility(char **argv)
+{
+    pid_t pid = jobs_fork(false);
+    if (pid < 0) {
+	perror("fork");
+	return 1;
+    }
+
+    if (pid == 0) {
+	environ = var_environ();
+	execvp(argv[0], argv);
+	fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+	_exit(127);
+    }
+
+    return jobs_wait(pid, NULL);
+}
+
+// search returns the path of the first regular file called name that can
+// be read in the directories of PATH, or NULL if there is none. The caller
+// frees it.
+static char *search(const char *name)
+{
+    const char *p = var_get("PATH");
+    Str path;
+    str_init(&path);
+
+    while (p) {
+	const char *end = strchr(p, ':');
+	size_t len = end ? (size_t) (end - p) : strlen(p);
+
+	path.len = 0;
+	str_putn(&path, len ? p : ".", len ? len : 1);
+	str_putc(&path, '/');
+	str_puts(&path, name);
+
+	struct stat st;
+	if (stat(str_cstr(&path), &st) == 0 && S_ISREG(st.st_mode)
+	    && access(path.s, R_OK) == 0) {
+	    char *found = strdup(path.s);
+	    str_free(&path);
+	    return found;
+	}
+
+	p = end ? end + 1 : NULL;
+    }
+
+    str_free(&path);
+    return NULL;
+}
+
+// caught checks whether the signal sig is caught by a handler.
+static bool caught(int sig)
+{
+    struct sigaction sa;
+    return sigaction(sig, NULL, &sa) == 0 && sa.sa_handler != SIG_DFL
+	&& sa.sa_handler != SIG_IGN;
+}
+
+// output writes the n bytes of buf to the standard output of the builtins.
+static ssize_t output(const char *buf, size_t n)
+{
+    if (capture) {
+	str_putn(capture, buf, n);
+	return n;
+    }
+
+    return write(1, buf, n);
+}
+
+// count returns the loop count argument of break and continue, or -1 if it
+// is not a positive integer.
+static int count(int argc, char **argv)
+{
+    if (argc < 2) {
+	return 1;
+    }
+
+    int n = atoi(argv[1]);
+    if (n < 1) {
+	fprintf(stderr, "%s: bad number: %s\n", argv[0], argv[1]);
+	return -1;
+    }
+
+    return n;
+}
+
+// isname checks whether the len bytes at s make a NAME.
+static bool isname(const char *s, size_t len)
+{
+    if (len == 0 || isdigit((unsigned char) *s)) {
+	return false;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+	if (!isalnum((unsigned char) s[i]) && s[i] != '_') {
+	    return false;
+	}
+    }
+
+    return true;
+}
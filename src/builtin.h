@@ -0,0 +1,21 @@
+//
+// builtin.h - builtin utilities
+//
+
+#ifndef BUILTIN_H
+#define BUILTIN_H
+
+#include <stdbool.h>
+#include "str.h"
+
+// Builtin is a utility run by the shell itself, without forking. It
+// returns its exit status.
+typedef int (*Builtin)(int, char **);
+
+Builtin builtin_lookup(const char *);
+const char *builtin_name(int);
+bool builtin_special(Builtin);
+bool builtin_pure(Builtin);
+Str *builtin_capture(Str *);
+
+#endif
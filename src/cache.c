@@ -0,0 +1,489 @@
+//
+// cache.c - persistent parsed-script cache
+//
+// A parsed script is saved as an image file named after a hash of the
+// script bytes. The image holds the tree and its words, each word stored
+// once, with every pointer written as an offset from the start of the
+// image, so the image does not depend on where it is mapped. Loading it
+// maps the file privately and turns the offsets back into pointers in
+// place; the script is neither lexed nor parsed.
+//
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ast.h"
+#include "cache.h"
+#include "table.h"
+
+#define VERSION 3
+#define MAGIC "xshimage"
+
+Node *cache_load(const char *, const char *, size_t);
+void cache_store(const char *, const char *, size_t, Node *);
+static uint64_t hash(const void *, size_t);
+static char *path(const char *, uint64_t);
+static uint64_t layout(void);
+static size_t put(const void *, size_t);
+static size_t put_word(const char *);
+static size_t put_words(char **, size_t);
+static bool same_word(const void *, const void *);
+static size_t put_redir(Redir *);
+static size_t put_items(CaseItem *);
+static size_t put_node(Node *);
+static bool fix(void *, size_t, size_t);
+static bool fix_word(char **);
+static bool fix_words(char ***, size_t);
+static bool fix_redir(Redir **);
+static bool fix_items(CaseItem **);
+static bool fix_node(Node **);
+
+// ---------------------------------------------------------------------------
+
+// Header is found at the start of every image.
+typedef struct __sHeader {
+    char magic[8];
+    uint64_t version;
+    uint64_t layout;		// sizes of the tree structs, see layout()
+    uint64_t key;		// hash of the script
+    uint64_t len;		// length of the script
+    uint64_t size;		// size of the image, header included
+    uint64_t check;		// hash of the image past the header
+    uint64_t root;		// offset of the root node
+} Header;
+
+// Word is an entry of the table used to store every word once.
+typedef struct __sWord {
+    uint64_t hash;
+    const char *text;
+    size_t off;
+} Word;
+
+// Image being written by cache_store().
+static char *img;
+static size_t imglen;
+static size_t imgcap;
+static Table words = {.size = sizeof(Word) };
+
+// Image being loaded by cache_load().
+static char *base;
+static size_t size;
+static size_t budget;		// nodes still allowed, guards against cycles
+
+// cache_load returns the tree of the script of len bytes at script if dir
+// holds a valid image of it, or NULL otherwise. Images that are stale or
+// corrupt are removed.
+Node *cache_load(const char *dir, const char *script, size_t len)
+{
+    uint64_t key = hash(script, len);
+    char *file = path(dir, key);
+
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+	free(file);
+	return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(Header)) {
+	close(fd);
+	unlink(file);
+	free(file);
+	return NULL;
+    }
+
+    size = st.st_size;
+    base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_POPULATE,
+		fd, 0);
+    close(fd);
+
+    if (base == MAP_FAILED) {
+	free(file);
+	return NULL;
+    }
+
+    Header *h = (Header *) base;
+    Node *root = (Node *) (uintptr_t) h->root;
+    // Nodes, redirections and case_items all count against the budget;
+    // the image can't hold more of them than of the smallest one.
+    budget = size / sizeof(Redir);
+
+    if (memcmp(h->magic, MAGIC, 8) || h->version != VERSION
+	|| h->layout != layout() || h->key != key || h->len != len
+	|| h->size != size
+	|| h->check != hash(base + sizeof(Header), size - sizeof(Header))
+	|| !fix_node(&root)) {
+	munmap(base, size);
+	unlink(file);
+	free(file);
+	return NULL;
+    }
+
+    free(file);
+    return root;
+}
+
+// cache_store saves the tree prog of the script of len bytes at script as
+// an image in dir. The image is written to a temporary file first and then
+// renamed, so readers never see it half written.
+void cache_store(const char *dir, const char *script, size_t len,
+		 Node *prog)
+{
+    imglen = 0;
+    table_clear(&words);
+
+    Header h;
+    memset(&h, 0, sizeof(Header));
+    put(&h, sizeof(Header));
+
+    h.root = put_node(prog);
+    memcpy(h.magic, MAGIC, 8);
+    h.version = VERSION;
+    h.layout = layout();
+    h.key = hash(script, len);
+    h.len = len;
+    h.size = imglen;
+    h.check = hash(img + sizeof(Header), imglen - sizeof(Header));
+    memcpy(img, &h, sizeof(Header));
+
+    mkdir(dir, 0700);
+
+    char *file = path(dir, h.key);
+    char *tmp = malloc(strlen(file) + 32);
+    sprintf(tmp, "%s.%ld", file, (long) getpid());
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+	free(tmp);
+	free(file);
+	return;
+    }
+
+    size_t n = 0;
+    while (n < imglen) {
+	ssize_t m = write(fd, img + n, imglen - n);
+	if (m < 0 && errno == EINTR) {
+	    continue;
+	}
+
+	if (m <= 0) {
+	    break;
+	}
+
+	n += m;
+    }
+
+    close(fd);
+
+    if (n != imglen || rename(tmp, file) < 0) {
+	unlink(tmp);
+    }
+
+    free(tmp);
+    free(file);
+}
+
+// hash returns a 64-bit hash of the len bytes at p. It mixes in eight
+// bytes at a time, so hashing a script costs far less than lexing it.
+static uint64_t hash(const void *p, size_t len)
+{
+    const unsigned char *s = p;
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ len;
+    uint64_t k;
+
+    for (; len >= 8; s += 8, len -= 8) {
+	memcpy(&k, s, 8);
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 32;
+	h = (h ^ k) * 0xc4ceb9fe1a85ec53ULL;
+    }
+
+    k = 0;
+    memcpy(&k, s, len);
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 32;
+    h = (h ^ k) * 0xc4ceb9fe1a85ec53ULL;
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// path returns the name of the image file for key in dir.
+static char *path(const char *dir, uint64_t key)
+{
+    char *file = malloc(strlen(dir) + 32);
+    sprintf(file, "%s/%016llx", dir, (unsigned long long) key);
+    return file;
+}
+
+// layout returns a value that changes whenever the tree structs change, so
+// images written by another build of the shell are never used.
+static uint64_t layout(void)
+{
+    return sizeof(Node) << 32 | sizeof(Redir) << 16 | sizeof(CaseItem);
+}
+
+// put appends n bytes to the image, aligned for any of the tree structs,
+// and returns their offset.
+static size_t put(const void *p, size_t n)
+{
+    size_t off = (imglen + 7) & ~(size_t) 7;
+
+    while (off + n > imgcap) {
+	imgcap = imgcap ? imgcap * 2 : 4096;
+	img = realloc(img, imgcap);
+    }
+
+    memset(img + imglen, 0, off - imglen);
+    memcpy(img + off, p, n);
+    imglen = off + n;
+    return off;
+}
+
+// put_word appends word to the image unless it is already there, and
+// returns its offset.
+static size_t put_word(const char *word)
+{
+    if (!word) {
+	return 0;
+    }
+
+    size_t len = strlen(word);
+    uint64_t h = table_hash(word, len);
+    Word key = {.text = word };
+    Word *w = table_find(&words, h, &key, same_word);
+    if (w) {
+	return w->off;
+    }
+
+    w = table_add(&words, h);
+    w->text = word;
+    w->off = put(word, len + 1);
+    return w->off;
+}
+
+// same_word tells whether the words a and b have the same text.
+static bool same_word(const void *a, const void *b)
+{
+    return !strcmp(((const Word *) a)->text, ((const Word *) b)->text);
+}
+
+// put_words appends the NULL-terminated vector of n words v to the image
+// and returns its offset.
+static size_t put_words(char **v, size_t n)
+{
+    if (!v) {
+	return 0;
+    }
+
+    uint64_t *offs = malloc(sizeof(uint64_t) * (n + 1));
+    for (size_t i = 0; i < n; i++) {
+	offs[i] = put_word(v[i]);
+    }
+    offs[n] = 0;
+
+    size_t off = put(offs, sizeof(uint64_t) * (n + 1));
+    free(offs);
+    return off;
+}
+
+// put_redir appends the redirections r to the image and returns the offset
+// of the first one.
+static size_t put_redir(Redir *r)
+{
+    if (!r) {
+	return 0;
+    }
+
+    Redir copy = *r;
+    copy.word = (char *) put_word(r->word);
+    copy.next = (Redir *) put_redir(r->next);
+    return put(&copy, sizeof(Redir));
+}
+
+// put_items appends the case_items item to the image and returns the
+// offset of the first one.
+static size_t put_items(CaseItem *item)
+{
+    if (!item) {
+	return 0;
+    }
+
+    CaseItem copy = *item;
+    copy.pats = (char **) put_words(item->pats, item->npats);
+    copy.body = (Node *) put_node(item->body);
+    copy.next = (CaseItem *) put_items(item->next);
+    return put(&copy, sizeof(CaseItem));
+}
+
+// put_node appends the tree n to the image and returns the offset of its
+// root. The chains of NList and NPipe nodes are walked in a loop rather
+// than recursively, since they are as long as the script.
+static size_t put_node(Node *n)
+{
+    if (!n) {
+	return 0;
+    }
+
+    size_t len = 0;
+    for (Node *p = n; p; p = p->right) {
+	len++;
+
+	if (p->type != NList && p->type != NPipe) {
+	    break;
+	}
+    }
+
+    Node **chain = malloc(sizeof(Node *) * len);
+    Node *p = n;
+    for (size_t i = 0; i < len; i++, p = p->right) {
+	chain[i] = p;
+    }
+
+    size_t next = 0;
+    for (size_t i = len; i-- > 0;) {
+	Node copy = *chain[i];
+
+	copy.assigns = (char **) put_words(copy.assigns, copy.nassigns);
+	copy.argv = (char **) put_words(copy.argv, copy.argc);
+	copy.redir = (Redir *) put_redir(copy.redir);
+	copy.left = (Node *) put_node(copy.left);
+	copy.els = (Node *) put_node(copy.els);
+	copy.name = (char *) put_word(copy.name);
+	copy.items = (CaseItem *) put_items(copy.items);
+	copy.pat = NULL;
+
+	if (i + 1 < len) {
+	    copy.right = (Node *) next;
+	} else {
+	    copy.right = (Node *) put_node(copy.right);
+	}
+
+	next = put(&copy, sizeof(Node));
+    }
+
+    free(chain);
+    return next;
+}
+
+// fix turns the offset at *p into a pointer to n bytes of the image being
+// loaded. It checks that the bytes are within the image past the header
+// and aligned.
+static bool fix(void *p, size_t n, size_t align)
+{
+    uintptr_t off;
+    memcpy(&off, p, sizeof(off));
+
+    if (off == 0) {
+	return true;
+    }
+
+    if (off < sizeof(Header) || off > size || n > size - off
+	|| off % align) {
+	return false;
+    }
+
+    char *ptr = base + off;
+    memcpy(p, &ptr, sizeof(ptr));
+    return true;
+}
+
+// fix_word fixes the word at *p, that must end within the image.
+static bool fix_word(char **p)
+{
+    if (!fix(p, 1, 1)) {
+	return false;
+    }
+
+    return !*p || memchr(*p, '\0', base + size - *p);
+}
+
+// fix_words fixes the NULL-terminated vector of n words at *p.
+static bool fix_words(char ***p, size_t n)
+{
+    if (n > size / sizeof(char *) || !fix(p, sizeof(char *) * (n + 1), 8)) {
+	return false;
+    }
+
+    if (!*p) {
+	return true;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+	if (!(*p)[i] || !fix_word(&(*p)[i])) {
+	    return false;
+	}
+    }
+
+    return !(*p)[n];
+}
+
+// fix_redir fixes the redirections at *p.
+static bool fix_redir(Redir **p)
+{
+    for (; *p; p = &(*p)->next) {
+	if (budget-- == 0 || !fix(p, sizeof(Redir), 8)) {
+	    return false;
+	}
+
+	Redir *r = *p;
+	if (r->type < TLess || r->type > TLobber || !fix_word(&r->word)) {
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+// fix_items fixes the case_items at *p.
+static bool fix_items(CaseItem **p)
+{
+    for (; *p; p = &(*p)->next) {
+	if (budget-- == 0 || !fix(p, sizeof(CaseItem), 8)) {
+	    return false;
+	}
+
+	CaseItem *item = *p;
+	if (!fix_words(&item->pats, item->npats) || !fix_node(&item->body)) {
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+// fix_node fixes the tree at *p. Like put_node(), it follows the right
+// pointers in a loop.
+static bool fix_node(Node **p)
+{
+    for (; *p; p = &(*p)->right) {
+	if (budget-- == 0 || !fix(p, sizeof(Node), 8)) {
+	    return false;
+	}
+
+	Node *n = *p;
+	if (n->type > NTime || !fix_words(&n->assigns, n->nassigns)
+	    || !fix_words(&n->argv, n->argc)
+	    || !fix_redir(&n->redir) || !fix_node(&n->left)
+	    || !fix_node(&n->els) || !fix_word(&n->name)
+	    || !fix_items(&n->items)) {
+	    return false;
+	}
+
+	// The automaton of a case_clause is never stored, but an image is
+	// not trusted to say so.
+	n->pat = NULL;
+    }
+
+    return true;
+}
@@ -0,0 +1,14 @@
+//
+// cache.h - persistent parsed-script cache
+//
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include "ast.h"
+
+Node *cache_load(const char *, const char *, size_t);
+void cache_store(const char *, const char *, size_t, Node *);
+
+#endif
@@ -0,0 +1,479 @@
+//
+// check.c - syntax checks of script trees
+//
+// check_run() parses every script of the files and the directories it is
+// given, without running them, on a pool of threads. Each thread has a
+// deque of tasks, a file to check or a directory to read: it takes its own
+// tasks from the bottom, last in first, so that it goes down the tree it
+// is in, and pushes there the entries of the directories it reads. A
+// thread with no task left steals the oldest one of another thread, from
+// the top of its deque, which is the largest part of the tree left there.
+//
+// Each thread parses with a lexer and a parser of its own, whose tokens
+// and trees are carved from an arena reset after every file, and appends
+// the errors it finds to a buffer of its own. Once every thread is done,
+// the errors are written file by file in the order of their paths, so the
+// output does not depend on which thread checked what.
+//
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "check.h"
+#include "lex.h"
+#include "parse.h"
+#include "arena.h"
+#include "str.h"
+
+typedef struct __sTask Task;
+typedef struct __sResult Result;
+typedef struct __sWorker Worker;
+
+int check_run(char **, int, int);
+static void *work(void *);
+static void push(Worker *, char *, int);
+static bool pop(Worker *, Task *);
+static bool steal(Worker *, Task *);
+static void run(Worker *, Task *);
+static void walk(Worker *, char *);
+static void check(Worker *, char *, bool);
+static bool script(int, const char *);
+static bool slurp(Worker *, int);
+static void fail(Worker *, char *, const char *);
+static void record(Worker *, char *, size_t, size_t);
+static int compare(const void *, const void *);
+
+// ---------------------------------------------------------------------------
+
+enum {
+    Named,			// an operand of check_run(), a file or a directory
+    Dir,			// a directory found in a directory
+    File,			// a file found in a directory, checked if a script
+};
+
+// Task is a path to check.
+struct __sTask {
+    char *path;
+    int kind;
+};
+
+// Result holds the errors found in a file, as the bytes of Worker->diag
+// from off.
+struct __sResult {
+    char *path;
+    size_t off;
+    size_t len;
+    const char *text;		// the errors, once all files are checked
+};
+
+// Worker is a thread of the pool.
+struct __sWorker {
+    pthread_t thread;
+
+    pthread_mutex_t lock;	// guards the deque
+    Task *tasks;		// the deque, from top to bottom
+    size_t top;
+    size_t bottom;
+    size_t cap;
+    unsigned seed;		// picks the first thread to steal from
+
+    Parser *parser;
+    Arena arena;
+    Str diag;
+    Result *results;
+    size_t nresults;
+    size_t capresults;
+
+    char *buf;			// the file being checked
+    size_t capbuf;
+
+    size_t files;
+    size_t errors;
+};
+
+static Worker *workers;
+static int nworkers;
+static atomic_size_t pending;	// tasks pushed and not done yet
+
+// check_run checks the syntax of the n files and directories of paths with
+// nthreads threads, or one for each CPU if it is not positive, writes the
+// errors it finds and how long it took to the standard error, and returns
+// the exit status of the check.
+//
+// The files named in paths are all checked. Those found in a directory
+// are only if their name ends in ".sh" or their first line is "#!" and the
+// path of a shell. The symbolic links found in a directory are not
+// followed.
+int check_run(char **paths, int n, int nthreads)
+{
+    nworkers = nthreads > 0 ? nthreads : sysconf(_SC_NPROCESSORS_ONLN);
+    if (nworkers < 1) {
+	nworkers = 1;
+    }
+
+    workers = calloc(nworkers, sizeof(Worker));
+    for (int i = 0; i < nworkers; i++) {
+	pthread_mutex_init(&workers[i].lock, NULL);
+	str_init(&workers[i].diag);
+	workers[i].seed = i + 1;
+    }
+
+    atomic_store(&pending, n);
+    for (int i = 0; i < n; i++) {
+	push(&workers[i % nworkers], strdup(paths[i]), Named);
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 1; i < nworkers; i++) {
+	pthread_create(&workers[i].thread, NULL, work, &workers[i]);
+    }
+
+    work(&workers[0]);
+    for (int i = 1; i < nworkers; i++) {
+	pthread_join(workers[i].thread, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double t = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    size_t files = 0;
+    size_t errors = 0;
+    size_t nresults = 0;
+    for (int i = 0; i < nworkers; i++) {
+	files += workers[i].files;
+	errors += workers[i].errors;
+	nresults += workers[i].nresults;
+    }
+
+    Result *results = malloc(sizeof(Result) * (nresults + 1));
+    nresults = 0;
+    for (int i = 0; i < nworkers; i++) {
+	Worker *w = &workers[i];
+	for (size_t j = 0; j < w->nresults; j++) {
+	    results[nresults] = w->results[j];
+	    results[nresults++].text = w->diag.s + w->results[j].off;
+	}
+    }
+
+    qsort(results, nresults, sizeof(Result), compare);
+    for (size_t i = 0; i < nresults; i++) {
+	fwrite(results[i].text, 1, results[i].len, stderr);
+	free(results[i].path);
+    }
+
+    fprintf(stderr, "%zu files, %zu errors, %.3f s, %.0f files/s\n",
+	    files, errors, t, t > 0 ? files / t : 0.0);
+
+    for (int i = 0; i < nworkers; i++) {
+	Worker *w = &workers[i];
+	pthread_mutex_destroy(&w->lock);
+	arena_release(&w->arena);
+	str_free(&w->diag);
+	free(w->tasks);
+	free(w->results);
+	free(w->buf);
+    }
+
+    free(results);
+    free(workers);
+    return errors ? 2 : 0;
+}
+
+// work runs the tasks of w, then those it steals, until there are none
+// left anywhere.
+static void *work(void *arg)
+{
+    Worker *w = arg;
+
+    w->parser = parser_make(lex_make());
+    w->parser->diag = &w->diag;
+    arena_use(&w->arena);
+
+    Task t;
+    while (atomic_load(&pending) > 0) {
+	if (pop(w, &t) || steal(w, &t)) {
+	    run(w, &t);
+	    atomic_fetch_sub(&pending, 1);
+	} else {
+	    sched_yield();
+	}
+    }
+
+    arena_use(NULL);
+    return NULL;
+}
+
+// push adds the task of path to the bottom of the deque of w. It is counted
+// as pending by the caller.
+static void push(Worker *w, char *path, int kind)
+{
+    pthread_mutex_lock(&w->lock);
+
+    if (w->bottom == w->cap) {
+	if (w->top > w->cap / 2) {
+	    memmove(w->tasks, w->tasks + w->top,
+		    sizeof(Task) * (w->bottom - w->top));
+	    w->bottom -= w->top;
+	    w->top = 0;
+	} else {
+	    w->cap = w->cap ? w->cap * 2 : 64;
+	    w->tasks = realloc(w->tasks, sizeof(Task) * w->cap);
+	}
+    }
+
+    w->tasks[w->bottom++] = (Task) {path, kind};
+    pthread_mutex_unlock(&w->lock);
+}
+
+// pop takes into *t the task at the bottom of the deque of w, and returns
+// false if there is none.
+static bool pop(Worker *w, Task *t)
+{
+    pthread_mutex_lock(&w->lock);
+
+    bool ok = w->bottom > w->top;
+    if (ok) {
+	*t = w->tasks[--w->bottom];
+    }
+
+    if (w->bottom == w->top) {
+	w->top = 0;
+	w->bottom = 0;
+    }
+
+    pthread_mutex_unlock(&w->lock);
+    return ok;
+}
+
+// steal takes into *t the task at the top of the deque of another thread
+// than w, and returns false if there is none.
+static bool steal(Worker *w, Task *t)
+{
+    int first = rand_r(&w->seed) % nworkers;
+
+    for (int i = 0; i < nworkers; i++) {
+	Worker *v = &workers[(first + i) % nworkers];
+	if (v == w) {
+	    continue;
+	}
+
+	pthread_mutex_lock(&v->lock);
+
+	bool ok = v->bottom > v->top;
+	if (ok) {
+	    *t = v->tasks[v->top++];
+	}
+
+	pthread_mutex_unlock(&v->lock);
+	if (ok) {
+	    return true;
+	}
+    }
+
+    return false;
+}
+
+// run does the task t.
+static void run(Worker *w, Task *t)
+{
+    if (t->kind == Dir) {
+	walk(w, t->path);
+	return;
+    }
+
+    if (t->kind == File) {
+	check(w, t->path, false);
+	return;
+    }
+
+    struct stat st;
+    if (stat(t->path, &st) < 0) {
+	fail(w, t->path, strerror(errno));
+    } else if (S_ISDIR(st.st_mode)) {
+	walk(w, t->path);
+    } else {
+	check(w, t->path, true);
+    }
+}
+
+// walk pushes the directories and the regular files of the directory path
+// as tasks of w.
+static void walk(Worker *w, char *path)
+{
+    DIR *dp = opendir(path);
+    if (!dp) {
+	fail(w, path, strerror(errno));
+	return;
+    }
+
+    size_t len = strlen(path);
+    while (len > 1 && path[len - 1] == '/') {
+	len--;
+    }
+
+    for (struct dirent *e; (e = readdir(dp));) {
+	const char *name = e->d_name;
+	if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]))) {
+	    continue;
+	}
+
+	int type = e->d_type;
+	struct stat st;
+	if (type == DT_UNKNOWN
+	    && fstatat(dirfd(dp), name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+	    type = S_ISDIR(st.st_mode) ? DT_DIR
+		: S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+	}
+
+	if (type != DT_DIR && type != DT_REG) {
+	    continue;
+	}
+
+	size_t n = strlen(name);
+	char *child = malloc(len + n + 2);
+	memcpy(child, path, len);
+	child[len] = '/';
+	memcpy(child + len + 1, name, n + 1);
+
+	atomic_fetch_add(&pending, 1);
+	push(w, child, type == DT_DIR ? Dir : File);
+    }
+
+    closedir(dp);
+    free(path);
+}
+
+// check parses the file path, if it is a script or named is set, and
+// records the errors found in it.
+static void check(Worker *w, char *path, bool named)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+	fail(w, path, strerror(errno));
+	return;
+    }
+
+    if (!named && !script(fd, path)) {
+	close(fd);
+	free(path);
+	return;
+    }
+
+    bool ok = slurp(w, fd);
+    int err = errno;
+    close(fd);
+
+    if (!ok) {
+	fail(w, path, strerror(err));
+	return;
+    }
+
+    size_t off = w->diag.len;
+    w->parser->name = path;
+    lex_readfrom(w->buf);
+    parser_parse();
+
+    arena_reset(&w->arena);
+    w->files++;
+    record(w, path, off, w->parser->nerr);
+}
+
+// script checks whether the file of fd, called path, is a shell script.
+static bool script(int fd, const char *path)
+{
+    size_t len = strlen(path);
+    if (len > 3 && !strcmp(path + len - 3, ".sh")) {
+	return true;
+    }
+
+    char line[128];
+    ssize_t n = pread(fd, line, sizeof(line) - 1, 0);
+    if (n < 2 || line[0] != '#' || line[1] != '!') {
+	return false;
+    }
+
+    line[n] = '\0';
+    line[strcspn(line, "\n")] = '\0';
+    return strstr(line, "sh") != NULL;
+}
+
+// slurp reads the file of fd into Worker->buf, NULL-terminated, and
+// returns false on error.
+static bool slurp(Worker *w, int fd)
+{
+    size_t len = 0;
+
+    for (;;) {
+	if (len + 1 >= w->capbuf) {
+	    w->capbuf = w->capbuf ? w->capbuf * 2 : 64 * 1024;
+	    w->buf = realloc(w->buf, w->capbuf);
+	}
+
+	ssize_t n = read(fd, w->buf + len, w->capbuf - len - 1);
+	if (n < 0) {
+	    if (errno == EINTR) {
+		continue;
+	    }
+
+	    return false;
+	}
+
+	if (n == 0) {
+	    break;
+	}
+
+	len += n;
+    }
+
+    w->buf[len] = '\0';
+    return true;
+}
+
+// fail records the error of the file path that could not be checked.
+static void fail(Worker *w, char *path, const char *err)
+{
+    size_t off = w->diag.len;
+    str_puts(&w->diag, path);
+    str_puts(&w->diag, ": ");
+    str_puts(&w->diag, err);
+    str_putc(&w->diag, '\n');
+    record(w, path, off, 1);
+}
+
+// record counts the nerr errors of path written to Worker->diag from off,
+// and keeps them to be written once all files are checked. It frees path
+// if there are none.
+static void record(Worker *w, char *path, size_t off, size_t nerr)
+{
+    w->errors += nerr;
+    if (w->diag.len == off) {
+	free(path);
+	return;
+    }
+
+    if (w->nresults == w->capresults) {
+	w->capresults = w->capresults ? w->capresults * 2 : 64;
+	w->results = realloc(w->results, sizeof(Result) * w->capresults);
+    }
+
+    w->results[w->nresults++] = (Result) {path, off, w->diag.len - off, NULL};
+}
+
+// compare orders two results by their path.
+static int compare(const void *a, const void *b)
+{
+    return strcmp(((const Result *) a)->path, ((const Result *) b)->path);
+}
@@ -0,0 +1,10 @@
+//
+// check.h - syntax checks of script trees
+//
+
+#ifndef CHECK_H
+#define CHECK_H
+
+int check_run(char **, int, int);
+
+#endif
@@ -0,0 +1,521 @@
+//
+// cmds.c - command names
+//
+// The names a command can be called by, for completion, are kept in a
+// compressed trie: the executables of the directories of PATH, the builtin
+// utilities and the reserved words. An edge holds all the bytes between
+// two branches, and a node the number of names under it, so that
+// completing a prefix costs what the prefix takes, however many names
+// there are. The trie is built when a name is first completed or the
+// first command is entered, not as the shell starts, then kept up to date
+// with the inotify events of the directories: a name created, deleted,
+// moved or chmodded in any of them is looked up again in PATH order,
+// alone. When PATH changes or events are lost, the trie is built again.
+//
+// A name also keeps the first directory of PATH it is found in, so that
+// the command is run from there without searching PATH again, once the
+// trie is built. It is built in the shell process only: a script, which
+// never calls cmds_refresh(), searches PATH as usual.
+//
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include "cmds.h"
+#include "builtin.h"
+#include "keyw.h"
+#include "var.h"
+#include "str.h"
+
+#define NONE (-1)
+#define EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO \
+		| IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF)
+
+typedef struct __sTrie Trie;
+
+void cmds_refresh(void);
+size_t cmds_complete(const char *, size_t, Str *);
+size_t cmds_list(const char *, size_t, Str *, size_t);
+const char *cmds_dir(const char *);
+static void build(void);
+static void recheck(const char *);
+static bool executable(int, const char *);
+static void update(const char *, size_t, int, bool);
+static Trie *find(const char *, size_t, size_t *);
+static Trie *lookup(const char *, size_t);
+static Trie *set(const char *, size_t);
+static void count(const char *, size_t, int);
+static void prune(Trie **, const char *, size_t);
+static Trie **child(Trie *, char);
+static void walk(Trie *, Str *, Str *, size_t *);
+static void clear(Trie *);
+
+// ---------------------------------------------------------------------------
+
+// Trie is a node of the trie of the names.
+struct __sTrie {
+    char *edge;			// bytes from its parent
+    size_t len;
+    size_t count;		// names here and under
+    int dir;			// index in dirs of the first with it, or NONE
+    bool word;			// whether a builtin or a reserved word
+    Trie *child;		// first child, by their first byte
+    Trie *next;			// next sibling
+};
+
+static Trie root = {.dir = NONE };
+
+static char *path;		// PATH the trie is for, NULL before it is built
+static char *copy;		// copy of it cut into its directories
+static char **dirs;
+static int *fds;		// descriptor of each, or -1
+static int ndirs;
+static int relative;		// index of the first relative one, or ndirs
+static int ino = -1;		// inotify descriptor watching them
+
+// cmds_refresh brings the trie up to date with the changes of PATH and of
+// its directories since the last call, or builds it the first time.
+void cmds_refresh(void)
+{
+    if (!path) {
+	build();
+	return;
+    }
+
+    const char *p = var_get("PATH");
+    if (strcmp(p ? p : "", path)) {
+	build();
+	return;
+    }
+
+    char buf[4096]
+	__attribute__((aligned(__alignof__(struct inotify_event))));
+    bool lost = false;
+    ssize_t n;
+
+    while (ino >= 0 && (n = read(ino, buf, sizeof(buf))) > 0) {
+	for (char *q = buf; q < buf + n;) {
+	    struct inotify_event *e = (struct inotify_event *) q;
+
+	    if (e->mask & (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF
+			   | IN_MOVE_SELF)) {
+		lost = true;
+	    } else if (e->len) {
+		recheck(e->name);
+	    }
+
+	    q += sizeof(*e) + e->len;
+	}
+    }
+
+    if (lost) {
+	build();
+    }
+}
+
+// cmds_complete appends to out the bytes that every command name starting
+// with the n bytes of prefix has next, and returns how many names do.
+size_t cmds_complete(const char *prefix, size_t n, Str *out)
+{
+    if (!path) {
+	build();
+    }
+
+    size_t past;
+    Trie *t = find(prefix, n, &past);
+    if (!t || !t->count) {
+	return 0;
+    }
+
+    str_putn(out, t->edge + past, t->len - past);
+
+    // Below the root, a node with no name has several children.
+    while (t->dir == NONE && !t->word && t->child && !t->child->next) {
+	t = t->child;
+	str_putn(out, t->edge, t->len);
+    }
+
+    return t->count;
+}
+
+// cmds_list appends to out the first max command names starting with the
+// n bytes of prefix, in byte order, each followed by a '\0', and returns
+// how many it appended.
+size_t cmds_list(const char *prefix, size_t n, Str *out, size_t max)
+{
+    if (!path) {
+	build();
+    }
+
+    size_t past;
+    Trie *t = find(prefix, n, &past);
+    if (!t) {
+	return 0;
+    }
+
+    Str name;
+    str_init(&name);
+    str_putn(&name, prefix, n);
+    str_putn(&name, t->edge + past, t->len - past);
+
+    size_t left = max;
+    walk(t, &name, out, &left);
+    str_free(&name);
+    return max - left;
+}
+
+// cmds_dir returns the directory the external command name is run from,
+// or NULL if it has to be searched for.
+const char *cmds_dir(const char *name)
+{
+    const char *p = var_get("PATH");
+    if (!path || ino < 0 || strcmp(p ? p : "", path)) {
+	return NULL;
+    }
+
+    Trie *t = lookup(name, strlen(name));
+    return t && t->dir != NONE && t->dir < relative ? dirs[t->dir] : NULL;
+}
+
+// build builds the trie again from PATH, and watches its directories.
+static void build(void)
+{
+    clear(&root);
+    root.count = 0;
+    free(path);
+    free(copy);
+    for (int i = 0; i < ndirs; i++) {
+	if (fds[i] >= 0) {
+	    close(fds[i]);
+	}
+    }
+    free(dirs);
+    free(fds);
+    if (ino >= 0) {
+	close(ino);
+    }
+
+    const char *p = var_get("PATH");
+    path = strdup(p ? p : "");
+    copy = strdup(path);
+
+    // An empty directory stands for the current one.
+    ndirs = 0;
+    dirs = malloc(sizeof(char *) * (strlen(path) / 2 + 2));
+    fds = malloc(sizeof(int) * (strlen(path) / 2 + 2));
+    for (char *s = copy, *colon;; s = colon + 1) {
+	colon = strchr(s, ':');
+	if (colon) {
+	    *colon = '\0';
+	}
+	dirs[ndirs++] = *s ? s : ".";
+	if (!colon) {
+	    break;
+	}
+    }
+
+    for (int i = 0; keyw_name(i); i++) {
+	if (isalpha((unsigned char) keyw_name(i)[0])) {
+	    update(keyw_name(i), strlen(keyw_name(i)), NONE, true);
+	}
+    }
+
+    for (int i = 0; builtin_name(i); i++) {
+	if (isalpha((unsigned char) builtin_name(i)[0])) {
+	    update(builtin_name(i), strlen(builtin_name(i)), NONE, true);
+	}
+    }
+
+    // A directory is watched before it is read, so that no change to it
+    // is missed in between.
+    ino = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    relative = ndirs;
+
+    for (int i = 0; i < ndirs; i++) {
+	fds[i] = -1;
+	if (dirs[i][0] != '/') {
+	    relative = relative < i ? relative : i;
+	    continue;
+	}
+
+	if (ino >= 0) {
+	    inotify_add_watch(ino, dirs[i], EVENTS | IN_ONLYDIR);
+	}
+
+	fds[i] = open(dirs[i], O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	DIR *d = fds[i] >= 0 ? fdopendir(fcntl(fds[i], F_DUPFD_CLOEXEC, 0)) : NULL;
+	if (!d) {
+	    continue;
+	}
+
+	for (struct dirent *e; (e = readdir(d));) {
+	    if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, "..")) {
+		continue;
+	    }
+
+	    size_t n = strlen(e->d_name);
+	    Trie *t = lookup(e->d_name, n);
+	    if ((!t || t->dir == NONE) && executable(dirfd(d), e->d_name)) {
+		update(e->d_name, n, i, t && t->word);
+	    }
+	}
+
+	closedir(d);
+    }
+}
+
+// recheck looks the command name up again in the directories of PATH.
+static void recheck(const char *name)
+{
+    int dir = NONE;
+
+    for (int i = 0; i < ndirs && dir == NONE; i++) {
+	if (fds[i] >= 0 && executable(fds[i], name)) {
+	    dir = i;
+	}
+    }
+
+    size_t n = strlen(name);
+    Trie *t = lookup(name, n);
+    if (t || dir != NONE) {
+	update(name, n, dir, t && t->word);
+    }
+}
+
+// executable checks whether name in the directory dfd is a file that can
+// be run.
+static bool executable(int dfd, const char *name)
+{
+    struct stat st;
+    return fstatat(dfd, name, &st, 0) == 0 && S_ISREG(st.st_mode)
+	&& st.st_mode & 0111;
+}
+
+// update sets what the name s of n bytes is: found first in the directory
+// dir, a builtin or reserved word if word is set, or no command at all.
+static void update(const char *s, size_t n, int dir, bool word)
+{
+    Trie *t = set(s, n);
+    bool was = t->dir != NONE || t->word;
+    bool is = dir != NONE || word;
+
+    t->dir = dir;
+    t->word = word;
+
+    if (was != is) {
+	count(s, n, is ? 1 : -1);
+    }
+
+    if (!is) {
+	Trie *r = &root;
+	prune(&r, s, n);
+    }
+}
+
+// find returns the node of the trie the n bytes of s lead to, setting
+// *past to the bytes of its edge they take, or NULL if no name starts
+// with them.
+static Trie *find(const char *s, size_t n, size_t *past)
+{
+    Trie *t = &root;
+    *past = 0;
+
+    while (n > 0) {
+	Trie *c = *child(t, *s);
+	if (!c || c->edge[0] != *s) {
+	    return NULL;
+	}
+
+	size_t k = 1;
+	while (k < c->len && k < n && c->edge[k] == s[k]) {
+	    k++;
+	}
+
+	if (k == n) {
+	    *past = k;
+	    return c;
+	}
+
+	if (k < c->len) {
+	    return NULL;
+	}
+
+	t = c;
+	s += k;
+	n -= k;
+    }
+
+    return t;
+}
+
+// lookup returns the node of the name s of n bytes, or NULL if there is
+// none.
+static Trie *lookup(const char *s, size_t n)
+{
+    size_t past;
+    Trie *t = find(s, n, &past);
+    return t && past == t->len ? t : NULL;
+}
+
+// set returns the node of the name s of n bytes, made if there is none.
+// An edge is split where the name leaves it.
+static Trie *set(const char *s, size_t n)
+{
+    Trie *t = &root;
+
+    while (n > 0) {
+	Trie **l = child(t, *s);
+	Trie *c = *l;
+
+	if (!c || c->edge[0] != *s) {
+	    c = calloc(1, sizeof(Trie));
+	    c->edge = malloc(n);
+	    memcpy(c->edge, s, n);
+	    c->len = n;
+	    c->dir = NONE;
+	    c->next = *l;
+	    *l = c;
+	    return c;
+	}
+
+	size_t k = 1;
+	while (k < c->len && k < n && c->edge[k] == s[k]) {
+	    k++;
+	}
+
+	if (k < c->len) {
+	    Trie *m = calloc(1, sizeof(Trie));
+	    m->edge = malloc(k);
+	    memcpy(m->edge, c->edge, k);
+	    m->len = k;
+	    m->count = c->count;
+	    m->dir = NONE;
+	    m->child = c;
+	    m->next = c->next;
+
+	    memmove(c->edge, c->edge + k, c->len - k);
+	    c->len -= k;
+	    c->next = NULL;
+	    *l = m;
+	    c = m;
+	}
+
+	t = c;
+	s += k;
+	n -= k;
+    }
+
+    return t;
+}
+
+// count adds d to the number of names of the nodes on the way to the name
+// s of n bytes.
+static void count(const char *s, size_t n, int d)
+{
+    Trie *t = &root;
+    t->count += d;
+
+    while (n > 0) {
+	t = *child(t, *s);
+	t->count += d;
+	s += t->len;
+	n -= t->len;
+    }
+}
+
+// prune removes the nodes left with no name under them on the way from
+// *link to the name s of n bytes, and merges those left with no name and
+// a single child with it.
+static void prune(Trie **link, const char *s, size_t n)
+{
+    Trie *t = *link;
+    s += t->len;
+    n -= t->len;
+
+    if (n > 0) {
+	Trie **l = child(t, *s);
+	if (*l && (*l)->edge[0] == *s) {
+	    prune(l, s, n);
+	}
+    }
+
+    if (t == &root || t->dir != NONE || t->word) {
+	return;
+    }
+
+    if (!t->child) {
+	*link = t->next;
+    } else if (!t->child->next) {
+	Trie *c = t->child;
+	char *edge = malloc(t->len + c->len);
+	memcpy(edge, t->edge, t->len);
+	memcpy(edge + t->len, c->edge, c->len);
+	free(c->edge);
+	c->edge = edge;
+	c->len += t->len;
+	c->next = t->next;
+	*link = c;
+    } else {
+	return;
+    }
+
+    free(t->edge);
+    free(t);
+}
+
+// child returns the link to the child of t whose edge starts with c, or
+// to where it would be.
+static Trie **child(Trie *t, char c)
+{
+    Trie **l = &t->child;
+    while (*l && (unsigned char) (*l)->edge[0] < (unsigned char) c) {
+	l = &(*l)->next;
+    }
+
+    return l;
+}
+
+// walk appends to out the names of t and under it, up to *left of them,
+// name being the name of t.
+static void walk(Trie *t, Str *name, Str *out, size_t *left)
+{
+    if (!*left) {
+	return;
+    }
+
+    if (t->dir != NONE || t->word) {
+	str_putn(out, name->s, name->len);
+	str_putc(out, '\0');
+	(*left)--;
+    }
+
+    for (Trie *c = t->child; c && *left; c = c->next) {
+	size_t len = name->len;
+	str_putn(name, c->edge, c->len);
+	walk(c, name, out, left);
+	name->len = len;
+    }
+}
+
+// clear frees the nodes under t.
+static void clear(Trie *t)
+{
+    for (Trie *c = t->child, *next; c; c = next) {
+	next = c->next;
+	clear(c);
+	free(c->edge);
+	free(c);
+    }
+
+    t->child = NULL;
+}
@@ -0,0 +1,16 @@
+//
+// cmds.h - command names
+//
+
+#ifndef CMDS_H
+#define CMDS_H
+
+#include <stddef.h>
+#include "str.h"
+
+void cmds_refresh(void);
+size_t cmds_complete(const char *, size_t, Str *);
+size_t cmds_list(const char *, size_t, Str *, size_t);
+const char *cmds_dir(const char *);
+
+#endif
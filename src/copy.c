@@ -0,0 +1,151 @@
+//
+// copy.c - bulk data movement between descriptors
+//
+// copy_fd() moves what is left to read of a descriptor to another one
+// without bringing it into the shell: with splice(2) when either of them
+// is a pipe, copy_file_range(2) between two regular files, and sendfile(2)
+// from a regular file to anything else. When the kernel can't do it for
+// the descriptors at hand, it falls back to the next of these calls, and
+// last to read(2) and write(2). All of them start and leave the data at
+// the offsets of the descriptors, so the fallback may happen at any time.
+//
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
+#include "copy.h"
+
+#define CHUNK (1 << 30)		// bytes asked of the kernel at once
+#define PIPESIZE (1 << 20)	// capacity asked for a pipe written to
+#define BUFSIZE (128 * 1024)	// buffer of the read and write fallback
+
+ssize_t copy_fd(int, int);
+static ssize_t move(int, int, int);
+static bool unsupported(int);
+static ssize_t copy(int, int);
+
+// ---------------------------------------------------------------------------
+
+enum {
+    Splice,
+    Range,
+    Send,
+    Copy,
+};
+
+// copy_fd moves the data of in to out up to its end, and returns the number
+// of bytes moved, or -1 on error with errno set.
+ssize_t copy_fd(int in, int out)
+{
+    struct stat si;
+    struct stat so;
+    if (fstat(in, &si) < 0 || fstat(out, &so) < 0) {
+	return -1;
+    }
+
+    // The files of /proc and /sys tell a size of zero, and the kernel may
+    // then move nothing of them but with read(2), so they are copied.
+    bool empty = S_ISREG(si.st_mode) && si.st_size == 0;
+    int how = Copy;
+    if (!empty && (S_ISFIFO(si.st_mode) || S_ISFIFO(so.st_mode))) {
+	how = Splice;
+    } else if (!empty && S_ISREG(si.st_mode)) {
+	how = S_ISREG(so.st_mode) ? Range : Send;
+    }
+
+    // A larger pipe takes more of the data in each call, and wakes the
+    // reader less often. It is only a hint.
+    if (how == Splice && S_ISFIFO(so.st_mode)
+	&& fcntl(out, F_GETPIPE_SZ) < PIPESIZE) {
+	fcntl(out, F_SETPIPE_SZ, PIPESIZE);
+    }
+
+    ssize_t total = 0;
+    while (how != Copy) {
+	ssize_t n = move(in, out, how);
+
+	if (n > 0) {
+	    total += n;
+	} else if (n == 0) {
+	    return total;
+	} else if (errno != EINTR) {
+	    if (!unsupported(errno)) {
+		return -1;
+	    }
+
+	    how = how != Send && S_ISREG(si.st_mode) ? Send : Copy;
+	}
+    }
+
+    ssize_t n = copy(in, out);
+    return n < 0 ? -1 : total + n;
+}
+
+// move moves at most CHUNK bytes of in to out the way how, and returns
+// what the call used returns.
+static ssize_t move(int in, int out, int how)
+{
+    switch (how) {
+
+    case Splice:
+	return splice(in, NULL, out, NULL, CHUNK, SPLICE_F_MOVE
+		      | SPLICE_F_MORE);
+
+    case Range:
+	return copy_file_range(in, NULL, out, NULL, CHUNK, 0);
+
+    default:
+	return sendfile(out, in, NULL, CHUNK);
+    }
+}
+
+// unsupported checks whether err, set by move(), tells that the call can't
+// be used with these descriptors, rather than that the data can't be
+// moved. copy_file_range(2) fails with EBADF for an output in append mode.
+static bool unsupported(int err)
+{
+    return err == EINVAL || err == ENOSYS || err == EXDEV
+	|| err == EOPNOTSUPP || err == EBADF || err == ESPIPE;
+}
+
+// copy moves the data of in to out through a buffer.
+static ssize_t copy(int in, int out)
+{
+    char *buf = malloc(BUFSIZE);
+    ssize_t total = 0;
+
+    for (;;) {
+	ssize_t n = read(in, buf, BUFSIZE);
+	if (n < 0 && errno == EINTR) {
+	    continue;
+	}
+
+	if (n <= 0) {
+	    free(buf);
+	    return n < 0 ? -1 : total;
+	}
+
+	for (ssize_t off = 0; off < n;) {
+	    ssize_t m = write(out, buf + off, n - off);
+	    if (m < 0 && errno == EINTR) {
+		continue;
+	    }
+
+	    if (m < 0) {
+		free(buf);
+		return -1;
+	    }
+
+	    off += m;
+	}
+
+	total += n;
+    }
+}
@@ -0,0 +1,12 @@
+//
+// copy.h - bulk data movement between descriptors
+//
+
+#ifndef COPY_H
+#define COPY_H
+
+#include <sys/types.h>
+
+ssize_t copy_fd(int, int);
+
+#endif
@@ -0,0 +1,1348 @@
+//
+// exec.c - tree-walking interpreter
+//
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "ast.h"
+#include "exec.h"
+#include "builtin.h"
+#include "var.h"
+#include "pat.h"
+#include "expand.h"
+#include "parse.h"
+#include "str.h"
+#include "jobs.h"
+#include "stats.h"
+#include "cmds.h"
+#include "table.h"
+
+#define NSAVED 64
+#define PIPESIZE (1024 * 1024)
+#define CHUNK (64 * 1024)
+
+typedef struct __sSubst Subst;
+
+extern char **environ;
+
+int exec_node(Node *);
+void exec_child(Node *) __attribute__((noreturn));
+int exec_text(const char *);
+int exec_file(const char *);
+int exec_status(void);
+void exec_setstatus(int);
+bool exec_interactive(void);
+void exec_setinteractive(bool);
+void exec_break(int);
+void exec_continue(int);
+int exec_builtin(Builtin, Node *);
+int exec_spawn(Node *);
+int exec_async(Node *);
+int exec_pipe(Node *);
+int exec_subshell(Node *);
+int exec_subst(const char *, size_t, Str *);
+int exec_wordlist(Node *, Fields *);
+int exec_match(Node *);
+int exec_redirect(Redir *);
+void exec_unredirect(int);
+static int exec_list(Node *);
+static int exec_simple(Node *, Builtin, bool);
+static int exec_argv(Builtin, Node *, int, char **);
+static int exec_fork(Node *, char **, char **);
+static void exec_command(Node *, char **, char **)
+    __attribute__((noreturn));
+static int exec_if(Node *);
+static int exec_loop(Node *);
+static int exec_for(Node *);
+static int exec_case(Node *);
+static int exec_time(Node *);
+static int pipe_run(Node *, Usage *);
+static void match_compile(Node *);
+static bool match_item(CaseItem *, const char *);
+static bool exec_skip(void);
+static bool exec_unwind(void);
+static int redir_apply(Redir *, bool);
+static int redir_open(Redir *);
+static void redir_restore(int);
+static Subst *subst_lookup(const char *, size_t);
+static bool subst_inproc(Node *);
+static bool subst_same(const void *, const void *);
+static bool subst_word(const char *);
+static void subst_run(Node *, Str *);
+static void subst_fork(Node *, Str *);
+static const char *label(Node *);
+static void report(const char *, const Usage *, const char *);
+
+// ---------------------------------------------------------------------------
+
+// Skip tells which loop control builtin is unwinding the tree walk.
+typedef enum {
+    SkipNone,
+    SkipBreak,
+    SkipCont,
+} Skip;
+
+// Subst is the command of a command substitution, parsed the first time it
+// runs and kept in an open addressing table by its text.
+struct __sSubst {
+    uint64_t hash;
+    char *text;
+    size_t len;
+    Node *tree;
+    bool inproc;		// whether it runs in the shell process
+};
+
+// Saved is a descriptor moved away by a redirection of a command run in the
+// shell process, to be put back once the command is done.
+typedef struct __sSaved {
+    int fd;
+    int save;			// copy of fd, or -1 if fd was not open
+} Saved;
+
+static int status;		// exit status of the last command
+static bool interactive;	// whether commands are read from a user
+static int loops;		// number of enclosing loops
+static Skip skip;		// pending break or continue
+static int skipn;		// loops still to be skipped by skip
+
+static Saved saved[NSAVED];
+static int nsaved;
+
+static Table substs = {.size = sizeof(Subst) };
+static int substatus;		// of the last command substitution, or -1
+static bool recorded;		// whether the parent adds this process to stats
+
+// exec_node runs the tree n and returns its exit status. The loop bodies
+// and every other subtree are walked as they are; nothing is lexed or
+// parsed again, however many times a node runs.
+int exec_node(Node *n)
+{
+    if (!n) {
+	return status;
+    }
+
+    int mark = nsaved;
+    if (n->type != NSimple && n->redir) {
+	mark = exec_redirect(n->redir);
+	if (mark < 0) {
+	    return status = 1;
+	}
+    }
+
+    switch (n->type) {
+
+    case NSimple:
+	exec_simple(n, NULL, false);
+	break;
+
+    case NPipe:
+	exec_pipe(n);
+	break;
+
+    case NNot:
+	status = !exec_node(n->left);
+	break;
+
+    case NAnd:
+	if (exec_node(n->left) == 0 && !exec_skip()) {
+	    exec_node(n->right);
+	}
+	break;
+
+    case NOr:
+	if (exec_node(n->left) != 0 && !exec_skip()) {
+	    exec_node(n->right);
+	}
+	break;
+
+    case NList:
+	exec_list(n);
+	break;
+
+    case NBrace:
+	exec_node(n->left);
+	break;
+
+    case NSubshell:
+	exec_subshell(n);
+	break;
+
+    case NIf:
+	exec_if(n);
+	break;
+
+    case NWhile:
+    case NUntil:
+	exec_loop(n);
+	break;
+
+    case NFor:
+	exec_for(n);
+	break;
+
+    case NCase:
+	exec_case(n);
+	break;
+
+    case NTime:
+	exec_time(n);
+	break;
+    }
+
+    redir_restore(mark);
+    return status;
+}
+
+// exec_child runs n in a process that has just been forked and exits with
+// its status. A simple command that is not a builtin replaces the process
+// rather than being forked once more.
+void exec_child(Node *n)
+{
+    if (n->type == NSimple) {
+	_exit(exec_simple(n, NULL, true));
+    }
+
+    _exit(exec_node(n));
+}
+
+// exec_text runs the complete commands of text one at a time, each one
+// parsed once those before it ran, so that it sees the aliases they
+// defined. It returns the status of the last one, zero if there is none,
+// or 2 on a syntax error, after which nothing more of text runs.
+int exec_text(const char *text)
+{
+    Input in;
+    Parser *p = parser_push(text, &in);
+    status = 0;
+
+    for (;;) {
+	Node *n = parser_next();
+	if (p->nerr) {
+	    status = 2;
+	    break;
+	}
+
+	if (!n) {
+	    break;
+	}
+
+	exec_node(n);
+	ast_free(n);
+    }
+
+    parser_pop(&in);
+    return status;
+}
+
+// exec_file runs the commands of the file at path as exec_text() does, and
+// returns their status, or -1 with errno set if the file can't be read.
+int exec_file(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+	return -1;
+    }
+
+    Str text;
+    str_init(&text);
+    bool ok = str_read(&text, fd);
+    int err = errno;
+    close(fd);
+
+    int st = ok ? exec_text(str_cstr(&text)) : -1;
+    str_free(&text);
+    errno = err;
+    return st;
+}
+
+// exec_status returns the exit status of the last command.
+int exec_status(void)
+{
+    return status;
+}
+
+// exec_setstatus sets the exit status of the last command.
+void exec_setstatus(int st)
+{
+    status = st;
+}
+
+// exec_interactive checks whether the shell is interactive.
+bool exec_interactive(void)
+{
+    return interactive;
+}
+
+// exec_setinteractive sets whether the shell is interactive.
+void exec_setinteractive(bool on)
+{
+    interactive = on;
+}
+
+// exec_break makes the n innermost enclosing loops stop.
+void exec_break(int n)
+{
+    if (loops == 0) {
+	return;
+    }
+
+    skip = SkipBreak;
+    skipn = n < loops ? n : loops;
+}
+
+// exec_continue makes the n-th innermost enclosing loop go on with its next
+// iteration.
+void exec_continue(int n)
+{
+    if (loops == 0) {
+	return;
+    }
+
+    skip = SkipCont;
+    skipn = n < loops ? n : loops;
+}
+
+// exec_skip checks whether a break or continue is pending.
+static bool exec_skip(void)
+{
+    return skip != SkipNone;
+}
+
+// exec_unwind consumes a pending break or continue when it reaches the
+// loop it stops at, and checks whether the current loop has to stop.
+static bool exec_unwind(void)
+{
+    if (!exec_skip()) {
+	return false;
+    }
+
+    if (skip == SkipCont && --skipn == 0) {
+	skip = SkipNone;
+	return false;
+    }
+
+    if (skip == SkipBreak && --skipn == 0) {
+	skip = SkipNone;
+    }
+
+    return true;
+}
+
+// exec_list runs the and_or of every item of the list n in turn. Items
+// followed by '&' are run in a child process that is not waited for.
+static int exec_list(Node *n)
+{
+    for (; n; n = n->right) {
+	if (!n->bg) {
+	    exec_node(n->left);
+	} else {
+	    exec_async(n->left);
+	}
+
+	if (exec_skip()) {
+	    break;
+	}
+    }
+
+    return status;
+}
+
+// exec_simple expands the words of the simple command n and runs it. fn is
+// the builtin it runs, or NULL if it has to be looked up. Builtins run in
+// the shell process with their redirections undone afterwards; any other
+// command runs in a child process, or replaces the current process if
+// child is set.
+//
+// The assignments of n last when there is no command or when it is a
+// special builtin. A regular builtin sees them until it returns, and any
+// other command in its environment only.
+static int exec_simple(Node *n, Builtin fn, bool child)
+{
+    Fields f;
+    Fields a;
+    fields_init(&f);
+    fields_init(&a);
+    substatus = -1;
+
+    if (expand_words(n->argv, n->argc, &f) < 0
+	|| expand_assigns(n->assigns, n->nassigns, &a) < 0) {
+	fields_free(&f);
+	fields_free(&a);
+	return status = 1;
+    }
+
+    char **argv = fields_argv(&f);
+    char **vars = fields_argv(&a);
+    if (!fn && f.n > 0) {
+	fn = builtin_lookup(argv[0]);
+    }
+
+    if (f.n == 0 || (fn && builtin_special(fn))) {
+	for (size_t i = 0; i < a.n; i += 2) {
+	    var_set(vars[i], vars[i + 1]);
+	}
+	exec_argv(fn, n, f.n, argv);
+
+	// Without a command, the status is that of the last command
+	// substitution.
+	if (f.n == 0 && status == 0 && substatus > 0) {
+	    status = substatus;
+	}
+    } else if (fn) {
+	size_t mark = var_mark();
+	for (size_t i = 0; i < a.n; i += 2) {
+	    var_local(vars[i], vars[i + 1]);
+	}
+	exec_argv(fn, n, f.n, argv);
+	var_restore(mark);
+    } else if (child) {
+	exec_command(n, argv, vars);
+    } else {
+	exec_fork(n, argv, vars);
+    }
+
+    fields_free(&f);
+    fields_free(&a);
+    return status;
+}
+
+// exec_builtin runs the builtin fn with the words and redirections of the
+// simple command n.
+int exec_builtin(Builtin fn, Node *n)
+{
+    return exec_simple(n, fn, false);
+}
+
+// exec_spawn runs the simple command n, whose first word is not a builtin
+// before expansion.
+int exec_spawn(Node *n)
+{
+    return exec_simple(n, NULL, false);
+}
+
+// exec_argv runs the builtin fn with the argc fields of argv, and with the
+// redirections of the simple command n. Without fn, as for a command with
+// no words, only the redirections are performed. The builtin is added to
+// the stats, unless the process is a child whose parent adds it.
+static int exec_argv(Builtin fn, Node *n, int argc, char **argv)
+{
+    int mark = exec_redirect(n->redir);
+    if (mark < 0) {
+	return status = 1;
+    }
+
+    if (!fn) {
+	status = 0;
+    } else if (!stats_active() || recorded) {
+	status = fn(argc, argv);
+    } else {
+	Usage u;
+	stats_begin(&u);
+	status = fn(argc, argv);
+	stats_end(&u);
+	stats_add(argv[0], getpid(), status, &u);
+    }
+
+    exec_unredirect(mark);
+    return status;
+}
+
+// exec_fork runs the external command argv with the assignments vars and
+// the redirections of the simple command n in a child process and waits
+// for it.
+static int exec_fork(Node *n, char **argv, char **vars)
+{
+    pid_t pid = jobs_fork(false);
+    if (pid < 0) {
+	perror("fork");
+	return status = 1;
+    }
+
+    if (pid == 0) {
+	exec_command(n, argv, vars);
+    }
+
+    Usage u;
+    status = jobs_wait(pid, &u);
+    stats_add(argv[0], pid, status, &u);
+    return status;
+}
+
+// exec_command replaces the current process with the external command argv,
+// after performing the redirections of the simple command n. vars holds
+// the name and the value of each variable to add to its environment. They
+// are assigned here, in the child process, so that the variables of the
+// shell are left untouched without copying them.
+static void exec_command(Node *n, char **argv, char **vars)
+{
+    if (redir_apply(n->redir, false) < 0) {
+	_exit(1);
+    }
+
+    for (; *vars; vars += 2) {
+	var_set(vars[0], vars[1]);
+	var_export(vars[0]);
+    }
+
+    environ = var_environ();
+
+    // A command whose directory is known is run from there, without
+    // searching PATH.
+    const char *dir = strchr(argv[0], '/') ? NULL : cmds_dir(argv[0]);
+    if (dir) {
+	Str path;
+	str_init(&path);
+	str_puts(&path, dir);
+	str_putc(&path, '/');
+	str_puts(&path, argv[0]);
+	execv(str_cstr(&path), argv);
+    }
+
+    execvp(argv[0], argv);
+
+    int err = errno;
+    fprintf(stderr, "%s: %s\n", argv[0],
+	    err == ENOENT ? "not found" : strerror(err));
+    _exit(err == ENOENT ? 127 : 126);
+}
+
+// exec_async runs n in a child process that is not waited for.
+int exec_async(Node *n)
+{
+    pid_t pid = jobs_fork(true);
+    if (pid == 0) {
+	recorded = false;
+	exec_child(n);
+    }
+
+    return status = pid < 0;
+}
+
+// exec_pipe runs every command of the pipe_sequence n in its own process,
+// with the standard output of each one connected to the standard input of
+// the next one. The status is the status of the last command.
+int exec_pipe(Node *n)
+{
+    return pipe_run(n, NULL);
+}
+
+// pipe_run runs the pipe_sequence n as exec_pipe() does. If stages is not
+// NULL, it is set to what the process of each command used.
+static int pipe_run(Node *n, Usage *stages)
+{
+    size_t len = 0;
+    for (Node *p = n; p; p = p->right) {
+	len++;
+    }
+
+    pid_t *pids = malloc(sizeof(pid_t) * len);
+    size_t npids = 0;
+    int in = -1;
+
+    for (Node *p = n; p; p = p->right) {
+	int fds[2] = { -1, -1 };
+
+	if (p->right && pipe(fds) < 0) {
+	    perror("pipe");
+	    break;
+	}
+
+	pid_t pid = jobs_fork(false);
+	if (pid < 0) {
+	    perror("fork");
+	    close(fds[0]);
+	    close(fds[1]);
+	    break;
+	}
+
+	if (pid == 0) {
+	    if (in != -1) {
+		dup2(in, 0);
+		close(in);
+	    }
+
+	    if (p->right) {
+		close(fds[0]);
+		dup2(fds[1], 1);
+		close(fds[1]);
+	    }
+
+	    recorded = true;
+	    exec_child(p->left);
+	}
+
+	if (in != -1) {
+	    close(in);
+	    in = -1;
+	}
+
+	if (p->right) {
+	    close(fds[1]);
+	    in = fds[0];
+	}
+
+	pids[npids++] = pid;
+    }
+
+    if (in != -1) {
+	close(in);
+    }
+
+    status = 1;
+    Node *p = n;
+    for (size_t i = 0; i < npids; i++, p = p->right) {
+	Usage u;
+	status = jobs_wait(pids[i], &u);
+	stats_add(label(p->left), pids[i], status, &u);
+
+	if (stages) {
+	    stages[i] = u;
+	}
+    }
+
+    free(pids);
+    return status;
+}
+
+// exec_subshell runs the compound_list of n in a child process, so that it
+// can't change the state of the shell.
+int exec_subshell(Node *n)
+{
+    pid_t pid = jobs_fork(false);
+    if (pid < 0) {
+	perror("fork");
+	return status = 1;
+    }
+
+    if (pid == 0) {
+	recorded = true;
+	_exit(exec_node(n->left));
+    }
+
+    Usage u;
+    status = jobs_wait(pid, &u);
+    stats_add(label(n), pid, status, &u);
+    return status;
+}
+
+// exec_subst runs the command of the len bytes at text, as for a command
+// substitution, and appends its output to out, less its trailing
+// newlines. The command is parsed only the first time it runs. A builtin,
+// or a list or pipe_sequence of them, that can't change the shell runs in
+// the shell process with its output captured in out; anything else runs in
+// a child process and its output is read from a pipe. It returns -1 if the
+// command has syntax errors.
+int exec_subst(const char *text, size_t len, Str *out)
+{
+    Subst *s = subst_lookup(text, len);
+    if (!s) {
+	return -1;
+    }
+
+    size_t start = out->len;
+
+    if (!s->tree) {
+	status = 0;
+    } else if (s->inproc) {
+	Str *old = builtin_capture(out);
+	subst_run(s->tree, out);
+	builtin_capture(old);
+    } else {
+	subst_fork(s->tree, out);
+    }
+
+    while (out->len > start && out->s[out->len - 1] == '\n') {
+	out->len--;
+    }
+
+    substatus = status;
+    return 0;
+}
+
+// subst_lookup returns the entry of the command of the len bytes at text,
+// parsing it if it is not there yet, or NULL if it has syntax errors.
+static Subst *subst_lookup(const char *text, size_t len)
+{
+    uint64_t h = table_hash(text, len);
+    Subst key = {.text = (char *) text, .len = len };
+    Subst *s = table_find(&substs, h, &key, subst_same);
+    if (s) {
+	return s;
+    }
+
+    char *copy = strndup(text, len);
+    Node *tree;
+    if (parser_parse_text(copy, &tree) > 0) {
+	free(copy);
+	status = 2;
+	return NULL;
+    }
+
+    // A list of a single command runs as the command itself, so that a
+    // child process can be replaced by it.
+    if (tree && !tree->right && !tree->bg) {
+	tree = tree->left;
+    }
+
+    s = table_add(&substs, h);
+    s->text = copy;
+    s->len = len;
+    s->tree = tree;
+    s->inproc = subst_inproc(tree);
+    return s;
+}
+
+// subst_same tells whether the substitutions a and b have the same text.
+static bool subst_same(const void *a, const void *b)
+{
+    const Subst *x = a, *y = b;
+    return x->len == y->len && !memcmp(x->text, y->text, x->len);
+}
+
+// subst_inproc checks whether n can run in the shell process without
+// changing it: a list of pipe_sequences of simple commands, each one a
+// builtin with no effect but its output, with no redirection.
+static bool subst_inproc(Node *n)
+{
+    if (!n) {
+	return true;
+    }
+
+    switch (n->type) {
+
+    default:
+	return false;
+
+    case NList:
+    case NPipe:
+	for (; n; n = n->right) {
+	    if (n->bg || !subst_inproc(n->left)) {
+		return false;
+	    }
+	}
+	return true;
+
+    case NSimple:
+	break;
+    }
+
+    if (n->redir || n->argc == 0 || !expand_literal(n->argv[0])) {
+	return false;
+    }
+
+    Builtin fn = builtin_lookup(n->argv[0]);
+    if (!fn || !builtin_pure(fn)) {
+	return false;
+    }
+
+    for (size_t i = 0; i < n->argc; i++) {
+	if (!subst_word(n->argv[i])) {
+	    return false;
+	}
+    }
+
+    for (size_t i = 0; i < n->nassigns; i++) {
+	if (!subst_word(n->assigns[i])) {
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+// subst_word checks whether expanding w can't change the shell, as a
+// '${name=word}' does, or make it exit, as a '${name?word}' does.
+static bool subst_word(const char *w)
+{
+    const char *p = strstr(w, "${");
+    return !p || !strpbrk(p, "=?");
+}
+
+// subst_run runs n, accepted by subst_inproc(), in the shell process. The
+// output of its builtins is appended to out, but for the commands of a
+// pipe_sequence other than the last one, since no builtin reads its input.
+static void subst_run(Node *n, Str *out)
+{
+    Str scratch;
+
+    switch (n->type) {
+
+    default:
+	builtin_capture(out);
+	exec_simple(n, NULL, false);
+	break;
+
+    case NList:
+	for (; n; n = n->right) {
+	    subst_run(n->left, out);
+	}
+	break;
+
+    case NPipe:
+	str_init(&scratch);
+	for (; n; n = n->right) {
+	    scratch.len = 0;
+	    subst_run(n->left, n->right ? &scratch : out);
+	}
+	str_free(&scratch);
+	break;
+    }
+}
+
+// subst_fork runs n in a child process and appends its output to out. The
+// pipe is enlarged so that the child is seldom blocked waiting for the
+// shell, which reads straight into out in large chunks.
+static void subst_fork(Node *n, Str *out)
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+	perror("pipe");
+	status = 1;
+	return;
+    }
+
+    fcntl(fds[1], F_SETPIPE_SZ, PIPESIZE);
+
+    pid_t pid = jobs_fork(false);
+    if (pid < 0) {
+	perror("fork");
+	close(fds[0]);
+	close(fds[1]);
+	status = 1;
+	return;
+    }
+
+    if (pid == 0) {
+	close(fds[0]);
+	dup2(fds[1], 1);
+	close(fds[1]);
+	builtin_capture(NULL);
+	recorded = true;
+	exec_child(n);
+    }
+
+    close(fds[1]);
+
+    for (;;) {
+	str_grow(out, CHUNK);
+
+	ssize_t r = read(fds[0], out->s + out->len, out->cap - out->len);
+	if (r < 0 && errno == EINTR) {
+	    continue;
+	}
+
+	if (r <= 0) {
+	    break;
+	}
+
+	out->len += r;
+    }
+
+    close(fds[0]);
+
+    Usage u;
+    status = jobs_wait(pid, &u);
+    stats_add(label(n), pid, status, &u);
+}
+
+// exec_if runs the if_clause n. The status is zero if no condition holds
+// and there is no else part.
+static int exec_if(Node *n)
+{
+    for (;;) {
+	exec_node(n->left);
+	if (exec_skip()) {
+	    return status;
+	}
+
+	if (status == 0) {
+	    return exec_node(n->right);
+	}
+
+	if (!n->els) {
+	    return status = 0;
+	}
+
+	if (n->els->type != NIf) {
+	    return exec_node(n->els);
+	}
+
+	n = n->els;
+    }
+}
+
+// exec_loop runs the while_clause or until_clause n.
+static int exec_loop(Node *n)
+{
+    int last = 0;
+    loops++;
+
+    for (;;) {
+	exec_node(n->left);
+
+	if (!exec_skip()) {
+	    if ((status == 0) != (n->type == NWhile)) {
+		break;
+	    }
+
+	    last = exec_node(n->right);
+	}
+
+	if (exec_unwind()) {
+	    break;
+	}
+    }
+
+    loops--;
+    return status = last;
+}
+
+// exec_for runs the for_clause n, assigning each field of its wordlist to
+// its name in turn.
+static int exec_for(Node *n)
+{
+    Fields f;
+    fields_init(&f);
+
+    if (exec_wordlist(n, &f) < 0) {
+	fields_free(&f);
+	return status = 1;
+    }
+
+    char **argv = fields_argv(&f);
+    int last = 0;
+    loops++;
+
+    for (size_t i = 0; i < f.n; i++) {
+	var_set(n->name, argv[i]);
+	last = exec_node(n->right);
+
+	if (exec_unwind()) {
+	    break;
+	}
+    }
+
+    loops--;
+    fields_free(&f);
+    return status = last;
+}
+
+// exec_wordlist expands the wordlist of the for_clause n into f. A
+// for_clause without 'in' goes through the positional parameters, as if
+// its wordlist was "$@". It returns -1 on error.
+int exec_wordlist(Node *n, Fields *f)
+{
+    static char *params[] = { "\"$@\"" };
+
+    if (!n->in) {
+	return expand_words(params, 1, f);
+    }
+
+    return expand_words(n->argv, n->argc, f);
+}
+
+// exec_case runs the body of the first case_item of n with a pattern that
+// matches the subject word.
+static int exec_case(Node *n)
+{
+    int k = exec_match(n);
+    status = 0;
+
+    for (CaseItem *item = n->items; item; item = item->next, k--) {
+	if (k == 0) {
+	    return item->body ? exec_node(item->body) : status;
+	}
+    }
+
+    return status;
+}
+
+// exec_time runs the pipeline of the 'time' n and reports on the standard
+// error the real time it took, the user and system time used meanwhile by
+// the shell and the children it waited for, and the largest resident set
+// size among them. A pipe_sequence of several commands is followed by a
+// line for each of them, with what its own process used.
+//
+// The largest resident set size of a pipe_sequence is that of its largest
+// stage. Otherwise only the lifetime peaks of the shell and of its
+// children are known, which tell about the command only if it raised one
+// of them; the size is left out if it did not.
+static int exec_time(Node *n)
+{
+    Node *p = n->left;
+    bool not = p && p->type == NNot;
+    if (not) {
+	p = p->left;
+    }
+
+    Usage *stages = NULL;
+    size_t nstages = 0;
+    if (p && p->type == NPipe) {
+	for (Node *q = p; q; q = q->right) {
+	    nstages++;
+	}
+	stages = calloc(nstages, sizeof(Usage));
+    }
+
+    Usage u;
+    struct rusage self, kids;
+    clock_gettime(CLOCK_MONOTONIC, &u.start);
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &kids);
+
+    status = 0;
+    if (stages) {
+	pipe_run(p, stages);
+    } else if (p) {
+	exec_node(p);
+    }
+
+    if (not) {
+	status = !status;
+    }
+
+    struct rusage ru;
+    getrusage(RUSAGE_CHILDREN, &ru);
+    getrusage(RUSAGE_SELF, &u.ru);
+    clock_gettime(CLOCK_MONOTONIC, &u.end);
+
+    timersub(&u.ru.ru_utime, &self.ru_utime, &u.ru.ru_utime);
+    timersub(&u.ru.ru_stime, &self.ru_stime, &u.ru.ru_stime);
+    timersub(&ru.ru_utime, &kids.ru_utime, &ru.ru_utime);
+    timersub(&ru.ru_stime, &kids.ru_stime, &ru.ru_stime);
+    timeradd(&u.ru.ru_utime, &ru.ru_utime, &u.ru.ru_utime);
+    timeradd(&u.ru.ru_stime, &ru.ru_stime, &u.ru.ru_stime);
+
+    long peak = -1;
+    if (stages) {
+	for (size_t i = 0; i < nstages; i++) {
+	    if (stages[i].ru.ru_maxrss > peak) {
+		peak = stages[i].ru.ru_maxrss;
+	    }
+	}
+    } else {
+	if (ru.ru_maxrss > kids.ru_maxrss) {
+	    peak = ru.ru_maxrss;
+	}
+	if (u.ru.ru_maxrss > self.ru_maxrss && u.ru.ru_maxrss > peak) {
+	    peak = u.ru.ru_maxrss;
+	}
+    }
+    u.ru.ru_maxrss = peak;
+
+    report("time:", &u, NULL);
+
+    for (size_t i = 0; i < nstages; i++, p = p->right) {
+	char lead[32];
+	snprintf(lead, sizeof(lead), "%5zu:", i + 1);
+	report(lead, &stages[i], label(p->left));
+    }
+
+    free(stages);
+    return status;
+}
+
+// exec_match returns the index of the first case_item of the case_clause n
+// with a pattern that matches the subject word, or the number of items if
+// none does. The patterns of all the items are compiled into a single
+// automaton the first time the case_clause runs, so that the subject word
+// is scanned once whatever the number of patterns. Patterns with
+// expansions in them can't be compiled ahead of time: they are expanded
+// and tried one by one, but only in the items before the one found.
+int exec_match(Node *n)
+{
+    if (!n->pat) {
+	match_compile(n);
+    }
+
+    Str word;
+    str_init(&word);
+
+    bool ok = expand_word(n->name, &word, 0) == 0;
+    int arm = ok ? pat_match(n->pat, word.s) : -1;
+    int k = 0;
+
+    for (CaseItem *item = n->items; item; item = item->next, k++) {
+	if (k == arm || (ok && match_item(item, word.s))) {
+	    break;
+	}
+    }
+
+    str_free(&word);
+    return k;
+}
+
+// match_compile compiles the patterns of the case_clause n without any
+// expansion into the automaton n->pat.
+static void match_compile(Node *n)
+{
+    size_t npats = 0;
+    for (CaseItem *item = n->items; item; item = item->next) {
+	npats += item->npats;
+    }
+
+    char **pats = malloc(sizeof(char *) * (npats + 1));
+    int *arms = calloc(npats + 1, sizeof(int));
+    size_t len = 0;
+    int k = 0;
+
+    for (CaseItem *item = n->items; item; item = item->next, k++) {
+	for (size_t i = 0; i < item->npats; i++) {
+	    if (!expand_static(item->pats[i])) {
+		continue;
+	    }
+
+	    Str pat;
+	    str_init(&pat);
+	    expand_word(item->pats[i], &pat, ExpPattern);
+
+	    pats[len] = strdup(pat.s);
+	    arms[len] = k;
+	    len++;
+	    str_free(&pat);
+	}
+    }
+
+    n->pat = pat_compile((const char **) pats, arms, len);
+
+    for (size_t i = 0; i < len; i++) {
+	free(pats[i]);
+    }
+    free(pats);
+    free(arms);
+}
+
+// match_item checks whether any pattern of item with expansions in it
+// matches word, once expanded.
+static bool match_item(CaseItem *item, const char *word)
+{
+    bool ok = false;
+
+    for (size_t i = 0; i < item->npats && !ok; i++) {
+	if (expand_static(item->pats[i])) {
+	    continue;
+	}
+
+	Str s;
+	str_init(&s);
+
+	if (expand_word(item->pats[i], &s, ExpPattern) == 0) {
+	    const char *pats = s.s;
+	    int arm = 0;
+	    Pat *p = pat_compile(&pats, &arm, 1);
+
+	    ok = pat_match(p, word) == 0;
+	    pat_free(p);
+	}
+
+	str_free(&s);
+    }
+
+    return ok;
+}
+
+// exec_redirect performs the redirections r in the shell process and
+// returns the mark to give to exec_unredirect() to undo them, or -1 on
+// error, in which case they are already undone.
+int exec_redirect(Redir *r)
+{
+    int mark = nsaved;
+
+    if (redir_apply(r, true) < 0) {
+	redir_restore(mark);
+	return -1;
+    }
+
+    return mark;
+}
+
+// exec_unredirect undoes the redirections performed since mark.
+void exec_unredirect(int mark)
+{
+    redir_restore(mark);
+}
+
+// redir_apply performs the redirections r in order. When save is set, every
+// descriptor replaced is saved first so that redir_restore() can put it
+// back.
+static int redir_apply(Redir *r, bool save)
+{
+    for (; r; r = r->next) {
+	int fd = r->fd;
+	if (fd < 0) {
+	    fd = r->type == TLess || r->type == TLessAnd
+		|| r->type == TLessGreat || r->type == TDLess
+		|| r->type == TDLessDash ? 0 : 1;
+	}
+
+	if (save) {
+	    if (nsaved == NSAVED) {
+		fprintf(stderr, "%d: too many redirections\n", fd);
+		return -1;
+	    }
+
+	    saved[nsaved].fd = fd;
+	    saved[nsaved].save = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+	    nsaved++;
+	}
+
+	int src = redir_open(r);
+	if (src == -2) {
+	    close(fd);
+	    continue;
+	}
+
+	if (src < 0) {
+	    return -1;
+	}
+
+	if (src != fd) {
+	    dup2(src, fd);
+
+	    if (r->type != TLessAnd && r->type != TGreatAnd) {
+		close(src);
+	    }
+	}
+    }
+
+    return 0;
+}
+
+// redir_open returns the descriptor the redirection r points to, -2 if r
+// closes its descriptor, or -1 on error. The word of r is expanded, but
+// not split into fields.
+static int redir_open(Redir *r)
+{
+    if (r->type == TDLess || r->type == TDLessDash) {
+	fprintf(stderr, "%s: here-documents are not supported\n", r->word);
+	return -1;
+    }
+
+    Str s;
+    str_init(&s);
+    if (expand_word(r->word, &s, 0) < 0) {
+	str_free(&s);
+	return -1;
+    }
+
+    const char *word = s.s;
+    int fd = -1;
+
+    switch (r->type) {
+
+    default:
+	break;
+
+    case TLessAnd:
+    case TGreatAnd:
+	if (!strcmp(word, "-")) {
+	    fd = -2;
+	    break;
+	}
+
+	fd = atoi(word);
+	if (fcntl(fd, F_GETFD) < 0) {
+	    fprintf(stderr, "%s: bad file descriptor\n", word);
+	    fd = -1;
+	}
+	break;
+
+    case TLess:
+	fd = open(word, O_RDONLY);
+	break;
+
+    case TGreat:
+    case TLobber:
+	fd = open(word, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	break;
+
+    case TDGreat:
+	fd = open(word, O_WRONLY | O_CREAT | O_APPEND, 0666);
+	break;
+
+    case TLessGreat:
+	fd = open(word, O_RDWR | O_CREAT, 0666);
+	break;
+    }
+
+    if (fd == -1 && r->type != TLessAnd && r->type != TGreatAnd) {
+	fprintf(stderr, "%s: %s\n", word, strerror(errno));
+    }
+
+    str_free(&s);
+    return fd;
+}
+
+// redir_restore puts back every descriptor saved by redir_apply() since
+// mark.
+static void redir_restore(int mark)
+{
+    while (nsaved > mark) {
+	nsaved--;
+
+	if (saved[nsaved].save < 0) {
+	    close(saved[nsaved].fd);
+	    continue;
+	}
+
+	dup2(saved[nsaved].save, saved[nsaved].fd);
+	close(saved[nsaved].save);
+    }
+}
+
+// label returns the name of the command n in reports: its first word
+// before expansion for a simple command, or else the reserved word or
+// operator it starts with.
+static const char *label(Node *n)
+{
+    static const char *const names[] = {
+	[NSimple] = "",
+	[NPipe] = "|",
+	[NNot] = "!",
+	[NAnd] = "&&",
+	[NOr] = "||",
+	[NList] = ";",
+	[NBrace] = "{",
+	[NSubshell] = "(",
+	[NIf] = "if",
+	[NWhile] = "while",
+	[NUntil] = "until",
+	[NFor] = "for",
+	[NCase] = "case",
+	[NTime] = "time",
+    };
+
+    if (n->type == NSimple && n->argc > 0) {
+	return n->argv[0];
+    }
+
+    return names[n->type];
+}
+
+// report prints on the standard error the usage u after lead, followed by
+// name if it is not NULL. A negative maxrss is left out.
+static void report(const char *lead, const Usage *u, const char *name)
+{
+    double real = (u->end.tv_sec - u->start.tv_sec)
+	+ (u->end.tv_nsec - u->start.tv_nsec) / 1e9;
+
+    char rss[32] = "";
+    if (u->ru.ru_maxrss >= 0) {
+	snprintf(rss, sizeof(rss), "  maxrss %ldk", u->ru.ru_maxrss);
+    }
+
+    fprintf(stderr, "%s real %.3fs  user %.3fs  sys %.3fs%s%s%s\n", lead,
+	    real, u->ru.ru_utime.tv_sec + u->ru.ru_utime.tv_usec / 1e6,
+	    u->ru.ru_stime.tv_sec + u->ru.ru_stime.tv_usec / 1e6, rss,
+	    name ? "  " : "", name ? name : "");
+}
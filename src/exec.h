@@ -0,0 +1,36 @@
+//
+// exec.h - tree-walking interpreter
+//
+
+#ifndef EXEC_H
+#define EXEC_H
+
+#include "ast.h"
+#include "builtin.h"
+#include "expand.h"
+
+int exec_node(Node *);
+void exec_child(Node *) __attribute__((noreturn));
+int exec_text(const char *);
+int exec_file(const char *);
+int exec_status(void);
+void exec_setstatus(int);
+bool exec_interactive(void);
+void exec_setinteractive(bool);
+void exec_break(int);
+void exec_continue(int);
+
+// The following run a single piece of a tree without walking it. They are
+// the runtime of the bytecode in "vm.h".
+int exec_builtin(Builtin, Node *);
+int exec_spawn(Node *);
+int exec_async(Node *);
+int exec_pipe(Node *);
+int exec_subshell(Node *);
+int exec_subst(const char *, size_t, Str *);
+int exec_wordlist(Node *, Fields *);
+int exec_match(Node *);
+int exec_redirect(Redir *);
+void exec_unredirect(int);
+
+#endif
@@ -0,0 +1,986 @@
+//
+// expand.c - word expansion
+//
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pwd.h>
+
+#include "expand.h"
+#include "lex.h"
+#include "exec.h"
+#include "var.h"
+#include "pat.h"
+#include "glob.h"
+#include "jobs.h"
+
+typedef struct __sExp Exp;
+
+void fields_init(Fields *);
+void fields_free(Fields *);
+char **fields_argv(Fields *);
+int expand_words(char **, size_t, Fields *);
+int expand_word(const char *, Str *, int);
+int expand_assigns(char **, size_t, Fields *);
+bool expand_literal(const char *);
+bool expand_static(const char *);
+static void fields_push(Fields *, const char *, size_t);
+static int scan(Exp *, const char *, const char *, bool);
+static const char *dollar(Exp *, const char *, const char *, bool);
+static int brace(Exp *, const char *, const char *, bool);
+static int brace_word(Exp *, const char *, const char *, bool);
+static int trim(Exp *, const char *, const char *, const char *,
+		char, bool, bool);
+static const char *tilde(Exp *, const char *, const char *);
+static const char *user_home(const char *, size_t);
+static int subst(Exp *, const char *, const char *, bool, bool);
+static void put(Exp *, char, bool);
+static void put_value(Exp *, const char *, bool);
+static void put_params(Exp *, char, bool);
+static void end_field(Exp *);
+static void unescape(Str *, size_t);
+static const char *param(const char *, size_t, char *);
+static const char *skip(const char *, const char *, char);
+static const char *subst_end(const char *, const char *);
+static bool isname(char);
+
+// ---------------------------------------------------------------------------
+
+// Delim tells what ended the last field while splitting.
+typedef enum {
+    DelimNone,			// nothing, or the field is still open
+    DelimSpace,			// IFS white space
+    DelimOther,			// any other IFS character
+} Delim;
+
+// Exp is the state of the expansion of a single word. The word is scanned
+// once: parameter expansion, quote removal and field splitting all happen
+// as its bytes are copied to out.
+struct __sExp {
+    Str *out;
+    Fields *f;			// fields being split, or NULL if not splitting
+    int flags;
+    const char *ifs;
+
+    size_t start;		// offset in out of the current field
+    bool open;			// whether the current field has started
+    bool glob;			// whether it has unquoted pattern characters
+    Delim delim;
+
+    // atempty is set when a "$@" expands to no field at all, so that the
+    // quotes around it don't make an empty field.
+    bool atempty;
+
+    // inword is set within the word of a '${name-word}' or
+    // '${name+word}', whose unquoted bytes are split as a value's are.
+    bool inword;
+};
+
+// fields_init makes f empty.
+void fields_init(Fields *f)
+{
+    str_init(&f->buf);
+    f->list = f->small;
+    f->n = 0;
+    f->cap = NFIELDS;
+    f->argv = f->smallv;
+    f->capargv = NFIELDS + 1;
+}
+
+// fields_free frees the heap buffers of f, if any, and empties it.
+void fields_free(Fields *f)
+{
+    str_free(&f->buf);
+
+    if (f->list != f->small) {
+	free(f->list);
+    }
+
+    if (f->argv != f->smallv) {
+	free(f->argv);
+    }
+
+    fields_init(f);
+}
+
+// fields_argv returns the fields of f as a NULL-terminated array, valid
+// until f changes.
+char **fields_argv(Fields *f)
+{
+    if (f->n + 1 > f->capargv) {
+	if (f->argv != f->smallv) {
+	    free(f->argv);
+	}
+
+	f->capargv = f->cap + 1;
+	f->argv = malloc(sizeof(char *) * f->capargv);
+    }
+
+    for (size_t i = 0; i < f->n; i++) {
+	Field *field = &f->list[i];
+	f->argv[i] = field->lit ? (char *) field->lit : f->buf.s + field->off;
+    }
+
+    f->argv[f->n] = NULL;
+    return f->argv;
+}
+
+// fields_push appends a field to f.
+static void fields_push(Fields *f, const char *lit, size_t off)
+{
+    if (f->n == f->cap) {
+	f->cap *= 2;
+
+	if (f->list == f->small) {
+	    f->list = malloc(sizeof(Field) * f->cap);
+	    memcpy(f->list, f->small, sizeof(f->small));
+	} else {
+	    f->list = realloc(f->list, sizeof(Field) * f->cap);
+	}
+    }
+
+    f->list[f->n].lit = lit;
+    f->list[f->n].off = off;
+    f->n++;
+}
+
+// expand_words expands the n words of argv and appends the resulting
+// fields to f. Words without quotes or expansions are not copied. It
+// returns -1 on error.
+int expand_words(char **argv, size_t n, Fields *f)
+{
+    for (size_t i = 0; i < n; i++) {
+	const char *w = argv[i];
+
+	if (expand_literal(w) && !strpbrk(w, "*?[")) {
+	    fields_push(f, w, 0);
+	    continue;
+	}
+
+	const char *ifs = var_get("IFS");
+	Exp e = {
+	    .out = &f->buf,
+	    .f = f,
+	    .flags = ExpSplit | ExpGlob,
+	    .ifs = ifs ? ifs : " \t\n",
+	    .start = f->buf.len,
+	};
+
+	if (scan(&e, w, w + strlen(w), false) < 0) {
+	    return -1;
+	}
+
+	if (e.open) {
+	    end_field(&e);
+	}
+    }
+
+    return 0;
+}
+
+// expand_word expands w into a single string appended to out, as for a
+// redirection or a case_clause. It returns -1 on error.
+int expand_word(const char *w, Str *out, int flags)
+{
+    Exp e = {
+	.out = out,
+	.flags = flags & ~ExpSplit,
+    };
+
+    if (scan(&e, w, w + strlen(w), false) < 0) {
+	return -1;
+    }
+
+    str_cstr(out);
+    return 0;
+}
+
+// expand_assigns expands the n ASSIGNMENT_WORD of assigns, and appends to f
+// the name and then the value of each one. Values are not split. It
+// returns -1 on error.
+int expand_assigns(char **assigns, size_t n, Fields *f)
+{
+    for (size_t i = 0; i < n; i++) {
+	const char *w = assigns[i];
+	const char *eq = strchr(w, '=');
+
+	fields_push(f, NULL, f->buf.len);
+	str_putn(&f->buf, w, eq - w);
+	str_putc(&f->buf, '\0');
+
+	if (expand_literal(eq + 1)) {
+	    fields_push(f, eq + 1, 0);
+	    continue;
+	}
+
+	fields_push(f, NULL, f->buf.len);
+	if (expand_word(eq + 1, &f->buf, 0) < 0) {
+	    return -1;
+	}
+	str_putc(&f->buf, '\0');
+    }
+
+    return 0;
+}
+
+// expand_literal checks whether w expands to itself.
+bool expand_literal(const char *w)
+{
+    return w[0] != '~' && !w[strcspn(w, "'\"\\$`")];
+}
+
+// expand_static checks whether w expands to the same string whatever the
+// state of the shell, as when it has quotes but no expansions.
+bool expand_static(const char *w)
+{
+    return w[0] != '~' && !strpbrk(w, "$`");
+}
+
+// scan expands the bytes from p to end. dq is set within double quotes.
+static int scan(Exp *e, const char *p, const char *end, bool dq)
+{
+    const char *word = p;
+
+    while (p < end) {
+	const char *q;
+	char c = *p++;
+
+	switch (c) {
+
+	default:
+	    if (e->inword && !dq) {
+		put_value(e, (char[]) {c, '\0'}, false);
+	    } else {
+		put(e, c, dq);
+	    }
+	    break;
+
+	case '\'':
+	    if (dq) {
+		put(e, c, true);
+		break;
+	    }
+
+	    q = memchr(p, '\'', end - p);
+	    if (!q) {
+		q = end;
+	    }
+
+	    // Even an empty quoted string makes a field.
+	    e->open = true;
+	    e->delim = DelimNone;
+	    while (p < q) {
+		put(e, *p++, true);
+	    }
+
+	    p = q < end ? q + 1 : end;
+	    break;
+
+	case '"':
+	    if (dq) {
+		put(e, c, true);
+		break;
+	    }
+
+	    q = skip(p, end, '"');
+	    e->atempty = false;
+	    if (scan(e, p, q, true) < 0) {
+		return -1;
+	    }
+
+	    if (!e->atempty) {
+		e->open = true;
+		e->delim = DelimNone;
+	    }
+
+	    p = q < end ? q + 1 : end;
+	    break;
+
+	case '\\':
+	    // Within double quotes, a backslash only quotes the characters
+	    // that are special there.
+	    if (p == end || (dq && !strchr("$`\"\\\n", *p))) {
+		put(e, c, true);
+		break;
+	    }
+
+	    if (*p != '\n') {
+		put(e, *p, true);
+	    }
+	    p++;
+	    break;
+
+	case '$':
+	    p = dollar(e, p, end, dq);
+	    if (!p) {
+		return -1;
+	    }
+	    break;
+
+	case '`':
+	    q = skip(p, end, '`');
+	    if (subst(e, p, q, dq, true) < 0) {
+		return -1;
+	    }
+
+	    p = q < end ? q + 1 : end;
+	    break;
+
+	case '~':
+	    if (dq || p - 1 != word) {
+		put(e, c, dq);
+		break;
+	    }
+
+	    p = tilde(e, p, end);
+	    break;
+	}
+    }
+
+    return 0;
+}
+
+// dollar expands the parameter after the '$' that precedes p, and returns
+// the position right after it, or NULL on error. A '$' that doesn't start
+// an expansion is kept as it is.
+static const char *dollar(Exp *e, const char *p, const char *end, bool dq)
+{
+    char num[32];
+    const char *q;
+
+    if (p == end) {
+	put(e, '$', dq);
+	return p;
+    }
+
+    switch (*p) {
+
+    case '{':
+	q = skip(p + 1, end, '}');
+	if (q == end) {
+	    fprintf(stderr, "%.*s: bad substitution\n", (int) (end - p + 1),
+		    p - 1);
+	    return NULL;
+	}
+
+	return brace(e, p + 1, q, dq) < 0 ? NULL : q + 1;
+
+    case '(':
+	q = subst_end(p + 1, end);
+	if (subst(e, p + 1, q, dq, false) < 0) {
+	    return NULL;
+	}
+
+	return q < end ? q + 1 : end;
+
+    case '@':
+    case '*':
+	put_params(e, *p, dq);
+	return p + 1;
+
+    case '#':
+    case '?':
+    case '$':
+    case '!':
+    case '-':
+	put_value(e, param(p, 1, num), dq);
+	return p + 1;
+    }
+
+    if (isdigit((unsigned char) *p)) {
+	put_value(e, param(p, 1, num), dq);
+	return p + 1;
+    }
+
+    if (!isname(*p) || isdigit((unsigned char) *p)) {
+	put(e, '$', dq);
+	return p;
+    }
+
+    for (q = p; q < end && isname(*q); q++) {
+    }
+
+    put_value(e, param(p, q - p, num), dq);
+    return q;
+}
+
+// brace expands the parameter expansion '${...}' whose contents go from p
+// to end.
+static int brace(Exp *e, const char *p, const char *end, bool dq)
+{
+    char num[32];
+    bool length = false;
+
+    if (*p == '#' && p + 1 < end) {
+	length = true;
+	p++;
+    }
+
+    const char *name = p;
+    if (isdigit((unsigned char) *p)) {
+	while (p < end && isdigit((unsigned char) *p)) {
+	    p++;
+	}
+    } else if (isname(*p)) {
+	while (p < end && isname(*p)) {
+	    p++;
+	}
+    } else if (p < end && strchr("@*#?$!-", *p)) {
+	p++;
+    }
+
+    size_t len = p - name;
+    if (len == 0 || (length && p != end)) {
+	fprintf(stderr, "${%.*s}: bad substitution\n", (int) (end - name),
+		name);
+	return -1;
+    }
+
+    // "$@" and "$*" are set when there are positional parameters.
+    bool params = *name == '@' || *name == '*';
+    const char *v = params ? NULL : param(name, len, num);
+    bool set = params ? var_nargs() > 0 : v != NULL;
+
+    if (length) {
+	snprintf(num, sizeof(num), "%zu",
+		 params ? (size_t) var_nargs() : v ? strlen(v) : 0);
+	put_value(e, num, dq);
+	return 0;
+    }
+
+    if (p == end) {
+	if (params) {
+	    put_params(e, *name, dq);
+	} else {
+	    put_value(e, v, dq);
+	}
+	return 0;
+    }
+
+    bool colon = *p == ':';
+    if (colon) {
+	p++;
+    }
+
+    char op = p < end ? *p++ : '\0';
+    bool twice = false;
+    if ((op == '%' || op == '#') && !colon && p < end && *p == op) {
+	twice = true;
+	p++;
+    }
+
+    // The word is used when the parameter is unset or, with a ':', null.
+    bool unset = !set || (colon && v && !*v);
+    Str s;
+
+    switch (op) {
+
+    default:
+	fprintf(stderr, "${%.*s}: bad substitution\n", (int) (end - name),
+		name);
+	return -1;
+
+    case '-':
+	if (unset) {
+	    return brace_word(e, p, end, dq);
+	}
+	break;
+
+    case '+':
+	if (!unset) {
+	    return brace_word(e, p, end, dq);
+	}
+	return 0;
+
+    case '=':
+	if (!unset) {
+	    break;
+	}
+
+	if (!isname(*name) || isdigit((unsigned char) *name)) {
+	    fprintf(stderr, "%.*s: cannot assign in this way\n", (int) len,
+		    name);
+	    return -1;
+	}
+
+	str_init(&s);
+	Exp sub = {.out = &s };
+	if (scan(&sub, p, end, false) < 0) {
+	    str_free(&s);
+	    return -1;
+	}
+
+	{
+	    char key[len + 1];
+	    memcpy(key, name, len);
+	    key[len] = '\0';
+	    var_set(key, str_cstr(&s));
+	}
+
+	put_value(e, s.s, dq);
+	str_free(&s);
+	return 0;
+
+    case '?':
+	if (!unset) {
+	    break;
+	}
+
+	// A shell that is not interactive exits; one that is only gives up
+	// the command.
+	str_init(&s);
+	Exp msg = {.out = &s };
+	if (scan(&msg, p, end, false) == 0) {
+	    fprintf(stderr, "%.*s: %s\n", (int) len, name,
+		    s.len ? str_cstr(&s) : "parameter null or not set");
+	}
+
+	if (!exec_interactive()) {
+	    exit(1);
+	}
+
+	str_free(&s);
+	return -1;
+
+    case '%':
+    case '#':
+	if (colon) {
+	    fprintf(stderr, "${%.*s}: bad substitution\n",
+		    (int) (end - name), name);
+	    return -1;
+	}
+
+	return trim(e, v ? v : "", p, end, op, twice, dq);
+    }
+
+    if (params) {
+	put_params(e, *name, dq);
+    } else {
+	put_value(e, v, dq);
+    }
+
+    return 0;
+}
+
+// brace_word expands the word from p to end of a '${name-word}' or
+// '${name+word}'.
+static int brace_word(Exp *e, const char *p, const char *end, bool dq)
+{
+    bool inword = e->inword;
+    e->inword = true;
+    int rc = scan(e, p, end, dq);
+    e->inword = inword;
+    return rc;
+}
+
+// trim expands v without the shortest ('%', '#') or longest ('%%', '##')
+// suffix or prefix matched by the pattern from p to end.
+static int trim(Exp *e, const char *v, const char *p, const char *end,
+		char op, bool twice, bool dq)
+{
+    Str pat;
+    str_init(&pat);
+
+    Exp sub = {.out = &pat, .flags = ExpPattern };
+    if (scan(&sub, p, end, false) < 0) {
+	str_free(&pat);
+	return -1;
+    }
+
+    const char *pats = str_cstr(&pat);
+    int arm = 0;
+    Pat *m = pat_compile(&pats, &arm, 1);
+
+    Str t;
+    str_init(&t);
+    size_t n = strlen(v);
+    str_putn(&t, v, n);
+    char *s = str_cstr(&t);
+
+    size_t from = 0;
+    size_t to = n;
+
+    for (size_t k = 0; k <= n; k++) {
+	if (op == '#') {
+	    size_t i = twice ? n - k : k;
+	    char c = s[i];
+
+	    s[i] = '\0';
+	    bool ok = pat_match(m, s) >= 0;
+	    s[i] = c;
+
+	    if (ok) {
+		from = i;
+		break;
+	    }
+	} else {
+	    size_t i = twice ? k : n - k;
+
+	    if (pat_match(m, s + i) >= 0) {
+		to = i;
+		break;
+	    }
+	}
+    }
+
+    s[to] = '\0';
+    put_value(e, s + from, dq);
+
+    pat_free(m);
+    str_free(&pat);
+    str_free(&t);
+    return 0;
+}
+
+// tilde expands the tilde-prefix after the '~' that precedes p to the home
+// directory of the user it names, or of the current user if it is empty,
+// and returns the position right after it.
+static const char *tilde(Exp *e, const char *p, const char *end)
+{
+    const char *q = p;
+    while (q < end && *q != '/') {
+	q++;
+    }
+
+    // A tilde-prefix with quotes in it is not expanded.
+    const char *home = NULL;
+    size_t len = q - p;
+
+    if (len == 0) {
+	home = var_get("HOME");
+    } else if (!memchr(p, '\'', len) && !memchr(p, '"', len)
+	       && !memchr(p, '\\', len) && !memchr(p, '$', len)) {
+	home = user_home(p, len);
+    }
+
+    if (!home) {
+	put(e, '~', false);
+	return p;
+    }
+
+    // The home directory is not split.
+    e->open = true;
+    e->delim = DelimNone;
+    for (; *home; home++) {
+	put(e, *home, true);
+    }
+
+    return q;
+}
+
+// user_home returns the home directory of the user named by the len bytes
+// of name, or NULL if there is none. The static build knows of no user:
+// the user database of the C library needs its shared libraries.
+static const char *user_home(const char *name, size_t len)
+{
+#ifdef XSH_STATIC
+    return NULL;
+#else
+    char s[len + 1];
+    memcpy(s, name, len);
+    s[len] = '\0';
+
+    struct passwd *pw = getpwnam(s);
+    return pw ? pw->pw_dir : NULL;
+#endif
+}
+
+// subst expands the command substitution of the command from p to end,
+// which bq tells is within backquotes. There, a backslash quotes '$', '`'
+// and '\\', and '"' too within double quotes, and is removed before the
+// command is parsed.
+static int subst(Exp *e, const char *p, const char *end, bool dq, bool bq)
+{
+    Str cmd;
+    Str out;
+    str_init(&cmd);
+    str_init(&out);
+
+    if (bq) {
+	for (; p < end; p++) {
+	    if (*p == '\\' && p + 1 < end
+		&& (strchr("$`\\", p[1]) || (dq && p[1] == '"'))) {
+		p++;
+	    }
+	    str_putc(&cmd, *p);
+	}
+
+	p = cmd.s;
+	end = cmd.s + cmd.len;
+    }
+
+    int rc = exec_subst(p, end - p, &out);
+    if (rc == 0) {
+	put_value(e, str_cstr(&out), dq);
+    }
+
+    str_free(&cmd);
+    str_free(&out);
+    return rc;
+}
+
+// put appends the byte c to the current field. When expanding a pattern,
+// a quoted pattern character gets a '\' so that it only matches itself.
+// For pathname expansion, so does a '\' that comes from an expansion, and
+// the escapes are only removed when the field ends.
+static void put(Exp *e, char c, bool quoted)
+{
+    if ((e->flags & ExpPattern) && quoted && strchr("*?[]\\", c)) {
+	str_putc(e->out, '\\');
+    } else if ((e->flags & ExpGlob) && (quoted || c == '\\')
+	       && strchr("*?[]\\", c)) {
+	str_putc(e->out, '\\');
+    } else if ((e->flags & ExpGlob) && strchr("*?[", c)) {
+	e->glob = true;
+    }
+
+    str_putc(e->out, c);
+    e->open = true;
+    e->delim = DelimNone;
+}
+
+// put_value appends the value v of a parameter, splitting it into fields
+// at the IFS characters if it is not quoted. v may be NULL for an unset
+// parameter.
+static void put_value(Exp *e, const char *v, bool dq)
+{
+    if (!v) {
+	return;
+    }
+
+    if (dq || !e->f) {
+	for (; *v; v++) {
+	    put(e, *v, dq);
+	}
+	return;
+    }
+
+    for (; *v; v++) {
+	char c = *v;
+
+	if (!strchr(e->ifs, c)) {
+	    put(e, c, false);
+	    continue;
+	}
+
+	// IFS white space only ends a field; any other IFS character ends a
+	// field, along with the white space around it, even if empty.
+	if (c == ' ' || c == '\t' || c == '\n') {
+	    if (e->open) {
+		end_field(e);
+		e->delim = DelimSpace;
+	    }
+	} else {
+	    if (e->open || e->delim != DelimSpace) {
+		end_field(e);
+	    }
+	    e->delim = DelimOther;
+	}
+    }
+}
+
+// put_params appends the positional parameters for '$@' or '$*'. Within
+// double quotes, "$@" makes a field of each one and "$*" joins them with
+// the first character of IFS.
+static void put_params(Exp *e, char c, bool dq)
+{
+    int n = var_nargs();
+    if (n == 0) {
+	e->atempty = dq;
+	return;
+    }
+
+    const char *ifs = var_get("IFS");
+    char sep = ifs ? *ifs : ' ';
+
+    for (int i = 1; i <= n; i++) {
+	if (i > 1) {
+	    if (dq && c == '@' && e->f) {
+		end_field(e);
+	    } else if (dq && c == '*') {
+		if (sep) {
+		    put(e, sep, true);
+		}
+	    } else if (e->f) {
+		if (e->open) {
+		    end_field(e);
+		}
+		e->delim = DelimSpace;
+	    } else {
+		put(e, ' ', dq);
+	    }
+	}
+
+	if (dq) {
+	    e->open = true;
+	    e->delim = DelimNone;
+	}
+
+	put_value(e, var_arg(i), dq);
+    }
+}
+
+// end_field ends the current field. With pathname expansion, a field with
+// unquoted pattern characters is replaced by the pathnames it matches, if
+// any.
+static void end_field(Exp *e)
+{
+    str_putc(e->out, '\0');
+
+    if (!(e->flags & ExpGlob)) {
+	fields_push(e->f, NULL, e->start);
+    } else if (!e->glob || glob_expand(e->out->s + e->start, e->out) == 0) {
+	unescape(e->out, e->start);
+	fields_push(e->f, NULL, e->start);
+    } else {
+	// The matches follow the pattern, which they replace.
+	size_t len = strlen(e->out->s + e->start) + 1;
+	memmove(e->out->s + e->start, e->out->s + e->start + len,
+		e->out->len - e->start - len);
+	e->out->len -= len;
+
+	for (size_t off = e->start; off < e->out->len;) {
+	    fields_push(e->f, NULL, off);
+	    off += strlen(e->out->s + off) + 1;
+	}
+    }
+
+    e->start = e->out->len;
+    e->open = false;
+    e->glob = false;
+}
+
+// unescape removes in place the escapes from the '\0'-terminated field at
+// off, the last one of out.
+static void unescape(Str *out, size_t off)
+{
+    char *s = out->s + off;
+    size_t j = 0;
+
+    for (size_t i = 0; s[i]; i++) {
+	if (s[i] == '\\' && s[i + 1]) {
+	    i++;
+	}
+	s[j++] = s[i];
+    }
+
+    s[j] = '\0';
+    out->len = off + j + 1;
+}
+
+// param returns the value of the parameter of the len bytes at name, or
+// NULL if it is unset. num is used to format the special parameters that
+// are numbers.
+static const char *param(const char *name, size_t len, char *num)
+{
+    if (isdigit((unsigned char) *name)) {
+	int i = 0;
+	for (size_t j = 0; j < len; j++) {
+	    i = i * 10 + name[j] - '0';
+	}
+	return var_arg(i);
+    }
+
+    if (len == 1 && !isname(*name)) {
+	switch (*name) {
+
+	case '#':
+	    sprintf(num, "%d", var_nargs());
+	    return num;
+
+	case '?':
+	    sprintf(num, "%d", exec_status());
+	    return num;
+
+	case '$':
+	    sprintf(num, "%ld", (long) var_pid());
+	    return num;
+
+	case '!':
+	    if (!jobs_last()) {
+		return NULL;
+	    }
+	    sprintf(num, "%ld", (long) jobs_last());
+	    return num;
+
+	case '-':
+	    return "";
+	}
+
+	return NULL;
+    }
+
+    char key[len + 1];
+    memcpy(key, name, len);
+    key[len] = '\0';
+    return var_get(key);
+}
+
+// skip returns the position of the close that ends the text from p, or
+// end if there is none: the closing '"' of a double-quoted string, the '`'
+// of a command substitution, or the '}' of a '${'. Quoted strings and
+// nested expansions are skipped over.
+static const char *skip(const char *p, const char *end, char close)
+{
+    while (p < end) {
+	char c = *p;
+
+	if (c == close) {
+	    return p;
+	}
+
+	p++;
+
+	if (c == '\\') {
+	    if (p < end) {
+		p++;
+	    }
+	    continue;
+	}
+
+	if (close == '`') {
+	    continue;
+	}
+
+	if (c == '`') {
+	    p = skip(p, end, '`');
+	} else if (c == '$' && p < end && *p == '{') {
+	    p = skip(p + 1, end, '}');
+	} else if (c == '$' && p < end && *p == '(') {
+	    p = subst_end(p + 1, end);
+	} else if (close == '"') {
+	    continue;
+	} else if (c == '\'') {
+	    const char *q = memchr(p, '\'', end - p);
+	    p = q ? q : end;
+	} else if (c == '"') {
+	    p = skip(p, end, '"');
+	} else {
+	    continue;
+	}
+
+	if (p < end) {
+	    p++;
+	}
+    }
+
+    return end;
+}
+
+// subst_end returns the position of the ')' that ends the '$(' command
+// substitution from p, or end if there is none. It is found as the lexer
+// found it, since a ')' ending a pattern of a case clause matches no '('.
+static const char *subst_end(const char *p, const char *end)
+{
+    const char *q = lex_subst_end(p);
+    return q < end ? q : end;
+}
+
+// isname checks whether c may be part of a name.
+static bool isname(char c)
+{
+    return isalnum((unsigned char) c) || c == '_';
+}
@@ -0,0 +1,58 @@
+//
+// expand.h - word expansion
+//
+
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "str.h"
+
+#define NFIELDS 8
+
+typedef enum {
+    ExpSplit = 1,		// split the results of expansions into fields
+    ExpPattern = 2,		// escape quoted pattern characters with '\'
+    ExpGlob = 4,		// expand unquoted patterns to pathnames
+} ExpFlag;
+
+// Field is a single field produced by expand_words(): either a word of the
+// tree that needs no expansion, used as it is, or the offset of its bytes
+// in Fields->buf.
+typedef struct __sField {
+    const char *lit;
+    size_t off;
+} Field;
+
+// Fields holds the fields that the words of a command expand to. Like Str,
+// it keeps the first NFIELDS fields and their bytes in the struct itself,
+// so it must not be copied.
+typedef struct __sFields {
+
+    // buf holds the bytes of the expanded fields, each one followed by a
+    // '\0'.
+    Str buf;
+
+    Field *list;
+    size_t n;
+    size_t cap;
+    Field small[NFIELDS];
+
+    // argv is filled by fields_argv().
+    char **argv;
+    size_t capargv;
+    char *smallv[NFIELDS + 1];
+
+} Fields;
+
+void fields_init(Fields *);
+void fields_free(Fields *);
+char **fields_argv(Fields *);
+int expand_words(char **, size_t, Fields *);
+int expand_word(const char *, Str *, int);
+int expand_assigns(char **, size_t, Fields *);
+bool expand_literal(const char *);
+bool expand_static(const char *);
+
+#endif
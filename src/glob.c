@@ -0,0 +1,411 @@
+//
+// glob.c - pathname expansion
+//
+// A pattern is matched one pathname component at a time. Components
+// without pattern characters are used as they are; the others are compiled
+// once with pat_compile() and run over the listing of each directory they
+// apply to. Listings are read with getdents64 and kept in a small cache, so
+// that a directory globbed again, as in a loop, is only read again once it
+// changes.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "glob.h"
+#include "pat.h"
+
+#define NDIRS 16
+#define BUFSIZE (64 * 1024)
+
+typedef struct __sDir Dir;
+typedef struct __sGlob Glob;
+
+int glob_expand(const char *, Str *);
+static void split(Glob *, char *);
+static void walk(Glob *, size_t);
+static bool isdir(Glob *, unsigned char);
+static Dir *dir_list(const char *);
+static bool dir_read(Dir *, const char *, struct stat *);
+static int compare(const void *, const void *);
+static int compare_ents(const void *, const void *);
+
+// ---------------------------------------------------------------------------
+
+// Dirent64 is the record written by getdents64 for each entry.
+typedef struct __sDirent64 {
+    uint64_t ino;
+    int64_t off;
+    unsigned short reclen;
+    unsigned char type;
+    char name[];
+} Dirent64;
+
+// Ent is an entry of a directory listing: the offset of its name in
+// Dir->names, and its type as told by getdents64, DT_UNKNOWN if the file
+// system doesn't tell.
+typedef struct __sEnt {
+    size_t off;
+    unsigned char type;
+} Ent;
+
+// Dir is a cached directory listing, sorted by name. It is used again as
+// long as the directory has the same device, inode and modification time,
+// unless racy tells that the directory changed within the same clock tick
+// as the listing was read, so that a later change might not show in its
+// time.
+struct __sDir {
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    bool racy;
+
+    Str names;			// the names, each followed by a '\0'
+    Ent *ents;
+    size_t n;
+    size_t cap;
+
+    int busy;			// walks iterating over ents
+    uint64_t used;		// tick of the last use, for eviction
+};
+
+// Comp is a component of a pattern.
+typedef struct __sComp {
+    const char *pat;		// with the escapes of the quoted characters
+    char *lit;			// without them if literal, else literal prefix
+    size_t nlit;
+    Pat *m;			// NULL if literal
+    bool dot;			// whether names may begin with a '.'
+} Comp;
+
+// Glob is the state of a single expansion.
+struct __sGlob {
+    Comp *comps;
+    size_t ncomps;
+    Str path;			// the directory being walked, '/'-terminated
+    Str found;			// the matches, each followed by a '\0'
+    size_t nfound;
+    size_t npats;		// number of components that are not literal
+};
+
+static Dir **dirs;
+static size_t ndirs;
+static size_t capdirs;
+static uint64_t ticks;
+static char *buf;		// for getdents64
+static const char *names;	// of the listing being sorted
+
+// glob_expand appends to out the pathnames matched by the pattern pat in
+// sorted order, each followed by a '\0', and returns how many there are.
+// Quoted characters of pat are escaped with '\', as expand_word() does
+// with ExpPattern. pat may point into out.
+int glob_expand(const char *pat, Str *out)
+{
+    Glob g = { 0 };
+    str_init(&g.path);
+    str_init(&g.found);
+
+    char *copy = strdup(pat);
+    split(&g, copy);
+    walk(&g, 0);
+
+    // As listings are sorted, the matches are found in order when only the
+    // last component is not literal. Otherwise, as "a/x" sorts after
+    // "a.b/y", they have to be sorted.
+    char **list = NULL;
+    if (g.npats == 0 || (g.npats == 1 && g.comps[g.ncomps - 1].m)) {
+	str_putn(out, g.found.s, g.found.len);
+    } else {
+	list = malloc(sizeof(char *) * g.nfound);
+	char *s = g.found.s;
+	for (size_t i = 0; i < g.nfound; i++) {
+	    list[i] = s;
+	    s += strlen(s) + 1;
+	}
+
+	qsort(list, g.nfound, sizeof(char *), compare);
+	for (size_t i = 0; i < g.nfound; i++) {
+	    str_putn(out, list[i], strlen(list[i]) + 1);
+	}
+    }
+
+    for (size_t i = 0; i < g.ncomps; i++) {
+	free(g.comps[i].lit);
+	if (g.comps[i].m) {
+	    pat_free(g.comps[i].m);
+	}
+    }
+
+    free(list);
+    free(g.comps);
+    free(copy);
+    str_free(&g.path);
+    str_free(&g.found);
+    return g.nfound;
+}
+
+// split cuts pat in place into the components of g, and puts its leading
+// '/', if any, in g->path.
+static void split(Glob *g, char *pat)
+{
+    while (*pat == '/') {
+	str_putc(&g->path, *pat++);
+    }
+
+    size_t cap = 1;
+    for (const char *p = pat; *p; p++) {
+	cap += *p == '/';
+    }
+
+    g->comps = calloc(cap, sizeof(Comp));
+
+    for (char *p = pat;; p++) {
+	if (*p && *p != '/') {
+	    continue;
+	}
+
+	bool end = !*p;
+	*p = '\0';
+
+	Comp *c = &g->comps[g->ncomps++];
+	c->pat = pat;
+	c->dot = pat[0] == '.' || (pat[0] == '\\' && pat[1] == '.');
+	c->lit = malloc(p - pat + 1);
+
+	// The literal prefix lets most names be rejected without running
+	// the automaton.
+	bool literal = pat_literal(pat);
+	for (const char *q = pat; *q && (literal || !strchr("*?[", *q)); q++) {
+	    if (*q == '\\' && q[1]) {
+		q++;
+	    }
+	    c->lit[c->nlit++] = *q;
+	}
+	c->lit[c->nlit] = '\0';
+
+	if (!literal) {
+	    int arm = 0;
+	    c->m = pat_compile(&c->pat, &arm, 1);
+	    g->npats++;
+	}
+
+	if (end) {
+	    break;
+	}
+	pat = p + 1;
+    }
+}
+
+// walk appends to g->found the pathnames matched by the components of g
+// from i on, within the directory g->path.
+static void walk(Glob *g, size_t i)
+{
+    Comp *c = &g->comps[i];
+    bool last = i + 1 == g->ncomps;
+    size_t len = g->path.len;
+    struct stat st;
+
+    if (!c->m) {
+	str_putn(&g->path, c->lit, c->nlit);
+
+	if (!last) {
+	    str_putc(&g->path, '/');
+	    walk(g, i + 1);
+	} else if (lstat(str_cstr(&g->path), &st) == 0) {
+	    str_putn(&g->found, g->path.s, g->path.len + 1);
+	    g->nfound++;
+	}
+
+	g->path.len = len;
+	return;
+    }
+
+    Dir *d = dir_list(len ? str_cstr(&g->path) : ".");
+    if (!d) {
+	return;
+    }
+
+    d->busy++;
+
+    for (size_t j = 0; j < d->n; j++) {
+	const char *name = d->names.s + d->ents[j].off;
+
+	if ((*name == '.' && !c->dot) || strncmp(name, c->lit, c->nlit)
+	    || pat_match(c->m, name) < 0) {
+	    continue;
+	}
+
+	g->path.len = len;
+	str_puts(&g->path, name);
+
+	if (last) {
+	    str_putn(&g->found, g->path.s, g->path.len);
+	    str_putc(&g->found, '\0');
+	    g->nfound++;
+	} else if (isdir(g, d->ents[j].type)) {
+	    str_putc(&g->path, '/');
+	    walk(g, i + 1);
+	}
+    }
+
+    d->busy--;
+    g->path.len = len;
+}
+
+// isdir checks whether g->path, an entry of the type type, is a directory
+// or a symbolic link to one.
+static bool isdir(Glob *g, unsigned char type)
+{
+    struct stat st;
+
+    if (type == DT_DIR) {
+	return true;
+    }
+
+    if (type != DT_LNK && type != DT_UNKNOWN) {
+	return false;
+    }
+
+    return stat(str_cstr(&g->path), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// dir_list returns the listing of the directory path, or NULL if it cannot
+// be read. It costs a single stat when the cached listing is still valid.
+// The least recently used listing that no walk is using makes room for a
+// new one.
+static Dir *dir_list(const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) < 0 || !S_ISDIR(st.st_mode)) {
+	return NULL;
+    }
+
+    Dir *d = NULL;
+    Dir *victim = NULL;
+
+    for (size_t i = 0; i < ndirs; i++) {
+	Dir *e = dirs[i];
+
+	if (e->busy) {
+	    continue;
+	}
+
+	if (!strcmp(e->path, path)) {
+	    d = e;
+	    break;
+	}
+
+	if (!victim || e->used < victim->used) {
+	    victim = e;
+	}
+    }
+
+    if (d && !d->racy && d->dev == st.st_dev && d->ino == st.st_ino
+	&& d->mtime.tv_sec == st.st_mtim.tv_sec
+	&& d->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+	d->used = ++ticks;
+	return d;
+    }
+
+    if (!d && (ndirs < NDIRS || !victim)) {
+	if (ndirs == capdirs) {
+	    capdirs = capdirs ? capdirs * 2 : NDIRS;
+	    dirs = realloc(dirs, sizeof(Dir *) * capdirs);
+	}
+
+	d = calloc(1, sizeof(Dir));
+	str_init(&d->names);
+	dirs[ndirs++] = d;
+    } else if (!d) {
+	d = victim;
+	free(d->path);
+	d->path = NULL;
+    }
+
+    if (!d->path) {
+	d->path = strdup(path);
+    }
+
+    d->used = ++ticks;
+    return dir_read(d, path, &st) ? d : NULL;
+}
+
+// dir_read reads the listing of the directory path, whose status is st,
+// into d.
+static bool dir_read(Dir *d, const char *path, struct stat *st)
+{
+    d->names.len = 0;
+    d->n = 0;
+    d->racy = true;
+
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+	return false;
+    }
+
+    if (!buf) {
+	buf = malloc(BUFSIZE);
+    }
+
+    // File times come from the coarse clock; a change made after this
+    // point gets a time at least as late as now.
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+
+    long n;
+    while ((n = syscall(SYS_getdents64, fd, buf, BUFSIZE)) > 0) {
+	for (long off = 0; off < n;) {
+	    Dirent64 *de = (Dirent64 *) (buf + off);
+	    off += de->reclen;
+
+	    if (d->n == d->cap) {
+		d->cap = d->cap ? d->cap * 2 : 64;
+		d->ents = realloc(d->ents, sizeof(Ent) * d->cap);
+	    }
+
+	    d->ents[d->n].off = d->names.len;
+	    d->ents[d->n].type = de->type;
+	    d->n++;
+	    str_putn(&d->names, de->name, strlen(de->name) + 1);
+	}
+    }
+
+    close(fd);
+    if (n < 0) {
+	d->n = 0;
+	return false;
+    }
+
+    names = d->names.s;
+    qsort(d->ents, d->n, sizeof(Ent), compare_ents);
+
+    d->dev = st->st_dev;
+    d->ino = st->st_ino;
+    d->mtime = st->st_mtim;
+    d->racy = st->st_mtim.tv_sec > now.tv_sec
+	|| (st->st_mtim.tv_sec == now.tv_sec
+	    && st->st_mtim.tv_nsec >= now.tv_nsec);
+    return true;
+}
+
+// compare orders two pathnames for qsort.
+static int compare(const void *a, const void *b)
+{
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+// compare_ents orders two entries of the listing being sorted for qsort.
+static int compare_ents(const void *a, const void *b)
+{
+    return strcmp(names + ((const Ent *) a)->off,
+		  names + ((const Ent *) b)->off);
+}
@@ -0,0 +1,12 @@
+//
+// glob.h - pathname expansion
+//
+
+#ifndef GLOB_H
+#define GLOB_H
+
+#include "str.h"
+
+int glob_expand(const char *, Str *);
+
+#endif
@@ -0,0 +1,664 @@
+//
+// hist.c - command history
+//
+// The history is a log of the complete commands entered, each followed by
+// a '\0', that shells only ever append to. An entry is added with a single
+// write to the log opened with O_APPEND, so that shells sharing the log
+// never mix their entries, and nobody waits for a lock: readers see an
+// entry once its '\0' is there. The log is mapped and read in place.
+//
+// A side index, in a file named after the log with ".idx" appended, covers
+// the log up to some offset. It holds the offsets of the entries sorted by
+// their text, for a binary search of the entries that start with a
+// prefix, and for each BLOCK bytes of the log, a Bloom filter of the
+// trigrams of the entries starting there, so that a substring search skips
+// the blocks that can't have it without reading them. The entries past
+// the index are searched as they are; once they take TAILMAX bytes, the
+// index is extended when a shell first uses the history and replaced with
+// a rename, which leaves alone the shells that still map the old one.
+//
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "hist.h"
+#include "table.h"
+
+#define BLOCK 16384
+#define BITS 14			// of the hash of a trigram
+#define BLOOM ((1 << BITS) / 8)	// bytes of the Bloom filter of a block
+#define NTRIGRAMS 64		// most trigrams of a query looked up
+#define TAILMAX (64 * 1024)
+#define VERSION 1
+#define MAGIC "xshindex"
+
+typedef struct __sIndex Index;
+
+void hist_open(const char *);
+void hist_add(const char *, size_t);
+const char *hist_text(uint64_t);
+uint64_t hist_end(void);
+uint64_t hist_prev(uint64_t);
+uint64_t hist_next(uint64_t);
+size_t hist_prefix(const char *, size_t, size_t, uint64_t *);
+uint64_t hist_search(const char *, size_t, uint64_t);
+static void ready(void);
+static void remap(void);
+static void load(const char *);
+static void unload(void);
+static void extend(const char *);
+static uint64_t scan(const char *, size_t, uint64_t, uint64_t);
+static uint64_t start(uint64_t);
+static size_t bound(const char *, size_t, bool);
+static bool bloom_has(const uint8_t *, const unsigned *, size_t);
+static unsigned trigram(const char *);
+static uint64_t check(uint64_t);
+static void keep(uint64_t *, size_t *, size_t, uint64_t);
+static int compare(const void *, const void *);
+static int compare_latest(const void *, const void *);
+static int compare_recent(const void *, const void *);
+static int compare_text(const void *, const void *);
+
+// ---------------------------------------------------------------------------
+
+// Index is found at the start of the index file. It is followed by the
+// offsets of the count entries it covers sorted by their text, equal texts
+// oldest first, and by the Bloom filter of each block of the log up to
+// covered.
+struct __sIndex {
+    char magic[8];
+    uint64_t version;
+    uint64_t dev;		// of the log
+    uint64_t ino;
+    uint64_t covered;		// bytes of the log indexed, whole entries
+    uint64_t check;		// hash of the last 64 bytes before covered
+    uint64_t count;
+};
+
+static char *name;		// path of the log, until it is opened
+static int fd = -1;		// the log
+static struct stat st;		// its status when opened
+static const char *data;	// its mapping, of size bytes
+static size_t size;
+static uint64_t end;		// past its last whole entry
+
+static Index *idx;		// NULL if there is no valid index
+static size_t idxsize;
+static const uint64_t *offs;
+static const uint8_t *blooms;
+static uint64_t covered;	// 0 without index
+
+// hist_open names path as the history log. It is opened, made if it does
+// not exist, only when the history is first used, and so is its index,
+// extended if too many entries are past it. Without a log, there is no
+// history.
+void hist_open(const char *path)
+{
+    free(name);
+    name = strdup(path);
+}
+
+// ready opens the log named by hist_open() and its index, the first time
+// the history is used.
+static void ready(void)
+{
+    if (!name) {
+	return;
+    }
+
+    char *path = name;
+    name = NULL;
+
+    fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+	free(path);
+	return;
+    }
+
+    remap();
+
+    char *ipath = malloc(strlen(path) + 5);
+    sprintf(ipath, "%s.idx", path);
+    load(ipath);
+
+    if (end - covered >= TAILMAX) {
+	extend(ipath);
+	load(ipath);
+    }
+
+    free(ipath);
+    free(path);
+}
+
+// hist_add appends the command text of n bytes to the history, unless it
+// is empty or the same as the last one.
+void hist_add(const char *text, size_t n)
+{
+    ready();
+    if (fd < 0 || n == 0 || memchr(text, '\0', n)) {
+	return;
+    }
+
+    uint64_t last = hist_prev(hist_end());
+    if (last != HIST_NONE && !strncmp(data + last, text, n)
+	&& !data[last + n]) {
+	return;
+    }
+
+    struct iovec iov[2] = {
+	{(void *) text, n},
+	{"", 1},
+    };
+
+    writev(fd, iov, 2);
+}
+
+// hist_text returns the text of the entry at off. It stays valid until the
+// next call to any other function of the history.
+const char *hist_text(uint64_t off)
+{
+    return data + off;
+}
+
+// hist_end returns the offset past the last entry of the history, taking
+// in the entries added since the last call, by any shell.
+uint64_t hist_end(void)
+{
+    ready();
+    if (fd >= 0) {
+	remap();
+    }
+
+    return end;
+}
+
+// hist_prev returns the offset of the entry before the one at off, or
+// HIST_NONE if there is none.
+uint64_t hist_prev(uint64_t off)
+{
+    if (off == 0 || off > end) {
+	return HIST_NONE;
+    }
+
+    const char *z = memrchr(data, '\0', off - 1);
+    return z ? (uint64_t) (z - data + 1) : 0;
+}
+
+// hist_next returns the offset of the entry after the one at off, or
+// HIST_NONE if there is none.
+uint64_t hist_next(uint64_t off)
+{
+    if (off >= end) {
+	return HIST_NONE;
+    }
+
+    off += strlen(data + off) + 1;
+    return off < end ? off : HIST_NONE;
+}
+
+// hist_prefix sets v to the offsets of the max most recent entries
+// starting with the n bytes of prefix, the most recent first, with each
+// text only once, and returns how many there are. The indexed entries are
+// found by a binary search of the index, which has those of a text
+// together and the latest last. Only the max most recent are kept, in a
+// heap: once it is full, an older entry is passed over without reading
+// its text, so that a prefix shared by many entries costs little more
+// than stepping over their offsets.
+size_t hist_prefix(const char *prefix, size_t n, size_t max, uint64_t *v)
+{
+    hist_end();
+
+    // The entries past the index are the most recent ones. Those of each
+    // text but the latest are dropped, and the indexed entries of their
+    // texts too.
+    size_t nt = 0;
+    size_t cap = 0;
+    uint64_t *t = NULL;
+
+    for (uint64_t o = covered; o < end; o += strlen(data + o) + 1) {
+	if (strncmp(data + o, prefix, n)) {
+	    continue;
+	}
+
+	if (nt == cap) {
+	    cap = cap ? cap * 2 : 16;
+	    t = realloc(t, sizeof(uint64_t) * cap);
+	}
+	t[nt++] = o;
+    }
+
+    qsort(t, nt, sizeof(uint64_t), compare_latest);
+    size_t m = 0;
+    for (size_t i = 0; i < nt; i++) {
+	if (!m || strcmp(data + t[m - 1], data + t[i])) {
+	    t[m++] = t[i];
+	}
+    }
+    nt = m;
+
+    size_t k = 0;
+    for (size_t i = 0; i < nt; i++) {
+	keep(v, &k, max, t[i]);
+    }
+
+    size_t lo = bound(prefix, n, false);
+    size_t hi = bound(prefix, n, true);
+
+    for (size_t i = lo; i < hi; i++) {
+	uint64_t o = offs[i];
+	if (k == max && (!max || o <= v[0])) {
+	    continue;
+	}
+
+	if (i + 1 < hi && !strcmp(data + o, data + offs[i + 1])) {
+	    continue;
+	}
+
+	if (nt && bsearch(data + o, t, nt, sizeof(uint64_t), compare_text)) {
+	    continue;
+	}
+
+	keep(v, &k, max, o);
+    }
+
+    free(t);
+    qsort(v, k, sizeof(uint64_t), compare_recent);
+    return k;
+}
+
+// hist_search returns the offset of the most recent entry starting before
+// before that has the n bytes of q in it, or HIST_NONE if there is none.
+// Blocks of the log whose Bloom filter lacks any trigram of q are skipped.
+uint64_t hist_search(const char *q, size_t n, uint64_t before)
+{
+    hist_end();
+
+    if (before > end) {
+	before = end;
+    }
+
+    if (n == 0 || before == 0) {
+	return HIST_NONE;
+    }
+
+    if (before > covered) {
+	uint64_t m = scan(q, n, covered, before);
+	if (m != HIST_NONE || covered == 0) {
+	    return m;
+	}
+	before = covered;
+    }
+
+    unsigned hs[NTRIGRAMS];
+    size_t nhs = 0;
+    for (size_t i = 0; i + 3 <= n && nhs < NTRIGRAMS; i++) {
+	hs[nhs++] = trigram(q + i);
+    }
+
+    for (uint64_t b = (before - 1) / BLOCK + 1; b-- > 0;) {
+	if (!bloom_has(blooms + b * BLOOM, hs, nhs)) {
+	    continue;
+	}
+
+	uint64_t to = (b + 1) * BLOCK < before ? (b + 1) * BLOCK : before;
+	uint64_t m = scan(q, n, b * BLOCK, to);
+	if (m != HIST_NONE) {
+	    return m;
+	}
+    }
+
+    return HIST_NONE;
+}
+
+// remap maps the log again if its size changed, and finds the end of its
+// last whole entry. An index that covers more than the log is dropped.
+static void remap(void)
+{
+    struct stat now;
+    if (fstat(fd, &now) < 0 || (size_t) now.st_size == size) {
+	return;
+    }
+
+    if (data) {
+	munmap((void *) data, size);
+    }
+
+    data = NULL;
+    size = 0;
+    end = 0;
+
+    if (now.st_size > 0) {
+	void *p = mmap(NULL, now.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (p != MAP_FAILED) {
+	    data = p;
+	    size = now.st_size;
+
+	    const char *z = memrchr(data, '\0', size);
+	    end = z ? (uint64_t) (z - data + 1) : 0;
+	}
+    }
+
+    if (end < covered) {
+	unload();
+    }
+}
+
+// load maps the index file path, if it is an index of the log.
+static void load(const char *path)
+{
+    unload();
+
+    int ifd = open(path, O_RDONLY | O_CLOEXEC);
+    if (ifd < 0) {
+	return;
+    }
+
+    struct stat ist;
+    void *p = MAP_FAILED;
+    if (fstat(ifd, &ist) == 0 && (size_t) ist.st_size >= sizeof(Index)) {
+	p = mmap(NULL, ist.st_size, PROT_READ, MAP_SHARED, ifd, 0);
+    }
+
+    close(ifd);
+    if (p == MAP_FAILED) {
+	return;
+    }
+
+    Index *h = p;
+    size_t n = ist.st_size - sizeof(Index);
+    size_t nblocks = (h->covered + BLOCK - 1) / BLOCK;
+
+    if (memcmp(h->magic, MAGIC, 8) || h->version != VERSION
+	|| h->dev != st.st_dev || h->ino != st.st_ino || h->covered > end
+	|| h->check != check(h->covered) || h->count > n / sizeof(uint64_t)
+	|| n != h->count * sizeof(uint64_t) + nblocks * BLOOM) {
+	munmap(p, ist.st_size);
+	return;
+    }
+
+    idx = h;
+    idxsize = ist.st_size;
+    offs = (const uint64_t *) (h + 1);
+    blooms = (const uint8_t *) (offs + h->count);
+    covered = h->covered;
+}
+
+// unload unmaps the index.
+static void unload(void)
+{
+    if (idx) {
+	munmap(idx, idxsize);
+    }
+
+    idx = NULL;
+    offs = NULL;
+    blooms = NULL;
+    covered = 0;
+}
+
+// extend writes to path the index of the whole log: the entries past the
+// current index are sorted and merged into it, and the Bloom filters of
+// the blocks they start in are made.
+static void extend(const char *path)
+{
+    size_t n = 0;
+    size_t cap = 1024;
+    uint64_t *tail = malloc(sizeof(uint64_t) * cap);
+
+    for (uint64_t o = covered; o < end; o += strlen(data + o) + 1) {
+	if (n == cap) {
+	    cap *= 2;
+	    tail = realloc(tail, sizeof(uint64_t) * cap);
+	}
+	tail[n++] = o;
+    }
+
+    qsort(tail, n, sizeof(uint64_t), compare);
+
+    size_t old = idx ? idx->count : 0;
+    size_t count = old + n;
+    size_t nblocks = (end + BLOCK - 1) / BLOCK;
+    size_t len = sizeof(Index) + count * sizeof(uint64_t) + nblocks * BLOOM;
+    char *buf = calloc(1, len);
+
+    Index *h = (Index *) buf;
+    memcpy(h->magic, MAGIC, 8);
+    h->version = VERSION;
+    h->dev = st.st_dev;
+    h->ino = st.st_ino;
+    h->covered = end;
+    h->check = check(end);
+    h->count = count;
+
+    uint64_t *o = (uint64_t *) (h + 1);
+    for (size_t i = 0, j = 0; i < old || j < n;) {
+	if (j == n || (i < old && compare(&offs[i], &tail[j]) < 0)) {
+	    *o++ = offs[i++];
+	} else {
+	    *o++ = tail[j++];
+	}
+    }
+
+    // The filters of the blocks before the one the index ends in are
+    // complete; the others are made from their entries.
+    uint8_t *b = (uint8_t *) o;
+    size_t keep = covered / BLOCK;
+    if (keep) {
+	memcpy(b, blooms, keep * BLOOM);
+    }
+
+    for (uint64_t e = start(keep * BLOCK); e < end;) {
+	uint8_t *bloom = b + e / BLOCK * BLOOM;
+	size_t elen = strlen(data + e);
+
+	for (size_t i = 0; i + 3 <= elen; i++) {
+	    unsigned t = trigram(data + e + i);
+	    bloom[t / 8] |= 1 << (t % 8);
+	}
+
+	e += elen + 1;
+    }
+
+    char *tmp = malloc(strlen(path) + 32);
+    sprintf(tmp, "%s.%d", path, (int) getpid());
+
+    int ifd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    size_t done = 0;
+    while (ifd >= 0 && done < len) {
+	ssize_t w = write(ifd, buf + done, len - done);
+	if (w <= 0) {
+	    break;
+	}
+	done += w;
+    }
+
+    if (ifd >= 0) {
+	close(ifd);
+	if (done < len || rename(tmp, path) < 0) {
+	    unlink(tmp);
+	}
+    }
+
+    free(tmp);
+    free(buf);
+    free(tail);
+}
+
+// scan returns the offset of the most recent entry starting from from and
+// before to that has the n bytes of q in it, or HIST_NONE if there is
+// none.
+static uint64_t scan(const char *q, size_t n, uint64_t from, uint64_t to)
+{
+    uint64_t e = start(from);
+    if (e >= to) {
+	return HIST_NONE;
+    }
+
+    // The last entry starting before to ends at the first '\0' from to-1.
+    const char *z = memchr(data + to - 1, '\0', end - (to - 1));
+    uint64_t limit = z - data + 1;
+    uint64_t found = HIST_NONE;
+
+    while (e < limit) {
+	const char *p = memmem(data + e, limit - e, q, n);
+	if (!p) {
+	    break;
+	}
+
+	const char *s = memrchr(data + e, '\0', p - (data + e));
+	uint64_t at = s ? (uint64_t) (s - data + 1) : e;
+	if (at >= to) {
+	    break;
+	}
+
+	found = at;
+	e = at + strlen(data + at) + 1;
+    }
+
+    return found;
+}
+
+// start returns the offset of the first entry starting at off or after.
+static uint64_t start(uint64_t off)
+{
+    if (off == 0 || off >= end) {
+	return off < end ? off : end;
+    }
+
+    const char *z = memchr(data + off - 1, '\0', end - (off - 1));
+    return z - data + 1;
+}
+
+// bound returns the index of the first indexed entry that starts with the
+// n bytes of prefix, or past them if upper is set, in sorted order.
+static size_t bound(const char *prefix, size_t n, bool upper)
+{
+    size_t lo = 0;
+    size_t hi = idx ? idx->count : 0;
+
+    while (lo < hi) {
+	size_t mid = lo + (hi - lo) / 2;
+	int c = strncmp(data + offs[mid], prefix, n);
+
+	if (c < 0 || (upper && c == 0)) {
+	    lo = mid + 1;
+	} else {
+	    hi = mid;
+	}
+    }
+
+    return lo;
+}
+
+// bloom_has checks whether the Bloom filter bloom may have every one of
+// the nhs trigram hashes hs.
+static bool bloom_has(const uint8_t *bloom, const unsigned *hs, size_t nhs)
+{
+    for (size_t i = 0; i < nhs; i++) {
+	if (!(bloom[hs[i] / 8] & 1 << (hs[i] % 8))) {
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+// trigram returns the hash of the three bytes at p, of BITS bits.
+static unsigned trigram(const char *p)
+{
+    const unsigned char *u = (const unsigned char *) p;
+    uint32_t t = u[0] | u[1] << 8 | u[2] << 16;
+    return (t * 2654435761u) >> (32 - BITS);
+}
+
+// check returns a hash of the 64 bytes of the log before off, or of those
+// there are, so that an index is not used with a log that was replaced.
+static uint64_t check(uint64_t off)
+{
+    uint64_t start = off > 64 ? off - 64 : 0;
+    return table_hash(data + start, off - start);
+}
+
+// keep adds the entry off to the heap of the *k most recent entries in v,
+// of at most max, whose root is the oldest. An entry older than all of a
+// full heap is left out.
+static void keep(uint64_t *v, size_t *k, size_t max, uint64_t off)
+{
+    size_t i;
+
+    if (*k < max) {
+	for (i = (*k)++; i > 0 && v[(i - 1) / 2] > off; i = (i - 1) / 2) {
+	    v[i] = v[(i - 1) / 2];
+	}
+
+	v[i] = off;
+	return;
+    }
+
+    if (!max || off <= v[0]) {
+	return;
+    }
+
+    for (i = 0;;) {
+	size_t c = 2 * i + 1;
+	if (c >= max) {
+	    break;
+	}
+
+	if (c + 1 < max && v[c + 1] < v[c]) {
+	    c++;
+	}
+
+	if (v[c] >= off) {
+	    break;
+	}
+
+	v[i] = v[c];
+	i = c;
+    }
+
+    v[i] = off;
+}
+
+// compare orders two entries by text, and by age if the same, for qsort.
+static int compare(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    int c = strcmp(data + x, data + y);
+    return c ? c : (x > y) - (x < y);
+}
+
+// compare_latest orders two entries by text, and the latest first if the
+// same, for qsort.
+static int compare_latest(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    int c = strcmp(data + x, data + y);
+    return c ? c : (x < y) - (x > y);
+}
+
+// compare_recent orders two entries the most recent first, for qsort.
+static int compare_recent(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return (x < y) - (x > y);
+}
+
+// compare_text orders the text key and an entry, for bsearch.
+static int compare_text(const void *key, const void *b)
+{
+    return strcmp(key, data + *(const uint64_t *) b);
+}
@@ -0,0 +1,22 @@
+//
+// hist.h - command history
+//
+
+#ifndef HIST_H
+#define HIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HIST_NONE UINT64_MAX
+
+void hist_open(const char *);
+void hist_add(const char *, size_t);
+const char *hist_text(uint64_t);
+uint64_t hist_end(void);
+uint64_t hist_prev(uint64_t);
+uint64_t hist_next(uint64_t);
+size_t hist_prefix(const char *, size_t, size_t, uint64_t *);
+uint64_t hist_search(const char *, size_t, uint64_t);
+
+#endif
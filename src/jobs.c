@@ -0,0 +1,453 @@
+//
+// jobs.c - child processes and background jobs
+//
+// Every child process of the shell is tracked from the time it is forked
+// until its status is collected. Rather than blocking in waitpid(2) for a
+// given child, the shell waits on a single epoll instance that tells which
+// children ended: each child has a pidfd registered there, which becomes
+// readable once it exits. A child without a pidfd, as when pidfd_open is
+// not available or the shell runs out of descriptors, is reaped when a
+// signalfd registered in the same instance reports SIGCHLD. Either way,
+// the job of an ended child is found in a hash table by its pid, so that
+// waiting costs the same whatever the number of jobs.
+//
+// With a limit set by jobs_limit(), at most that many background jobs run
+// at once. A job started beyond it waits for one of them to end: the shell
+// stops at its '&' until then, so that the jobs start in the order of the
+// script, each with the variables of the shell at its '&'.
+//
+// Children are reaped with wait4, so that what each one used is known to
+// whoever waits for it, as for the stages of a timed pipeline.
+//
+// A background job that ended is kept for 'wait pid' until KEEP more have
+// ended after it, which POSIX allows, so that scripts that never wait
+// don't fill the table. The job of $! is kept whatever its age.
+//
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "jobs.h"
+#include "table.h"
+
+#define NEVENTS 64
+#define SIGNAL 0		// epoll key of the signalfd; the others are pids
+#define KEEP 1024		// background jobs kept once done
+
+typedef struct __sJob Job;
+
+pid_t jobs_fork(bool);
+int jobs_wait(pid_t, Usage *);
+int jobs_waitall(void);
+void jobs_poll(void);
+pid_t jobs_last(void);
+void jobs_limit(int);
+static void init(void);
+static void forget(void);
+static void track(pid_t, bool);
+static void signals(void);
+static int dispatch(int);
+static void reap(Job *, int);
+static void reap_any(void);
+static int code(int);
+static Job *lookup(pid_t, bool);
+static void delete(Job *);
+static void prune(uint64_t);
+static bool same(const void *, const void *);
+
+// ---------------------------------------------------------------------------
+
+// Job is a child process, an entry of the open addressing table that holds
+// them.
+struct __sJob {
+    uint64_t hash;
+    pid_t pid;
+    int pidfd;			// -1 if none, or once reaped
+    bool bg;			// whether it is a background job
+    bool done;			// whether it was reaped
+    int status;			// exit status, once done
+    uint64_t seq;		// of a background job, its rank in ending
+    Usage usage;		// complete once done
+};
+
+static Table jobs = {.size = sizeof(Job) };
+static size_t running;		// background jobs not done
+static uint64_t ended;		// background jobs done so far
+static uint64_t pruned;		// those done before it were dropped
+
+static int epfd = -1;
+static int sigfd = -1;		// -1 until a child has no pidfd
+static sigset_t mask;		// signal mask before SIGCHLD was blocked
+static struct rlimit nofile;	// descriptor limit before it was raised
+static pid_t last;		// most recent background job, $!
+static size_t limit;		// of running background jobs, 0 if none
+
+// jobs_fork forks a child process, and returns its pid in the parent, 0 in
+// the child, or -1 on error. The parent tracks the child until
+// jobs_wait() collects its status; bg tells a background job, which is
+// also waited for by jobs_waitall(). The child forgets the jobs of the
+// parent.
+pid_t jobs_fork(bool bg)
+{
+    if (epfd < 0) {
+	init();
+    }
+
+    // Reap the background jobs that are done, so that scripts that never
+    // wait don't fill the process table with zombies.
+    if (bg) {
+	jobs_poll();
+    }
+
+    while (bg && limit && running >= limit) {
+	if (sigfd >= 0) {
+	    reap_any();
+	}
+
+	if (running >= limit && dispatch(-1) < 0) {
+	    break;
+	}
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+	return -1;
+    }
+
+    if (pid == 0) {
+	forget();
+	return 0;
+    }
+
+    track(pid, bg);
+    if (bg) {
+	last = pid;
+    }
+
+    return pid;
+}
+
+// jobs_wait waits for the child pid to end and returns its exit status,
+// 128 plus the number of the signal that killed it, or 127 if it is not a
+// child of the shell or was already waited for. If u is not NULL, it is
+// set to what the child used.
+int jobs_wait(pid_t pid, Usage *u)
+{
+    Job *j = lookup(pid, false);
+    if (!j) {
+	return 127;
+    }
+
+    // Jobs are neither added nor deleted while dispatching, so j stays.
+    while (!j->done) {
+	if (sigfd >= 0) {
+	    reap_any();
+	}
+
+	if (!j->done && dispatch(-1) < 0) {
+	    break;
+	}
+    }
+
+    int st = j->done ? j->status : 127;
+    if (u) {
+	*u = j->usage;
+    }
+
+    delete(j);
+    return st;
+}
+
+// jobs_waitall waits for every background job to end and forgets them. It
+// returns zero.
+int jobs_waitall(void)
+{
+    while (running > 0) {
+	if (sigfd >= 0) {
+	    reap_any();
+	}
+
+	if (running > 0 && dispatch(-1) < 0) {
+	    break;
+	}
+    }
+
+    prune(UINT64_MAX);
+
+    return 0;
+}
+
+// jobs_poll reaps the children that ended, without waiting, and forgets
+// the background jobs that ended KEEP jobs ago or more. They are dropped
+// KEEP at a time, so that the table is swept once per KEEP jobs.
+void jobs_poll(void)
+{
+    if (epfd < 0) {
+	return;
+    }
+
+    if (sigfd >= 0) {
+	reap_any();
+    }
+
+    while (dispatch(0) == NEVENTS) {
+    }
+
+    if (ended - pruned >= 2 * KEEP) {
+	pruned = ended - KEEP + 1;
+	prune(pruned);
+    }
+}
+
+// jobs_last returns the pid of the most recent background job, $!, or 0 if
+// there is none.
+pid_t jobs_last(void)
+{
+    return last;
+}
+
+// jobs_limit makes at most n background jobs run at once, or lifts the
+// limit if n is zero.
+void jobs_limit(int n)
+{
+    limit = n > 0 ? n : 0;
+}
+
+// init makes the epoll instance. As every running child holds a pidfd,
+// the limit on descriptors is raised as far as it goes.
+static void init(void)
+{
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+	perror("epoll_create1");
+	exit(2);
+    }
+
+    getrlimit(RLIMIT_NOFILE, &nofile);
+    struct rlimit raised = { nofile.rlim_max, nofile.rlim_max };
+    setrlimit(RLIMIT_NOFILE, &raised);
+}
+
+// forget drops the jobs of the parent in a child just forked, and puts
+// back the signal mask and the limit on descriptors. It costs the same
+// whatever the number of jobs: the table is left to the parent, and the
+// pidfds, opened close-on-exec, go away with any command run.
+static void forget(void)
+{
+    jobs = (Table) {.size = sizeof(Job) };
+    running = 0;
+    ended = 0;
+    pruned = 0;
+
+    close(epfd);
+    epfd = -1;
+
+    if (sigfd >= 0) {
+	close(sigfd);
+	sigfd = -1;
+	sigprocmask(SIG_SETMASK, &mask, NULL);
+    }
+
+    setrlimit(RLIMIT_NOFILE, &nofile);
+}
+
+// track adds the child pid to the jobs.
+static void track(pid_t pid, bool bg)
+{
+    Job *j = lookup(pid, true);
+    j->bg = bg;
+    j->done = false;
+    j->status = 0;
+    j->seq = 0;
+    j->pidfd = -1;
+    memset(&j->usage, 0, sizeof(Usage));
+    clock_gettime(CLOCK_MONOTONIC, &j->usage.start);
+
+#ifdef SYS_pidfd_open
+    j->pidfd = syscall(SYS_pidfd_open, pid, 0);
+#endif
+
+    if (j->pidfd >= 0) {
+	struct epoll_event ev = {.events = EPOLLIN,.data.u64 = pid };
+	epoll_ctl(epfd, EPOLL_CTL_ADD, j->pidfd, &ev);
+    } else {
+	signals();
+    }
+
+    running += bg;
+}
+
+// signals blocks SIGCHLD and registers a signalfd for it, so that the
+// children without a pidfd are reaped too. A child may have ended before,
+// its signal lost, which is why reap_any() is called before any wait from
+// now on.
+static void signals(void)
+{
+    if (sigfd >= 0) {
+	return;
+    }
+
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &set, &mask);
+
+    sigfd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sigfd < 0) {
+	perror("signalfd");
+	exit(2);
+    }
+
+    struct epoll_event ev = {.events = EPOLLIN,.data.u64 = SIGNAL };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, sigfd, &ev);
+}
+
+// dispatch waits up to timeout milliseconds, or forever if it is negative,
+// for children to end, and reaps them. It returns the number of events
+// handled, or -1 on error.
+static int dispatch(int timeout)
+{
+    struct epoll_event evs[NEVENTS];
+
+    int n = epoll_wait(epfd, evs, NEVENTS, timeout);
+    if (n < 0) {
+	if (errno == EINTR) {
+	    return 0;
+	}
+
+	perror("epoll_wait");
+	return -1;
+    }
+
+    for (int i = 0; i < n; i++) {
+	if (evs[i].data.u64 == SIGNAL) {
+	    struct signalfd_siginfo si;
+	    while (read(sigfd, &si, sizeof(si)) == sizeof(si)) {
+	    }
+
+	    reap_any();
+	    continue;
+	}
+
+	// A pidfd is readable once its process has ended, so this does not
+	// block.
+	Job *j = lookup(evs[i].data.u64, false);
+	if (j && !j->done) {
+	    int ws;
+	    pid_t pid = wait4(j->pid, &ws, 0, &j->usage.ru);
+	    reap(j, pid == j->pid ? code(ws) : 127);
+	}
+    }
+
+    return n;
+}
+
+// reap marks the job j as done with the exit status st.
+static void reap(Job *j, int st)
+{
+    j->done = true;
+    j->status = st;
+    running -= j->bg;
+    if (j->bg) {
+	j->seq = ++ended;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &j->usage.end);
+
+    if (j->pidfd >= 0) {
+	epoll_ctl(epfd, EPOLL_CTL_DEL, j->pidfd, NULL);
+	close(j->pidfd);
+	j->pidfd = -1;
+    }
+}
+
+// reap_any reaps every child that ended.
+static void reap_any(void)
+{
+    int ws;
+    pid_t pid;
+    struct rusage ru;
+
+    while ((pid = wait4(-1, &ws, WNOHANG, &ru)) > 0) {
+	Job *j = lookup(pid, false);
+	if (j && !j->done) {
+	    j->usage.ru = ru;
+	    reap(j, code(ws));
+	}
+    }
+}
+
+// code returns the exit status of the wait status ws.
+static int code(int ws)
+{
+    if (WIFSIGNALED(ws)) {
+	return 128 + WTERMSIG(ws);
+    }
+
+    return WEXITSTATUS(ws);
+}
+
+// lookup returns the job of pid. If there is none, it is added when create
+// is set, or NULL is returned.
+static Job *lookup(pid_t pid, bool create)
+{
+    uint64_t h = table_hash(&pid, sizeof(pid));
+    Job key = {.pid = pid };
+    Job *j = table_find(&jobs, h, &key, same);
+    if (j || !create) {
+	return j;
+    }
+
+    j = table_add(&jobs, h);
+    j->pid = pid;
+    return j;
+}
+
+// delete removes the job j from the table.
+static void delete(Job *j)
+{
+    if (!j->done) {
+	reap(j, 127);
+    }
+
+    table_delete(&jobs, j);
+}
+
+// prune removes the background jobs that ended before the one of rank
+// seq. The job of $! is kept, unless seq is UINT64_MAX and every job that
+// ended goes.
+static void prune(uint64_t seq)
+{
+    // A deletion shifts the next jobs back into slot i, so it is looked
+    // at again.
+    for (size_t i = 0; i < jobs.cap;) {
+	Job *e = table_at(&jobs, i);
+	bool gone = e && e->bg && e->done && e->seq < seq
+	    && (e->pid != last || seq == UINT64_MAX);
+
+	if (gone) {
+	    table_delete(&jobs, e);
+	} else {
+	    i++;
+	}
+    }
+}
+
+// same tells whether the jobs a and b are of the same pid.
+static bool same(const void *a, const void *b)
+{
+    return ((const Job *) a)->pid == ((const Job *) b)->pid;
+}
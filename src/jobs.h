@@ -0,0 +1,28 @@
+//
+// jobs.h - child processes and background jobs
+//
+
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdbool.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+// Usage is what a child process used, from the time it was forked until it
+// was reaped.
+typedef struct __sUsage {
+    struct timespec start;	// CLOCK_MONOTONIC
+    struct timespec end;
+    struct rusage ru;		// as told by wait4
+} Usage;
+
+pid_t jobs_fork(bool);
+int jobs_wait(pid_t, Usage *);
+int jobs_waitall(void);
+void jobs_poll(void);
+pid_t jobs_last(void);
+void jobs_limit(int);
+
+#endif
@@ -1,9 +1,11 @@
 #include <stdbool.h>
 #include "lex.h"
 
-#define LENGTH 16
+#define LENGTH 17
 
-static char *keywords[LENGTH] = {
+// The keywords are kept in place rather than pointed to, so that the table
+// is constant data needing no relocation when the program starts.
+static const char keywords[LENGTH][6] = {
     "if",
     "then",
     "else",
@@ -19,10 +21,11 @@ static char *keywords[LENGTH] = {
     "{",
     "}",
     "!",
+    "time",
     "in",
 };
 
-static int keywordtypes[LENGTH] = {
+static const TokenType keywordtypes[LENGTH] = {
     TIf,
     TThen,
     TElse,
@@ -38,10 +41,12 @@ static int keywordtypes[LENGTH] = {
     TLBrace,
     TRBrace,
     TBang,
+    TTime,
     TIn,
 };
 
 TokenType keyw_gettype(const char *);
+const char *keyw_name(int);
 static bool streq(const char *, const char *);
 
 // ---------------------------------------------------------------------------
@@ -60,6 +65,12 @@ TokenType keyw_typeof(const char *keyword)
     return TWord;
 }
 
+// keyw_name returns the i-th keyword, or NULL past the last one.
+const char *keyw_name(int i)
+{
+    return i >= 0 && i < LENGTH ? keywords[i] : NULL;
+}
+
 // streq checks whether s1 and s2 are equal.
 static bool streq(const char *s1, const char *s2)
 {
@@ -5,5 +5,6 @@
 #include "lex.h"
 
 TokenType keyw_typeof(const char *);
+const char *keyw_name(int);
 
 #endif
@@ -9,16 +9,26 @@
 
 #include "lex.h"
 #include "keyw.h"
+#include "arena.h"
 
 Lex *lex_make(void);
 void lex_readfrom(const char *);
 Token *lex_next(void);
+Token *lex_tokens(const char *, size_t *);
+const char *lex_subst_end(const char *);
 static char next(void);
 static char peek(void);
 static void ignore(void);
 static Token *emit(TokenType);
 static Token *lex_keyword(void);
 static Token *lex_word(void);
+static bool lex_text(void);
+static bool lex_squote(void);
+static bool lex_dquote(void);
+static bool lex_bquote(void);
+static bool lex_dollar(void);
+static bool lex_nested(char, char);
+static bool lex_subst(void);
 static Token *lex_number(void);
 static Token *lex_and(void);
 static Token *lex_or(void);
@@ -30,14 +40,17 @@ static void lex_space(void);
 
 // ---------------------------------------------------------------------------
 
-static Lex *lex;
+static _Thread_local Lex state;
+static _Thread_local Lex *lex;
 
-// lex_make allocates and returns a Lex struct. Its field are just read-only,
-// make sure not setting any of its fields.  lex_make has to be called before
-// using the rest of public functions listen in "lex.h".
+// lex_make initializes and returns the Lex struct, which is static storage
+// rather than allocated. Its field are just read-only, make sure not
+// setting any of its fields.  lex_make has to be called before using the
+// rest of public functions listen in "lex.h", by every thread using them:
+// each thread has a lexer of its own.
 Lex *lex_make(void)
 {
-    lex = malloc(sizeof(Lex));
+    lex = &state;
     lex->pos = 0;
     lex->stt = 0;
     lex->seen[0] = TEOF;
@@ -92,12 +105,11 @@ static Token *emit(TokenType type)
     lex->seen[0] = type;
 
     // Prepare the current token.
-    Token *tok = malloc(sizeof(Token));
+    Token *tok = arena_alloc(sizeof(Token));
     tok->type = type;
 
     int n_chars = lex->pos - lex->stt;
-    tok->text = malloc(sizeof(char) * (n_chars + 1));
-    tok->text[n_chars] = '\0';
+    tok->text = arena_alloc(sizeof(char) * (n_chars + 1));
     tok->col = lex->stt + 1;
 
     strncpy(tok->text, lex->buf + lex->stt, n_chars);
@@ -129,6 +141,22 @@ Token *lex_next(void)
 	case '>':
 	    return lex_great();
 
+	case '(':
+	    return emit(TLParen);
+
+	case ')':
+	    return emit(TRParen);
+
+	    // These characters start a quoted or expanded part of a word,
+	    // which lex_word scans from its start.
+	case '\\':
+	case '\'':
+	case '"':
+	case '`':
+	case '$':
+	    lex->pos--;
+	    return lex_word();
+
 	    // These are all of the possible characters a keyword can start with.
 	case 'i':
 	case 't':
@@ -183,14 +211,71 @@ Token *lex_next(void)
     }
 }
 
+// lex_tokens returns the tokens of the whole input, without the TEOF at
+// its end, and sets *n to their number. The lexer is left as it was, so it
+// may be called between two calls to lex_next().
+Token *lex_tokens(const char *input, size_t *n)
+{
+    if (!lex) {
+	lex_make();
+    }
+
+    Lex saved = *lex;
+    lex_readfrom(input);
+    lex->seen[0] = TEOF;
+    lex->seen[1] = TEOF;
+    lex->seen[2] = TEOF;
+
+    size_t cap = 8;
+    Token *toks = malloc(sizeof(Token) * cap);
+    *n = 0;
+
+    for (;;) {
+	Token *tok = lex_next();
+	if (tok->type == TEOF) {
+	    arena_free(tok->text);
+	    arena_free(tok);
+	    break;
+	}
+
+	if (*n == cap) {
+	    cap *= 2;
+	    toks = realloc(toks, sizeof(Token) * cap);
+	}
+
+	toks[(*n)++] = *tok;
+	arena_free(tok);
+    }
+
+    *lex = saved;
+    return toks;
+}
+
+// lex_subst_end returns the position of the ')' closing the '$(' command
+// substitution whose text starts at s, or that of the '\0' ending s if
+// there is none. As with lex_tokens(), the lexer is left as it was.
+const char *lex_subst_end(const char *s)
+{
+    if (!lex) {
+	lex_make();
+    }
+
+    Lex saved = *lex;
+    lex_readfrom(s);
+    size_t end = lex_subst() ? lex->pos - 1 : lex->pos;
+
+    *lex = saved;
+    return s + end;
+}
+
 // lex_keyword scans:  TIf      TThen    TElse    TElif    TFi   TDo   TDone.
 //                     'if'     'then'   'else'   'elif'   'fi'  'do'  'done'
 //
 //                     TCase    TEsac    TWhile   TUntil   TFor
 //                     'case'   'esac'   'while'  'until'  'for'
 //
-//                     TLBrace  TRBrace  TBang
-//                     '{'      '}'      '!'
+//                     TLBrace  TRBrace  TBang    TTime
+//                     '{'      '}'      '!'      'time'
 static Token *lex_keyword(void)
 {
     for (;;) {
@@ -213,6 +298,7 @@ static Token *lex_keyword(void)
 	case 'h':
 	case 'i':
 	case 'l':
+	case 'm':
 	case 'n':
 	case 'o':
 	case 'r':
@@ -230,6 +316,13 @@ static Token *lex_keyword(void)
 	case '\r':
 	case '\n':
 	case '\0':
+	case ';':
+	case '&':
+	case '|':
+	case '<':
+	case '>':
+	case '(':
+	case ')':
 	    Token * tok = emit(TWord);
 
 	    // At this point, we have a t->text which has only characters 
@@ -256,8 +349,23 @@ static Token *lex_keyword(void)
 }
 
 
-// lex_word scans any TWord.
+// lex_word scans any TWord. Quoted parts and expansions are kept as they
+// are in the text of the token, but the characters in them don't end it,
+// so that:
+//
+//   echo "a b" ${x:-c d} $(f; g)
+//
+// gives four words. A word starting with '#' is a comment, but a '#'
+// within a word is not. A word whose quote or substitution is still open
+// at the end of the buf is a TError.
 static Token *lex_word(void)
+{
+    return emit(lex_text() ? TWord : TError);
+}
+
+// lex_text scans the rest of a word, up to the delimiter ending it, and
+// returns false if the buf ends within a quote or a substitution.
+static bool lex_text(void)
 {
     for (;;) {
 	switch (peek()) {
@@ -266,6 +374,41 @@ static Token *lex_word(void)
 	    next();
 	    break;
 
+	case '\\':
+	    next();
+	    if (peek() != '\0') {
+		next();
+	    }
+	    break;
+
+	case '\'':
+	    next();
+	    if (!lex_squote()) {
+		return false;
+	    }
+	    break;
+
+	case '"':
+	    next();
+	    if (!lex_dquote()) {
+		return false;
+	    }
+	    break;
+
+	case '`':
+	    next();
+	    if (!lex_bquote()) {
+		return false;
+	    }
+	    break;
+
+	case '$':
+	    next();
+	    if (!lex_dollar()) {
+		return false;
+	    }
+	    break;
+
 	    // Stop scanning when any of these delimiters is found.
 	case ' ':
 	case '\t':
@@ -276,8 +419,266 @@ static Token *lex_word(void)
 	case '\0':
 	case '<':
 	case '>':
+	case ';':
+	case '&':
+	case '|':
+	case '(':
+	case ')':
+	    return true;
+	}
+    }
+}
+
+// lex_squote scans the rest of a single-quoted string, up to and including
+// the closing quote, and returns false if there is none. Nothing is
+// special in between.
+static bool lex_squote(void)
+{
+    for (;;) {
+	switch (peek()) {
+
+	default:
+	    next();
+	    break;
+
+	case '\'':
+	    next();
+	    return true;
+
+	case '\0':
+	    return false;
+	}
+    }
+}
+
+// lex_dquote scans the rest of a double-quoted string, up to and including
+// the closing quote, and returns false if there is none. Backslashes and
+// expansions still apply in between.
+static bool lex_dquote(void)
+{
+    for (;;) {
+	switch (peek()) {
+
+	default:
+	    next();
+	    break;
+
+	case '\\':
+	    next();
+	    if (peek() != '\0') {
+		next();
+	    }
+	    break;
+
+	case '`':
+	    next();
+	    if (!lex_bquote()) {
+		return false;
+	    }
+	    break;
+
+	case '$':
+	    next();
+	    if (!lex_dollar()) {
+		return false;
+	    }
+	    break;
+
+	case '"':
+	    next();
+	    return true;
+
+	case '\0':
+	    return false;
+	}
+    }
+}
+
+// lex_bquote scans the rest of a backquoted command substitution, up to and
+// including the closing backquote, and returns false if there is none.
+static bool lex_bquote(void)
+{
+    for (;;) {
+	switch (peek()) {
+
+	default:
+	    next();
+	    break;
+
+	case '\\':
+	    next();
+	    if (peek() != '\0') {
+		next();
+	    }
+	    break;
+
+	case '`':
+	    next();
+	    return true;
+
+	case '\0':
+	    return false;
+	}
+    }
+}
+
+// lex_dollar scans what follows a '$': a '${...}' parameter expansion or a
+// '$(...)' command substitution, and returns false if it is not closed. A
+// plain '$name' needs nothing special.
+static bool lex_dollar(void)
+{
+    switch (peek()) {
+
+    case '{':
+	next();
+	return lex_nested('{', '}');
+
+    case '(':
+	next();
+	return lex_subst();
+    }
+
+    return true;
+}
+
+// lex_nested scans up to and including the close that matches an open
+// just scanned, skipping over quoted strings and nested expansions, and
+// returns false if there is no such close.
+static bool lex_nested(char open, char close)
+{
+    int depth = 1;
+
+    for (;;) {
+	char c = peek();
+
+	if (c == '\0') {
+	    return false;
+	}
+
+	next();
+
+	if (c == close && --depth == 0) {
+	    return true;
+	}
+
+	bool closed = true;
+	if (c == open) {
+	    depth++;
+	} else if (c == '\\' && peek() != '\0') {
+	    next();
+	} else if (c == '\'') {
+	    closed = lex_squote();
+	} else if (c == '"') {
+	    closed = lex_dquote();
+	} else if (c == '`') {
+	    closed = lex_bquote();
+	} else if (c == '$') {
+	    closed = lex_dollar();
+	}
+
+	if (!closed) {
+	    return false;
+	}
+    }
+}
+
+// lex_subst scans the rest of a '$(...)' command substitution, up to and
+// including the ')' closing it, and returns false if there is none. Its
+// commands are scanned word by word, as a case clause in them has a ')'
+// ending each pattern but no '(' to match: the words after its 'in' and
+// after each ';;' are patterns, up to the 'esac'.
+static bool lex_subst(void)
+{
+    int depth = 1;		// subshells open, and the substitution itself
+    int cases = 0;		// case clauses open, past their 'in'
+    int subject = 0;		// words left up to the 'in' of a case
+    bool head = true;		// whether a word would name a command
+    bool pattern = false;	// whether a word would be a pattern
+
+    for (;;) {
+	char c = peek();
+
+	switch (c) {
+
+	case '\0':
+	    return false;
+
+	case ' ':
+	case '\t':
+	case '\v':
+	case '\f':
+	case '\r':
+	case '<':
+	case '>':
+	    next();
+	    break;
+
+	case '\n':
+	case ';':
+	case '&':
+	case '|':
+	    next();
+	    if (c == ';' && peek() == ';') {
+		next();
+		pattern = cases > 0;
+	    }
+	    head = true;
+	    break;
+
+	    // A comment is kept in the text of the word, up to the newline.
 	case '#':
-	    return emit(TWord);
+	    while (peek() != '\n' && peek() != '\0') {
+		next();
+	    }
+	    break;
+
+	    // A '(' where a pattern would be is the optional one before it.
+	case '(':
+	    next();
+	    depth += !pattern;
+	    head = true;
+	    break;
+
+	case ')':
+	    next();
+	    if (pattern) {
+		pattern = false;
+		head = true;
+	    } else if (--depth == 0) {
+		return true;
+	    }
+	    break;
+
+	default:
+	    size_t stt = lex->pos;
+	    if (!lex_text()) {
+		return false;
+	    }
+
+	    // Only a few letters long words may be keywords.
+	    char word[8] = "";
+	    if (lex->pos - stt < sizeof(word)) {
+		memcpy(word, lex->buf + stt, lex->pos - stt);
+	    }
+	    TokenType type = keyw_typeof(word);
+
+	    if (subject > 0) {
+		if (--subject == 0 && type == TIn) {
+		    cases++;
+		    pattern = true;
+		}
+		type = TWord;
+	    } else if (type == TEsac && cases > 0 && (head || pattern)) {
+		cases--;
+		pattern = false;
+	    } else if (type == TCase && head) {
+		subject = 2;
+	    }
+
+	    head = type == TIf || type == TThen || type == TElse
+		|| type == TElif || type == TDo || type == TWhile
+		|| type == TUntil || type == TLBrace || type == TBang
+		|| type == TTime;
 	}
     }
 }
@@ -330,6 +731,13 @@ static Token *lex_number(void)
 
 	default:
 
+	    // A number followed by any other character of a word, as in '2x'
+	    // or '1"a"', is just the start of that word. strchr() also finds
+	    // the '\0' that ends the buf.
+	    if (!strchr(" \t\v\f\r\n;&|<>()", peek())) {
+		return lex_word();
+	    }
+
 	    Token * tok = emit(TWord);
 
 	    // At this point Lex->stt and Lex->pos are pointing at the start and
@@ -343,14 +751,12 @@ static Token *lex_number(void)
 	    // But we still don't know what type of tokin it is. It could be TWord or
 	    // TIONumber. Consequently, we don't return inmediatly the token; the analysis
 	    // continues.
-	    // Consume all spaces.
-	    lex_space();
-
 	    char c = peek();
 
-	    // If the next character in buf is  a '<' or '>', the next token
-	    // could be: "<", ">", "<<", ">>", "<&", ">&", "<>", "<<-", or ">|".
-	    // Hence, the current token is a TIONumber.
+	    // If the character right after the number is a '<' or '>', the next
+	    // token could be: "<", ">", "<<", ">>", "<&", ">&", "<>", "<<-", or
+	    // ">|". Hence, the current token is a TIONumber. A number followed
+	    // by a space is a TWord, as in "2>&1 >file".
 	    if (c == '<' || c == '>') {
 		tok->type = TIONumber;
 	    }
@@ -445,7 +851,9 @@ static void lex_comment(void)
 	    break;
 
 	    // The newline that ends the line is not considered part of the comment.
+	    // A comment may also end the buf without any newline.
 	case '\n':
+	case '\0':
 	    ignore();
 	    return;
 	}
@@ -46,8 +46,14 @@ typedef enum {
     TLBrace,			// {
     TRBrace,			// }
     TBang,			// !
+    TTime,			// time
 
     TIn,			// in
+
+    TLParen,			// (
+    TRParen,			// )
+
+    TError,			// Word with a quote or substitution left open
 } TokenType;
 
 // Lex holds the state of the lexer.
@@ -110,5 +116,7 @@ typedef struct __sToken {
 Lex *lex_make(void);
 void lex_readfrom(const char *);
 Token *lex_next(void);
+Token *lex_tokens(const char *, size_t *);
+const char *lex_subst_end(const char *);
 
 #endif
@@ -0,0 +1,272 @@
+//
+// main.c - xsh entry point
+//
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "lex.h"
+#include "parse.h"
+#include "exec.h"
+#include "vm.h"
+#include "cache.h"
+#include "var.h"
+#include "jobs.h"
+#include "stats.h"
+#include "repl.h"
+#include "check.h"
+#include "expand.h"
+#include "str.h"
+
+int main(int, char **);
+static bool aliasing(Node *);
+static void usage(void);
+
+// ---------------------------------------------------------------------------
+
+// main runs the program given with -c, read from the file operand, or read
+// from the standard input, in this order of preference. With -B the program
+// is compiled to bytecode before it runs.
+//
+// The words after the command_string or the file are the positional
+// parameters. With -c, the first of them is $0 rather than $1.
+//
+// The program is parsed and run one complete command at a time, so that
+// the aliases a command defines apply to the commands after it, and a
+// syntax error stops it only once the commands before the error ran.
+//
+// Commands read from the standard input are read and run one at a time
+// when the shell is interactive: with -i, or when the standard input and
+// the standard error are terminals. They are kept in the history file
+// named by HISTFILE, ~/.xsh_history by default. The file named by ENV is
+// run first.
+//
+// When XSH_CACHE names a directory, the tree of a script file is saved
+// there the first time it runs, and loaded from there afterwards instead
+// of being parsed. Such a script is parsed whole before it runs, unless
+// it may define aliases, and then it is neither cached nor loaded.
+//
+// With -j, or XSH_JOBS if it is not given, at most jobs background jobs
+// run at once; the script waits at any '&' beyond. Zero stands for the
+// number of CPUs.
+//
+// When XSH_STATS names a file, what every command used is recorded there;
+// -S prints the records of such a file instead of running anything.
+//
+// With -n, the program is parsed but not run, and all its syntax errors
+// reported. The operands are then files and directories, all of whose
+// scripts are checked, jobs at a time.
+//
+//   xsh [-Bi] [-j jobs] [-c command_string [name [arg...]] | file [arg...]]
+//   xsh -n [-j jobs] [-c command_string | file...]
+//   xsh -S stats_file
+int main(int argc, char **argv)
+{
+    char *input = NULL;
+    size_t len = 0;
+    Str buf;
+    bool bytecode = false;
+    bool interactive = false;
+    bool check = false;
+    const char *cache = NULL;
+    const char *jobs = getenv("XSH_JOBS");
+    const char *stats = getenv("XSH_STATS");
+    int opt;
+
+    while ((opt = getopt(argc, argv, "+BS:c:ij:n")) != -1) {
+	switch (opt) {
+
+	case 'B':
+	    bytecode = true;
+	    break;
+
+	case 'S':
+	    return stats_dump(optarg);
+
+	case 'c':
+	    input = optarg;
+	    break;
+
+	case 'i':
+	    interactive = true;
+	    break;
+
+	case 'j':
+	    jobs = optarg;
+	    break;
+
+	case 'n':
+	    check = true;
+	    break;
+
+	default:
+	    usage();
+	}
+    }
+
+    bool command = input != NULL;
+    if (check && !command && optind < argc) {
+	return check_run(argv + optind, argc - optind,
+			 jobs && *jobs ? atoi(jobs) : 0);
+    }
+
+    if (stats && *stats) {
+	stats_open(stats);
+    }
+
+    if (jobs && *jobs) {
+	int n = atoi(jobs);
+	jobs_limit(n > 0 ? n : sysconf(_SC_NPROCESSORS_ONLN));
+    }
+
+    if (input) {
+	if (optind < argc) {
+	    var_init(argc - optind, argv + optind);
+	} else {
+	    var_init(1, argv);
+	}
+    } else if (optind < argc) {
+	var_init(argc - optind, argv + optind);
+
+	int fd = open(argv[optind], O_RDONLY);
+	if (fd < 0) {
+	    perror(argv[optind]);
+	    return 127;
+	}
+
+	str_init(&buf);
+	if (!str_read(&buf, fd)) {
+	    perror("read");
+	    return 2;
+	}
+
+	close(fd);
+	input = str_cstr(&buf);
+	len = buf.len;
+
+	cache = getenv("XSH_CACHE");
+	if (cache && !*cache) {
+	    cache = NULL;
+	}
+    } else {
+	argv[optind - 1] = argv[0];
+	var_init(argc - optind + 1, argv + optind - 1);
+
+	if (!check && (interactive || (isatty(0) && isatty(2)))) {
+	    return repl_run(bytecode);
+	}
+
+	str_init(&buf);
+	if (!str_read(&buf, 0)) {
+	    perror("read");
+	    return 2;
+	}
+
+	input = str_cstr(&buf);
+	len = buf.len;
+    }
+
+    Lex *lex = lex_make();
+    Parser *parser = parser_make(lex);
+    lex_readfrom(input);
+
+    // The errors are told as for the files of check_run(), the input being
+    // named "-c" or "-".
+    if (check) {
+	Str diag;
+	str_init(&diag);
+	parser->diag = &diag;
+	parser->name = command ? "-c" : "-";
+	parser_parse();
+	fwrite(diag.s, 1, diag.len, stderr);
+	return parser->nerr ? 2 : 0;
+    }
+
+    // A script to cache is parsed whole first, quietly. If it has syntax
+    // errors or may define aliases, it is run one command at a time as
+    // any other, which reports the errors as they are reached.
+    Node *prog = cache ? cache_load(cache, input, len) : NULL;
+    if (cache && !prog) {
+	Str diag;
+	str_init(&diag);
+	parser->diag = &diag;
+	prog = parser_parse();
+	parser->diag = NULL;
+	str_free(&diag);
+
+	if (parser->nerr || aliasing(prog)) {
+	    if (!parser->nerr) {
+		ast_free(prog);
+	    }
+	    prog = NULL;
+	    parser_make(lex);
+	    lex_readfrom(input);
+	} else if (prog) {
+	    cache_store(cache, input, len, prog);
+	}
+    }
+
+    if (prog) {
+	return bytecode ? vm_run(vm_compile(prog)) : exec_node(prog);
+    }
+
+    for (;;) {
+	Node *n = parser_next();
+	if (parser->nerr) {
+	    return 2;
+	}
+
+	if (!n) {
+	    return exec_status();
+	}
+
+	if (bytecode) {
+	    Code *code = vm_compile(n);
+	    vm_run(code);
+	    vm_free(code);
+	} else {
+	    exec_node(n);
+	}
+
+	ast_free(n);
+    }
+}
+
+// aliasing checks whether running the tree n may define aliases: whether
+// it has a simple command named alias or '.', or whose name is expanded.
+static bool aliasing(Node *n)
+{
+    for (; n; n = n->right) {
+	if (n->type == NSimple) {
+	    return n->argc && (!expand_literal(n->argv[0])
+			       || !strcmp(n->argv[0], "alias")
+			       || !strcmp(n->argv[0], "."));
+	}
+
+	if (aliasing(n->left) || aliasing(n->els)) {
+	    return true;
+	}
+
+	for (CaseItem *it = n->items; it; it = it->next) {
+	    if (aliasing(it->body)) {
+		return true;
+	    }
+	}
+    }
+
+    return false;
+}
+
+// usage prints how to invoke xsh and exits.
+static void usage(void)
+{
+    fprintf(stderr, "usage: xsh [-Bi] [-j jobs] [-c command_string "
+	    "[name [arg...]] | file [arg...]]\n"
+	    "       xsh -n [-j jobs] [-c command_string | file...]\n"
+	    "       xsh -S stats_file\n");
+    exit(2);
+}
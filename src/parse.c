@@ -5,65 +5,291 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
 
 #include "lex.h"
+#include "ast.h"
 #include "parse.h"
+#include "alias.h"
+#include "arena.h"
+#include "str.h"
 
 Parser *parser_make(Lex *);
-void parser_parse(void);
+Node *parser_parse(void);
+Node *parser_next(void);
+size_t parser_parse_text(const char *, Node **);
+Parser *parser_push(const char *, Input *);
+void parser_pop(Input *);
+static Token *parse_next_token(void);
+static void parse_alias(void);
+static void advance(void);
+static char *take(void);
 static bool accept(TokenType);
 static bool expect(TokenType);
-static void parse_program(void);
-static void parse_complete_command(void);
-static void parse_list(void);
-static void parse_list_prime(void);
+static bool expect_word(void);
+static bool expect_redirect(void);
+static bool expect_assignment(void);
+static bool expect_command(void);
+static bool expect_in(void);
+static void parse_error(const char *);
+static void parse_report(const char *);
+static Node *parse_program(void);
+static Node *parse_complete_commands(void);
+static void parse_complete_commands_prime(Node *);
+static Node *parse_complete_command(void);
+static Node *parse_list(void);
+static void parse_list_prime(Node *);
+static Node *parse_and_or(void);
+static Node *parse_and_or_prime(Node *);
 static void parse_separator_op(void);
-static void parse_pipeline(void);
-static void parse_pipe_sequence(void);
-static void parse_pipe_sequence_prime(void);
-static void parse_command(void);
-static void parse_simple_command(void);
-static void parse_cmd_name(void);
-static void parse_cmd_suffix(void);
-static void parse_cmd_suffix_prime(void);
-static void parse_io_redirect(void);
-static void parse_io_file(void);
-static void parse_filename(void);
-static void parse_io_here(void);
+static void parse_separator(void);
+static void parse_sequential_sep(void);
+static Node *parse_pipeline(void);
+static Node *parse_pipe_sequence(void);
+static void parse_pipe_sequence_prime(Node *);
+static Node *parse_command(void);
+static Node *parse_compound_list(void);
+static void parse_term_prime(Node *);
+static Node *parse_subshell(void);
+static Node *parse_brace_group(void);
+static Node *parse_if_clause(void);
+static Node *parse_else_part(void);
+static Node *parse_while_clause(void);
+static Node *parse_for_clause(void);
+static Node *parse_case_clause(void);
+static void parse_case_item(Node *);
+static Node *parse_do_group(void);
+static Node *parse_simple_command(void);
+static void parse_cmd_prefix(Node *);
+static void parse_cmd_name(Node *);
+static void parse_cmd_suffix(Node *);
+static void parse_cmd_suffix_prime(Node *);
+static void parse_redirect_list(Node *);
+static void parse_io_redirect(Node *);
+static void parse_io_file(Redir *);
+static void parse_filename(Redir *);
+static void parse_io_here(Redir *);
 static void parse_newline_list(void);
 static void parse_newline_list_prime(void);
 static void parse_linebreak(void);
 
 // ---------------------------------------------------------------------------
 
-static Parser *parser;
+static _Thread_local Parser state;
+static _Thread_local Parser *parser;
 
+// parser_make initializes and returns the Parser of the calling thread,
+// which is static storage rather than allocated.
 Parser *parser_make(Lex * lex)
 {
-    parser = malloc(sizeof(Parser));
+    parser = &state;
     parser->lex = lex;
+    parser->lah = NULL;
+    parser->nerr = 0;
+    parser->panic = false;
+    parser->diag = NULL;
+    parser->name = NULL;
+    parser->shared = false;
+    parser->blank = false;
+    parser->splices = NULL;
+    parser->nsplices = 0;
+    parser->capsplices = 0;
     return parser;
 }
 
 // parser_parse checks if the textual input provided by the Lexer is
-// syntactically correct.
-void parser_parse(void)
+// syntactically correct and returns its abstract syntax tree. The tree is
+// NULL for an empty program. Parser->nerr counts the errors reported; the
+// tree must not be run when it is not zero.
+Node *parser_parse(void)
 {
+    parser->nerr = 0;
+    parser->panic = false;
     parser->lah = lex_next();
-    parse_program();
+    return parse_program();
 }
 
-static Token *parse_next_token()
+// parser_next parses the next complete_command of the input and returns
+// its tree, or NULL at the end of the input. Parser->nerr counts the
+// errors reported in it; the tree must not be run when it is not zero.
+// As nothing past the command is parsed yet, it may be run before the
+// next one is parsed, which then sees the aliases it defined.
+Node *parser_next(void)
 {
+    parser->nerr = 0;
+    parser->panic = false;
+    if (!parser->lah) {
+	parser->lah = lex_next();
+    }
+
+    parse_linebreak();
+    if (expect(TEOF)) {
+	return NULL;
+    }
+
+    if (!expect_command()) {
+	parse_error("program");
+	return NULL;
+    }
+
+    Node *n = parse_complete_command();
+    if (!expect(TNewLine) && !expect(TEOF)) {
+	parse_error("program");
+    }
+
+    return n;
+}
+
+// parser_parse_text parses text as a program of its own, as the command of
+// a command substitution, into *np, and returns the number of errors
+// found. The lexer and the parser are left as they were, so it may be
+// called while running a tree read from a cache, with no parser made yet.
+size_t parser_parse_text(const char *text, Node **np)
+{
+    Input in;
+    parser_push(text, &in);
+    *np = parser_parse();
+    size_t n = parser->nerr;
+    parser_pop(&in);
+    return n;
+}
+
+// parser_push sets what the parser and the lexer were reading aside in
+// *in, and makes them read text from its start, with parser_next() or
+// parser_parse(). It makes them first if there are none yet.
+Parser *parser_push(const char *text, Input *in)
+{
+    if (!parser) {
+	parser_make(lex_make());
+    }
+
+    in->lex = *parser->lex;
+    in->parser = *parser;
+
+    lex_readfrom(text);
+    parser->lah = NULL;
+    parser->nerr = 0;
+    parser->panic = false;
+    parser->shared = false;
+    parser->blank = false;
+    parser->splices = NULL;
+    parser->nsplices = 0;
+    parser->capsplices = 0;
+    return parser;
+}
+
+// parser_pop makes the parser and the lexer read again what parser_push()
+// set aside in in.
+void parser_pop(Input *in)
+{
+    if (parser->lah && !parser->shared) {
+	arena_free(parser->lah->text);
+	arena_free(parser->lah);
+    }
+
+    // The aliases still being read are done with.
+    while (parser->nsplices > 0) {
+	alias_done(parser->splices[--parser->nsplices].alias);
+    }
+    free(parser->splices);
+
+    *parser->lex = in->lex;
+    *parser = in->parser;
+}
+
+// parse_next_token returns the next token of the innermost alias being
+// read, or of the lexer once they are all read. The tokens of an alias are
+// shared by all its uses, and not to be freed. Parser->blank tells whether
+// the token follows those of an alias ending with a blank.
+static Token *parse_next_token(void)
+{
+    parser->blank = false;
+    while (parser->nsplices > 0) {
+	Splice *sp = &parser->splices[parser->nsplices - 1];
+	if (sp->next < sp->alias->ntoks) {
+	    parser->shared = true;
+	    return &sp->alias->toks[sp->next++];
+	}
+
+	parser->nsplices--;
+	parser->blank = parser->blank || sp->alias->blank;
+	alias_done(sp->alias);
+    }
+
+    parser->shared = false;
     return lex_next();
 }
 
+// parse_alias replaces Parser->lah, a word in command position, with the
+// tokens of the alias it names, if any, and so on with the first of them.
+// An alias is not replaced again within its own tokens, which ends the
+// replacements of an alias such as ls='ls -F', or of aliases naming each
+// other. If the value of an alias ends with a blank, the word after its
+// tokens may be an alias too.
+static void parse_alias(void)
+{
+    while (parser->lah->type == TWord) {
+	Alias *a = alias_get(parser->lah->text);
+	if (!a || a->busy) {
+	    return;
+	}
+
+	if (parser->nsplices == parser->capsplices) {
+	    parser->capsplices = parser->capsplices ? parser->capsplices * 2 : 8;
+	    parser->splices = realloc(parser->splices, sizeof(Splice)
+				      * parser->capsplices);
+	}
+
+	a->busy = true;
+	parser->splices[parser->nsplices++] = (Splice) {a, 0};
+	advance();
+    }
+}
+
+// advance discards Parser->lah and reads the next token. The lexer is never
+// asked for more tokens once it has returned TEOF.
+static void advance(void)
+{
+    Token *tok = parser->lah;
+    bool shared = parser->shared;
+    if (tok->type == TEOF) {
+	return;
+    }
+
+    // An error is over once a newline or a ';' is read.
+    if (tok->type == TNewLine || tok->type == TSemi) {
+	parser->panic = false;
+    }
+
+    parser->lah = parse_next_token();
+    if (!shared) {
+	arena_free(tok->text);
+	arena_free(tok);
+    }
+}
+
+// take returns the text of Parser->lah and advances it. The caller owns the
+// returned text.
+static char *take(void)
+{
+    char *text = parser->lah->text;
+    if (parser->shared) {
+	text = strdup(text);
+    } else {
+	parser->lah->text = NULL;
+    }
+
+    advance();
+    return text;
+}
+
 // accept checks whether the Parser->lah is the expected token type. If
-// so, it avances the token Parse->lah. 
+// so, it avances the token Parse->lah.
 static bool accept(TokenType type)
 {
     if (expect(type)) {
-	parser->lah = parse_next_token();
+	advance();
 	return true;
     }
 
@@ -76,50 +302,292 @@ static bool expect(TokenType type)
     return parser->lah->type == type;
 }
 
-// program               : complete_command linebreak
+// expect_word checks whether the Parser->lah can be used as a WORD. Reserved
+// words are only recognized in command position, so anywhere else they are
+// plain words.
+static bool expect_word(void)
+{
+    TokenType type = parser->lah->type;
+    return type == TWord || (type >= TIf && type <= TIn);
+}
+
+// expect_assignment checks whether the Parser->lah is an ASSIGNMENT_WORD:
+// a WORD made of a NAME, a '=' and a value, as in 'x=1'. It is only asked
+// in cmd_prefix, where rule 7b applies.
+static bool expect_assignment(void)
+{
+    const char *s = parser->lah->text;
+
+    if (parser->lah->type != TWord || (!isalpha((unsigned char) *s)
+				       && *s != '_')) {
+	return false;
+    }
+
+    while (isalnum((unsigned char) *s) || *s == '_') {
+	s++;
+    }
+
+    return *s == '=';
+}
+
+// expect_redirect checks whether the Parser->lah starts an io_redirect.
+static bool expect_redirect(void)
+{
+    switch (parser->lah->type) {
+
+    default:
+	return false;
+
+    case TIONumber:
+    case TLess:
+    case TLessAnd:
+    case TGreat:
+    case TGreatAnd:
+    case TDGreat:
+    case TLessGreat:
+    case TLobber:
+    case TDLess:
+    case TDLessDash:
+	return true;
+    }
+}
+
+// expect_command checks whether the Parser->lah starts a command. It is
+// used to tell a trailing separator from a separator between two commands.
+static bool expect_command(void)
+{
+    switch (parser->lah->type) {
+
+    default:
+	return expect_redirect();
+
+    case TWord:
+    case TBang:
+    case TTime:
+    case TIf:
+    case TWhile:
+    case TUntil:
+    case TFor:
+    case TCase:
+    case TLBrace:
+    case TLParen:
+	return true;
+    }
+}
+
+// expect_in checks whether the Parser->lah is the reserved word 'in'. An
+// 'in' after a linebreak is not seen by the lexer as a TIn.
+static bool expect_in(void)
+{
+    return expect(TIn) || (expect(TWord) && !strcmp(parser->lah->text, "in"));
+}
+
+// parse_error reports a syntax error found by the rule at Parser->lah, and
+// skips the tokens up to the next newline or ';', from where the rule goes
+// on as if nothing was missing. Until one of them is read, the errors that
+// follow from the first are not reported.
+static void parse_error(const char *rule)
+{
+    if (!parser->panic) {
+	parser->nerr++;
+	parse_report(rule);
+    }
+
+    parser->panic = true;
+    while (!expect(TNewLine) && !expect(TSemi) && !expect(TEOF)) {
+	advance();
+    }
+}
+
+// parse_report writes the error found by the rule at Parser->lah to
+// Parser->diag, with the line and the column it is at in the input called
+// Parser->name, or else to the standard error.
+static void parse_report(const char *rule)
+{
+    Token *tok = parser->lah;
+    if (!parser->diag) {
+	fprintf(stderr, "%s: error at col=%ld, got='%s'\n",
+		rule, tok->col, tok->text);
+	return;
+    }
+
+    // The tokens of an alias are at no place in the input.
+    size_t line = 1;
+    size_t col = 0;
+    if (!parser->shared) {
+	const char *buf = parser->lex->buf;
+	for (size_t i = 0; i + 1 < tok->col && buf[i]; i++) {
+	    col = buf[i] == '\n' ? 0 : col + 1;
+	    line += buf[i] == '\n';
+	}
+    }
+
+    char head[64];
+    snprintf(head, sizeof(head), ":%zu:%zu: ", line, col + 1);
+    str_puts(parser->diag, parser->name ? parser->name : "xsh");
+    str_puts(parser->diag, head);
+    str_puts(parser->diag, rule);
+
+    switch (tok->type) {
+
+    case TEOF:
+	str_puts(parser->diag, ": unexpected end of file\n");
+	break;
+
+    case TNewLine:
+	str_puts(parser->diag, ": unexpected newline\n");
+	break;
+
+    case TError:
+	str_puts(parser->diag, ": unterminated quote or substitution\n");
+	break;
+
+    default:
+	str_puts(parser->diag, ": unexpected '");
+	str_puts(parser->diag, tok->text);
+	str_puts(parser->diag, "'\n");
+    }
+}
+
+// program               : linebreak complete_commands linebreak
 //                       | linebreak
 //                       ;
-static void parse_program(void)
+//
+// After an error, the program goes on with the complete_commands after the
+// next newline or ';', so that a single parse reports all the errors found
+// in them. The tree is then only made of the first ones, but it is not to
+// be run anyway. A word ending a compound command met there after an error
+// most likely ends the one that error cut short, and is not reported.
+static Node *parse_program(void)
 {
-    if (expect(TNewLine)) {
-	parse_linebreak();
+    parse_linebreak();
+
+    if (expect(TEOF)) {
+	return NULL;
     }
 
-    parse_complete_command();
+    Node *n = parse_complete_commands();
     parse_linebreak();
+
+    while (!expect(TEOF)) {
+	if (parser->nerr && (expect(TFi) || expect(TDone) || expect(TEsac)
+			     || expect(TRBrace) || expect(TRParen))) {
+	    parser->panic = true;
+	}
+
+	parse_error("program");
+	accept(TSemi);
+	parse_linebreak();
+
+	if (!expect(TEOF)) {
+	    parse_complete_commands();
+	    parse_linebreak();
+	}
+    }
+
+    return n;
+}
+
+
+// complete_commands     : complete_command complete_commands_prime
+//                       ;
+static Node *parse_complete_commands(void)
+{
+    Node *n = parse_complete_command();
+    parse_complete_commands_prime(n);
+    return n;
+}
+
+// complete_commands_prime : newline_list complete_command
+//                           complete_commands_prime
+//                       | /* eps */
+//                       ;
+//
+// The complete commands are chained into a single list, so prev is the
+// last complete_command parsed. They are parsed in a loop rather than by
+// recursion, which would take a stack frame for every line of a script.
+static void parse_complete_commands_prime(Node *prev)
+{
+    while (expect(TNewLine)) {
+	parse_newline_list();
+
+	if (!expect_command()) {
+	    return;
+	}
+
+	while (prev->right) {
+	    prev = prev->right;
+	}
+
+	prev->right = parse_complete_command();
+	prev = prev->right;
+    }
 }
 
 // complete_command      : list separator_op
 //                       | list
 //                       ;
-static void parse_complete_command(void)
+static Node *parse_complete_command(void)
 {
-    parse_list();
+    return parse_list();
+}
 
-    if (expect(TAnd) || expect(TOr)) {
+// list                  : and_or list_prime
+//                       ;
+static Node *parse_list(void)
+{
+    Node *n = ast_make(NList);
+    n->left = parse_and_or();
+    parse_list_prime(n);
+    return n;
+}
+
+// list_prime            : separator_op and_or list_prime
+//                       | /* eps */
+//                       ;
+//
+// A separator_op that is not followed by a command is the one ending a
+// complete_command.
+static void parse_list_prime(Node *n)
+{
+    while (expect(TAnd) || expect(TSemi)) {
+	n->bg = expect(TAnd);
 	parse_separator_op();
+
+	if (!expect_command()) {
+	    return;
+	}
+
+	n->right = ast_make(NList);
+	n = n->right;
+	n->left = parse_and_or();
     }
 }
 
-// list                  : pipeline list_prime
+// and_or                : pipeline and_or_prime
 //                       ;
-static void parse_list(void)
+static Node *parse_and_or(void)
 {
-    parse_pipeline();
-    parse_list_prime();
+    Node *n = parse_pipeline();
+    return parse_and_or_prime(n);
 }
 
-// list_prime            : separator_op pipeline list_prime
+// and_or_prime          : AND_IF linebreak pipeline and_or_prime
+//                       | OR_IF  linebreak pipeline and_or_prime
 //                       | /* eps */
 //                       ;
-static void parse_list_prime(void)
+static Node *parse_and_or_prime(Node *left)
 {
-    if (expect(TAnd) || expect(TOr)) {
-	parse_separator_op();
-	parse_pipeline();
-	parse_list_prime();
-	return;
+    while (expect(TAndIf) || expect(TOrIf)) {
+	Node *n = ast_make(expect(TAndIf) ? NAnd : NOr);
+	advance();
+	parse_linebreak();
+	n->left = left;
+	n->right = parse_pipeline();
+	left = n;
     }
+
+    return left;
 }
 
 // separator_op          : AND
@@ -127,157 +595,539 @@ static void parse_list_prime(void)
 //                       ;
 static void parse_separator_op(void)
 {
-    if (accept(TAnd) || accept(TOr)) {
+    if (accept(TAnd) || accept(TSemi)) {
 	return;
     }
 
-    fprintf(stderr, "newline_list: error at col=%ld, got='%s'\n",
-	    parser->lah->col, parser->lah->text);
+    parse_error("separator_op");
+}
+
+// separator             : separator_op linebreak
+//                       | newline_list
+//                       ;
+static void parse_separator(void)
+{
+    if (expect(TNewLine)) {
+	parse_newline_list();
+	return;
+    }
+
+    parse_separator_op();
+    parse_linebreak();
+}
+
+// sequential_sep        : SEMI linebreak
+//                       | newline_list
+//                       ;
+static void parse_sequential_sep(void)
+{
+    if (accept(TSemi)) {
+	parse_linebreak();
+	return;
+    }
+
+    if (expect(TNewLine)) {
+	parse_newline_list();
+	return;
+    }
+
+    parse_error("sequential_sep");
 }
 
 // pipeline              :      pipe_sequence
 //                       | Bang pipe_sequence
+//                       | Time pipeline
+//                       | Time
 //                       ;
-static void parse_pipeline(void)
+//
+// A 'time' alone times nothing, as in other shells.
+static Node *parse_pipeline(void)
 {
-    if (accept(TBang));
+    parse_alias();
+
+    if (accept(TTime)) {
+	Node *n = ast_make(NTime);
+	if (expect_command()) {
+	    n->left = parse_pipeline();
+	}
+	return n;
+    }
+
+    if (accept(TBang)) {
+	Node *n = ast_make(NNot);
+	n->left = parse_pipe_sequence();
+	return n;
+    }
 
-    parse_pipe_sequence();
+    return parse_pipe_sequence();
 }
 
 // pipe_sequence         : command pipe_sequence_prime
 //                       ;
-static void parse_pipe_sequence(void)
+//
+// A pipe_sequence of a single command is the command itself.
+static Node *parse_pipe_sequence(void)
 {
-    parse_command();
-    parse_pipe_sequence_prime();
+    Node *cmd = parse_command();
+
+    if (!expect(TOr)) {
+	return cmd;
+    }
+
+    Node *n = ast_make(NPipe);
+    n->left = cmd;
+    parse_pipe_sequence_prime(n);
+    return n;
 }
 
 // pipe_sequence_prime   : OR linebreak command pipe_sequence_prime
 //                       | /* eps */
 //                       ;
-static void parse_pipe_sequence_prime(void)
+static void parse_pipe_sequence_prime(Node *n)
 {
-    if (accept(TOr)) {
+    while (accept(TOr)) {
 	parse_linebreak();
-	parse_command();
-	parse_pipe_sequence_prime();
-	return;
+	n->right = ast_make(NPipe);
+	n = n->right;
+	n->left = parse_command();
     }
 }
 
 // command               : simple_command
+//                       | compound_command
+//                       | compound_command redirect_list
+//                       ;
+// compound_command      : brace_group
+//                       | subshell
+//                       | for_clause
+//                       | case_clause
+//                       | if_clause
+//                       | while_clause
+//                       | until_clause
 //                       ;
-static void parse_command(void)
+static Node *parse_command(void)
 {
-    parse_simple_command();
+    Node *n;
+
+    parse_alias();
+
+    switch (parser->lah->type) {
+
+    default:
+	return parse_simple_command();
+
+    case TLBrace:
+	n = parse_brace_group();
+	break;
+
+    case TLParen:
+	n = parse_subshell();
+	break;
+
+    case TFor:
+	n = parse_for_clause();
+	break;
+
+    case TCase:
+	n = parse_case_clause();
+	break;
+
+    case TIf:
+	n = parse_if_clause();
+	break;
+
+    case TWhile:
+    case TUntil:
+	n = parse_while_clause();
+	break;
+    }
+
+    parse_redirect_list(n);
+    return n;
 }
 
-// simple_command        | cmd_name cmd_suffix
-//                       | cmd_name
+// compound_list         : linebreak term
+//                       | linebreak term separator
 //                       ;
-static void parse_simple_command(void)
+// term                  : and_or term_prime
+//                       ;
+static Node *parse_compound_list(void)
 {
-    if (expect(TWord)) {
-	parse_cmd_name();
-
-	switch (parser->lah->type) {
-
-	default:
-	    break;
-
-	case TIONumber:
-	case TLess:
-	case TLessAnd:
-	case TGreat:
-	case TGreatAnd:
-	case TDGreat:
-	case TLessGreat:
-	case TLobber:
-	case TDLess:
-	case TDLessDash:
-	    parse_cmd_suffix();
+    parse_linebreak();
+
+    Node *n = ast_make(NList);
+    n->left = parse_and_or();
+    parse_term_prime(n);
+    return n;
+}
+
+// term_prime            : separator and_or term_prime
+//                       | /* eps */
+//                       ;
+//
+// A separator that is not followed by a command is the one ending the
+// compound_list, right before a reserved word such as Done or Fi.
+static void parse_term_prime(Node *n)
+{
+    while (expect(TAnd) || expect(TSemi) || expect(TNewLine)) {
+	n->bg = expect(TAnd);
+	parse_separator();
+
+	if (!expect_command()) {
+	    return;
 	}
 
-	return;
+	n->right = ast_make(NList);
+	n = n->right;
+	n->left = parse_and_or();
     }
-    fprintf(stderr, "simple_command: error at col=%ld, got='%s'\n",
-	    parser->lah->col, parser->lah->text);
 }
 
-// cmd_suffix            : io_redirect cmd_suffix_prime
-//                       | WORD        cmd_suffix_prime
+// subshell              : '(' compound_list ')'
 //                       ;
-static void parse_cmd_suffix(void)
+static Node *parse_subshell(void)
 {
-    parse_io_redirect();
-    parse_cmd_suffix_prime();
+    Node *n = ast_make(NSubshell);
+    accept(TLParen);
+    n->left = parse_compound_list();
+
+    if (!accept(TRParen)) {
+	parse_error("subshell");
+    }
+
+    return n;
 }
 
-// cmd_suffix_prime      : io_redirect cmd_suffix_prime
-//                       | WORD        cmd_suffix_prime
+// brace_group           : Lbrace compound_list Rbrace
+//                       ;
+static Node *parse_brace_group(void)
+{
+    Node *n = ast_make(NBrace);
+    accept(TLBrace);
+    n->left = parse_compound_list();
+
+    if (!accept(TRBrace)) {
+	parse_error("brace_group");
+    }
+
+    return n;
+}
+
+// if_clause             : If compound_list Then compound_list else_part Fi
+//                       | If compound_list Then compound_list           Fi
+//                       ;
+static Node *parse_if_clause(void)
+{
+    Node *n = ast_make(NIf);
+    accept(TIf);
+    n->left = parse_compound_list();
+
+    if (!accept(TThen)) {
+	parse_error("if_clause");
+	return n;
+    }
+
+    n->right = parse_compound_list();
+    n->els = parse_else_part();
+
+    if (!accept(TFi)) {
+	parse_error("if_clause");
+    }
+
+    return n;
+}
+
+// else_part             : Elif compound_list Then compound_list
+//                       | Elif compound_list Then compound_list else_part
+//                       | Else compound_list
 //                       | /* eps */
 //                       ;
-static void parse_cmd_suffix_prime()
+static Node *parse_else_part(void)
 {
+    if (accept(TElif)) {
+	Node *n = ast_make(NIf);
+	n->left = parse_compound_list();
 
-    switch (parser->lah->type) {
+	if (!accept(TThen)) {
+	    parse_error("else_part");
+	    return n;
+	}
 
-    default:
-	break;
+	n->right = parse_compound_list();
+	n->els = parse_else_part();
+	return n;
+    }
 
-    case TIONumber:
-    case TLess:
-    case TLessAnd:
-    case TGreat:
-    case TGreatAnd:
-    case TDGreat:
-    case TLessGreat:
-    case TLobber:
-    case TDLess:
-    case TDLessDash:
-	parse_io_redirect();
-	parse_cmd_suffix_prime();
+    if (accept(TElse)) {
+	return parse_compound_list();
+    }
+
+    return NULL;
+}
+
+// while_clause          : While compound_list do_group
+//                       ;
+// until_clause          : Until compound_list do_group
+//                       ;
+static Node *parse_while_clause(void)
+{
+    Node *n = ast_make(expect(TWhile) ? NWhile : NUntil);
+    advance();
+    n->left = parse_compound_list();
+    n->right = parse_do_group();
+    return n;
+}
+
+// for_clause            : For name                                 do_group
+//                       | For name                  sequential_sep do_group
+//                       | For name linebreak in          sequential_sep do_group
+//                       | For name linebreak in wordlist sequential_sep do_group
+//                       ;
+static Node *parse_for_clause(void)
+{
+    Node *n = ast_make(NFor);
+    accept(TFor);
+
+    if (!expect(TWord)) {
+	parse_error("for_clause");
+	return n;
+    }
+
+    n->name = take();
+    parse_linebreak();
+
+    if (expect_in()) {
+	advance();
+	n->in = true;
+
+	while (expect_word()) {
+	    ast_push_word(n, take());
+	}
+
+	parse_sequential_sep();
+    } else if (expect(TSemi)) {
+	parse_sequential_sep();
+    }
+
+    n->right = parse_do_group();
+    return n;
+}
+
+// case_clause           : Case WORD linebreak in linebreak case_list    Esac
+//                       | Case WORD linebreak in linebreak case_list_ns Esac
+//                       | Case WORD linebreak in linebreak              Esac
+//                       ;
+static Node *parse_case_clause(void)
+{
+    Node *n = ast_make(NCase);
+    accept(TCase);
+
+    if (!expect_word()) {
+	parse_error("case_clause");
+	return n;
+    }
+
+    n->name = take();
+    parse_linebreak();
+
+    if (!expect_in()) {
+	parse_error("case_clause");
+	return n;
+    }
+
+    advance();
+    parse_linebreak();
+
+    while (!expect(TEsac) && !expect(TEOF)) {
+	size_t nerr = parser->nerr;
+	parse_case_item(n);
+
+	if (parser->nerr != nerr) {
+	    return n;
+	}
+    }
+
+    if (!accept(TEsac)) {
+	parse_error("case_clause");
+    }
+
+    return n;
+}
+
+// case_item             : pattern ')' linebreak     DSEMI linebreak
+//                       | pattern ')' compound_list DSEMI linebreak
+//                       | '(' pattern ')' linebreak     DSEMI linebreak
+//                       | '(' pattern ')' compound_list DSEMI linebreak
+//                       ;
+// pattern               :             WORD
+//                       | pattern '|' WORD
+//                       ;
+//
+// The DSEMI of the last case_item may be omitted (case_item_ns).
+static void parse_case_item(Node *n)
+{
+    CaseItem *item = ast_push_item(n);
+    accept(TLParen);
+
+    do {
+	if (!expect_word()) {
+	    parse_error("pattern");
+	    return;
+	}
+
+	ast_push_pattern(item, take());
+    } while (accept(TOr));
+
+    if (!accept(TRParen)) {
+	parse_error("case_item");
 	return;
     }
 
-    if (accept(TWord)) {
-	parse_cmd_suffix_prime();
+    parse_linebreak();
+
+    if (!expect(TDSemi) && !expect(TEsac)) {
+	item->body = parse_compound_list();
+    }
+
+    if (accept(TDSemi)) {
+	parse_linebreak();
 	return;
     }
+
+    if (!expect(TEsac)) {
+	parse_error("case_item");
+    }
 }
 
-// io_redirect           :           io_file
-//                       | IO_NUMBER io_file
-//                       |           io_here
-//                       | IO_NUMBER io_here
+// do_group              : Do compound_list Done
+//                       ;
+static Node *parse_do_group(void)
+{
+    if (!accept(TDo)) {
+	parse_error("do_group");
+	return NULL;
+    }
+
+    Node *n = parse_compound_list();
+
+    if (!accept(TDone)) {
+	parse_error("do_group");
+    }
+
+    return n;
+}
+
+// simple_command        : cmd_prefix cmd_word cmd_suffix
+//                       | cmd_prefix cmd_word
+//                       | cmd_prefix
+//                       | cmd_name cmd_suffix
+//                       | cmd_name
 //                       ;
-static void parse_io_redirect()
+static Node *parse_simple_command(void)
 {
-    if (accept(TIONumber)) {
-	switch (parser->lah->type) {
+    Node *n = ast_make(NSimple);
+    parse_cmd_prefix(n);
 
-	default:
-	    break;
+    if (n->redir || n->nassigns) {
+	parse_alias();
+    }
 
-	case TLess:
-	case TLessAnd:
-	case TGreat:
-	case TGreatAnd:
-	case TDGreat:
-	case TLessGreat:
-	case TLobber:
-	    parse_io_file();
+    if (expect(TWord)) {
+	parse_cmd_name(n);
+	parse_cmd_suffix(n);
+	return n;
+    }
+
+    if (!n->redir && !n->nassigns) {
+	parse_error("simple_command");
+    }
+
+    return n;
+}
+
+// cmd_prefix            : io_redirect     cmd_prefix_prime
+//                       | ASSIGNMENT_WORD cmd_prefix_prime
+//                       ;
+// cmd_prefix_prime      : io_redirect     cmd_prefix_prime
+//                       | ASSIGNMENT_WORD cmd_prefix_prime
+//                       | /* eps */
+//                       ;
+static void parse_cmd_prefix(Node *n)
+{
+    for (;;) {
+	if (expect_redirect()) {
+	    parse_io_redirect(n);
+	} else if (expect_assignment()) {
+	    ast_push_assign(n, take());
+	} else {
 	    return;
 	}
+    }
+}
+
+// cmd_name              : WORD
+//                       ;
+static void parse_cmd_name(Node *n)
+{
+    if (!expect(TWord)) {
+	parse_error("cmd_name");
+	return;
+    }
+
+    ast_push_word(n, take());
+}
+
+// cmd_suffix            : io_redirect cmd_suffix_prime
+//                       | WORD        cmd_suffix_prime
+//                       ;
+static void parse_cmd_suffix(Node *n)
+{
+    parse_cmd_suffix_prime(n);
+}
+
+// cmd_suffix_prime      : io_redirect cmd_suffix_prime
+//                       | WORD        cmd_suffix_prime
+//                       | /* eps */
+//                       ;
+static void parse_cmd_suffix_prime(Node *n)
+{
+    for (;;) {
+	if (parser->blank) {
+	    parse_alias();
+	}
 
-	if (expect(TDLess) || expect(TDLessDash)) {
-	    parse_io_here();
+	if (expect_redirect()) {
+	    parse_io_redirect(n);
+	} else if (expect_word()) {
+	    ast_push_word(n, take());
+	} else {
 	    return;
 	}
+    }
+}
 
-	fprintf(stderr, "io_redirect: error\n");
-	return;
+// redirect_list         : io_redirect
+//                       | redirect_list io_redirect
+//                       ;
+static void parse_redirect_list(Node *n)
+{
+    while (expect_redirect()) {
+	parse_io_redirect(n);
+    }
+}
+
+// io_redirect           :           io_file
+//                       | IO_NUMBER io_file
+//                       |           io_here
+//                       | IO_NUMBER io_here
+//                       ;
+static void parse_io_redirect(Node *n)
+{
+    Redir *r = ast_push_redir(n);
+
+    if (expect(TIONumber)) {
+	r->fd = atoi(parser->lah->text);
+	advance();
     }
 
     switch (parser->lah->type) {
@@ -292,17 +1142,16 @@ static void parse_io_redirect()
     case TDGreat:
     case TLessGreat:
     case TLobber:
-	parse_io_file();
+	parse_io_file(r);
 	return;
     }
 
     if (expect(TDLess) || expect(TDLessDash)) {
-	parse_io_here();
+	parse_io_here(r);
 	return;
     }
 
-    fprintf(stderr, "io_redirect: error at col=%ld, got='%s'\n",
-	    parser->lah->col, parser->lah->text);
+    parse_error("io_redirect");
 }
 
 // io_file               : LESS      filename
@@ -313,13 +1162,12 @@ static void parse_io_redirect()
 //                       | LESSGREAT filename
 //                       | CLOBBER   filename
 //                       ;
-static void parse_io_file(void)
+static void parse_io_file(Redir *r)
 {
     switch (parser->lah->type) {
 
     default:
-	fprintf(stderr, "io_file: error at col=%ld, got='%s'\n",
-		parser->lah->col, parser->lah->text);
+	parse_error("io_file");
 	return;
 
     case TLess:
@@ -329,42 +1177,45 @@ static void parse_io_file(void)
     case TDGreat:
     case TLessGreat:
     case TLobber:
-	parse_filename();
+	r->type = parser->lah->type;
+	advance();
+	parse_filename(r);
 	return;
     }
 }
 
 // filename              : WORD
 //                       ;
-static void parse_filename(void)
+static void parse_filename(Redir *r)
 {
-    if (!accept(TWord)) {
-	fprintf(stderr, "filename: error at col=%ld, got='%s'\n",
-		parser->lah->col, parser->lah->text);
+    if (!expect_word()) {
+	parse_error("filename");
 	return;
     }
+
+    r->word = take();
 }
 
 // io_here               : DLESS     here_end
 //                       | DLESSDASH here_end
 //                       ;
-static void parse_io_here(void)
+// here_end              : WORD
+//                       ;
+static void parse_io_here(Redir *r)
 {
-    if (!accept(TDLess) || !accept(TDLessDash)) {
-	fprintf(stderr, "io_here: error at col=%ld, got='%s'\n",
-		parser->lah->col, parser->lah->text);
+    r->type = parser->lah->type;
+
+    if (!accept(TDLess) && !accept(TDLessDash)) {
+	parse_error("io_here");
+	return;
     }
-}
 
-// cmd_name              : WORD
-//                       ;
-static void parse_cmd_name(void)
-{
-    if (!accept(TWord)) {
-	fprintf(stderr, "newline_list: error at col=%ld, got='%s'\n",
-		parser->lah->col, parser->lah->text);
+    if (!expect_word()) {
+	parse_error("here_end");
 	return;
     }
+
+    r->word = take();
 }
 
 // newline_list          : NEWLINE newline_list_prime
@@ -376,8 +1227,7 @@ static void parse_newline_list(void)
 	return;
     }
 
-    fprintf(stderr, "newline_list: error at col=%ld, got='%s'\n",
-	    parser->lah->col, parser->lah->text);
+    parse_error("newline_list");
 }
 
 // newline_list_prime    : NEWLINE newline_list_prime
@@ -385,9 +1235,7 @@ static void parse_newline_list(void)
 //                       ;
 static void parse_newline_list_prime(void)
 {
-    if (accept(TNewLine)) {
-	parse_newline_list_prime();
-	return;
+    while (accept(TNewLine)) {
     }
 }
 
@@ -6,13 +6,44 @@
 #define PARSE_H
 
 #include "lex.h"
+#include "ast.h"
+#include "alias.h"
+#include "str.h"
+
+// Splice is an alias whose tokens are read in place of its name.
+typedef struct _sSplice {
+    Alias *alias;
+    size_t next;		// index of the next token to read
+} Splice;
 
 typedef struct _sParser {
     Lex *lex;
     Token *lah;			// lookahead token
+    size_t nerr;		// syntax errors of the last parse or command
+    bool panic;			// whether the tokens are skipped after an error
+
+    Str *diag;			// where errors go, the standard error if NULL
+    const char *name;		// name of the input in the errors in diag
+
+    bool shared;		// whether lah is a token of an alias
+    bool blank;			// whether lah may be an alias too
+    Splice *splices;		// aliases being read, innermost last
+    size_t nsplices;
+    size_t capsplices;
 } Parser;
 
+// Input is what the parser and its lexer were reading, set aside while
+// they read another input.
+typedef struct _sInput {
+    Lex lex;
+    Parser parser;
+} Input;
+
 Parser *parser_make(Lex *);
-void parser_parse(void);
+Node *parser_parse(void);
+Node *parser_next(void);
+size_t parser_parse_text(const char *, Node **);
+Parser *parser_push(const char *, Input *);
+void parser_pop(Input *);
 
 #endif
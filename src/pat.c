@@ -0,0 +1,522 @@
+//
+// pat.c - pattern matching automaton
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "pat.h"
+
+#define NSTATES 4096
+
+Pat *pat_compile(const char **, const int *, size_t);
+int pat_match(Pat *, const char *);
+bool pat_literal(const char *);
+void pat_free(Pat *);
+static void trie_add(Pat *, const char *, int);
+static int trie_next(Pat *, int, unsigned char);
+static void glob_add(Pat *, const char *, int);
+static size_t glob_bracket(const char *, uint64_t *);
+static void glob_push(Pat *, Elem *);
+static void classes(Pat *);
+static void dfa_reset(Pat *);
+static int dfa_add(Pat *, uint64_t *);
+static int dfa_step(Pat *, int, int);
+static void closure(Pat *, uint64_t *);
+static uint64_t hash(uint64_t *, int);
+
+// ---------------------------------------------------------------------------
+
+#define BIT(set, i)	((set)[(i) >> 6] >> ((i) & 63) & 1)
+#define SETBIT(set, i)	((set)[(i) >> 6] |= (uint64_t) 1 << ((i) & 63))
+
+// Class is a character class name allowed in a bracket expression, as in
+// '[[:alpha:]]'.
+typedef struct __sClass {
+    const char *name;
+    int (*fn)(int);
+} Class;
+
+static const Class ctypes[] = {
+    {"alnum", isalnum},
+    {"alpha", isalpha},
+    {"blank", isblank},
+    {"cntrl", iscntrl},
+    {"digit", isdigit},
+    {"graph", isgraph},
+    {"lower", islower},
+    {"print", isprint},
+    {"punct", ispunct},
+    {"space", isspace},
+    {"upper", isupper},
+    {"xdigit", isxdigit},
+};
+
+// pat_compile compiles the n patterns pats. A word matched by pats[i]
+// belongs to the arm arms[i]; arms are expected in increasing order of
+// preference, lowest first.
+Pat *pat_compile(const char **pats, const int *arms, size_t n)
+{
+    Pat *p = calloc(1, sizeof(Pat));
+    p->tarm = malloc(sizeof(int));
+    p->tarm[0] = -1;
+    p->ntnodes = 1;
+
+    for (size_t i = 0; i < n; i++) {
+	if (pat_literal(pats[i])) {
+	    trie_add(p, pats[i], arms[i]);
+	} else {
+	    glob_add(p, pats[i], arms[i]);
+	}
+    }
+
+    p->nwords = p->npos / 64 + 1;
+    classes(p);
+
+    p->captable = 2 * NSTATES;
+    p->table = malloc(sizeof(int) * p->captable);
+    dfa_reset(p);
+    return p;
+}
+
+// pat_match returns the lowest arm of the patterns matching word, or -1 if
+// no pattern matches. The trie and the DFA walk the word side by side, and
+// the walk stops as soon as both of them are stuck.
+int pat_match(Pat *p, const char *word)
+{
+    const unsigned char *s = (const unsigned char *) word;
+    int t = 0;
+    int d = p->init;
+
+    for (; *s; s++) {
+	if (t >= 0) {
+	    t = trie_next(p, t, *s);
+	}
+
+	if (d > 0) {
+	    int k = p->cls[*s];
+	    int to = p->next[d * p->ncls + k];
+	    d = to >= 0 ? to : dfa_step(p, d, k);
+	}
+
+	if (t < 0 && d == 0) {
+	    return -1;
+	}
+    }
+
+    int arm = t >= 0 ? p->tarm[t] : -1;
+    int other = p->accept[d];
+
+    if (arm < 0 || (other >= 0 && other < arm)) {
+	arm = other;
+    }
+
+    return arm;
+}
+
+// pat_literal checks whether pat matches only itself, once its backslashes
+// are removed.
+bool pat_literal(const char *pat)
+{
+    for (; *pat; pat++) {
+	switch (*pat) {
+
+	case '\\':
+	    if (pat[1]) {
+		pat++;
+	    }
+	    break;
+
+	case '*':
+	case '?':
+	case '[':
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+// pat_free frees p.
+void pat_free(Pat *p)
+{
+    free(p->edges);
+    free(p->tarm);
+    free(p->elems);
+    free(p->sets);
+    free(p->next);
+    free(p->accept);
+    free(p->table);
+    free(p);
+}
+
+// trie_add adds the literal pattern pat of the arm arm to the trie.
+static void trie_add(Pat *p, const char *pat, int arm)
+{
+    int t = 0;
+
+    for (; *pat; pat++) {
+	if (*pat == '\\' && pat[1]) {
+	    pat++;
+	}
+
+	int to = trie_next(p, t, *pat);
+	if (to >= 0) {
+	    t = to;
+	    continue;
+	}
+
+	// Keep the table of edges at most half full.
+	if (2 * (p->nedges + 1) > p->capedges) {
+	    Edge *old = p->edges;
+	    size_t oldcap = p->capedges;
+
+	    p->capedges = oldcap ? oldcap * 2 : 64;
+	    p->edges = malloc(sizeof(Edge) * p->capedges);
+	    for (size_t i = 0; i < p->capedges; i++) {
+		p->edges[i].key = -1;
+	    }
+
+	    for (size_t i = 0; i < oldcap; i++) {
+		if (old[i].key < 0) {
+		    continue;
+		}
+
+		size_t j = old[i].key * 0x9e3779b97f4a7c15ULL >> 40;
+		while (p->edges[j &= p->capedges - 1].key >= 0) {
+		    j++;
+		}
+		p->edges[j] = old[i];
+	    }
+
+	    free(old);
+	}
+
+	int64_t key = (int64_t) t << 8 | (unsigned char) *pat;
+	size_t j = key * 0x9e3779b97f4a7c15ULL >> 40;
+	while (p->edges[j &= p->capedges - 1].key >= 0) {
+	    j++;
+	}
+
+	p->tarm = realloc(p->tarm, sizeof(int) * (p->ntnodes + 1));
+	p->tarm[p->ntnodes] = -1;
+	p->edges[j].key = key;
+	p->edges[j].to = p->ntnodes;
+	p->nedges++;
+	t = p->ntnodes++;
+    }
+
+    if (p->tarm[t] < 0 || arm < p->tarm[t]) {
+	p->tarm[t] = arm;
+    }
+}
+
+// trie_next returns the child of the trie node t through the byte c, or -1
+// if there is none.
+static int trie_next(Pat *p, int t, unsigned char c)
+{
+    if (!p->nedges) {
+	return -1;
+    }
+
+    int64_t key = (int64_t) t << 8 | c;
+    size_t j = key * 0x9e3779b97f4a7c15ULL >> 40;
+
+    for (;; j++) {
+	Edge *e = &p->edges[j & (p->capedges - 1)];
+
+	if (e->key == key) {
+	    return e->to;
+	}
+
+	if (e->key < 0) {
+	    return -1;
+	}
+    }
+}
+
+// glob_add appends the positions of the pattern pat of the arm arm.
+static void glob_add(Pat *p, const char *pat, int arm)
+{
+    while (*pat) {
+	Elem e;
+	memset(&e, 0, sizeof(Elem));
+	size_t len;
+
+	if (*pat == '*') {
+	    // A run of '*' is the same as a single one.
+	    while (*pat == '*') {
+		pat++;
+	    }
+
+	    e.star = true;
+	    memset(e.set, 0xff, sizeof(e.set));
+	} else if (*pat == '?') {
+	    pat++;
+	    memset(e.set, 0xff, sizeof(e.set));
+	} else if (*pat == '[' && (len = glob_bracket(pat, e.set))) {
+	    pat += len;
+	} else {
+	    if (*pat == '\\' && pat[1]) {
+		pat++;
+	    }
+
+	    SETBIT(e.set, (unsigned char) *pat);
+	    pat++;
+	}
+
+	glob_push(p, &e);
+    }
+
+    Elem e;
+    memset(&e, 0, sizeof(Elem));
+    e.final = true;
+    e.arm = arm;
+    glob_push(p, &e);
+}
+
+// glob_bracket sets in set the bytes matched by the bracket expression at
+// the start of pat, and returns its length. It returns zero if the bracket
+// is not closed, in which case the '[' is an ordinary character.
+static size_t glob_bracket(const char *pat, uint64_t *set)
+{
+    uint64_t bits[4] = { 0, 0, 0, 0 };
+    const char *q = pat + 1;
+    bool neg = false;
+
+    if (*q == '!' || *q == '^') {
+	neg = true;
+	q++;
+    }
+
+    for (bool first = true; *q && (first || *q != ']'); first = false) {
+	if (q[0] == '[' && q[1] == ':') {
+	    const char *end = strstr(q + 2, ":]");
+	    size_t n = sizeof(ctypes) / sizeof(ctypes[0]);
+	    size_t i = 0;
+
+	    while (end && i < n && (strlen(ctypes[i].name) != (size_t) (end - q - 2)
+				    || strncmp(ctypes[i].name, q + 2, end - q - 2))) {
+		i++;
+	    }
+
+	    if (end && i < n) {
+		for (int c = 1; c < 256; c++) {
+		    if (ctypes[i].fn(c)) {
+			SETBIT(bits, c);
+		    }
+		}
+
+		q = end + 2;
+		continue;
+	    }
+	}
+
+	if (*q == '\\' && q[1]) {
+	    q++;
+	}
+
+	int lo = (unsigned char) *q++;
+	int hi = lo;
+
+	if (q[0] == '-' && q[1] && q[1] != ']') {
+	    q++;
+	    if (*q == '\\' && q[1]) {
+		q++;
+	    }
+
+	    hi = (unsigned char) *q++;
+	}
+
+	for (int c = lo; c <= hi; c++) {
+	    SETBIT(bits, c);
+	}
+    }
+
+    if (*q != ']') {
+	return 0;
+    }
+
+    for (int i = 0; i < 4; i++) {
+	set[i] = neg ? ~bits[i] : bits[i];
+    }
+
+    // No subject contains a NUL byte.
+    set[0] &= ~(uint64_t) 1;
+    return q + 1 - pat;
+}
+
+// glob_push appends the position e.
+static void glob_push(Pat *p, Elem *e)
+{
+    if ((p->npos & (p->npos - 1)) == 0) {
+	p->elems = realloc(p->elems, sizeof(Elem) * (p->npos ? p->npos * 2 : 1));
+    }
+
+    p->elems[p->npos++] = *e;
+}
+
+// classes splits the bytes into the classes of bytes that every position
+// matches either all or none of.
+static void classes(Pat *p)
+{
+    memset(p->cls, 0, sizeof(p->cls));
+    p->ncls = 1;
+
+    for (int j = 0; j < p->npos; j++) {
+	Elem *e = &p->elems[j];
+	if (e->star || e->final) {
+	    continue;
+	}
+
+	int remap[512];
+	int n = 0;
+	memset(remap, -1, sizeof(remap));
+
+	for (int c = 0; c < 256; c++) {
+	    int key = p->cls[c] * 2 + BIT(e->set, c);
+	    if (remap[key] < 0) {
+		remap[key] = n++;
+	    }
+	    p->cls[c] = remap[key];
+	}
+
+	p->ncls = n;
+    }
+
+    for (int c = 255; c >= 0; c--) {
+	p->rep[p->cls[c]] = c;
+    }
+}
+
+// dfa_reset drops every state of the DFA but the dead state and the start
+// state.
+static void dfa_reset(Pat *p)
+{
+    p->nstates = 0;
+    memset(p->table, 0, sizeof(int) * p->captable);
+
+    uint64_t set[p->nwords];
+    memset(set, 0, sizeof(set));
+    dfa_add(p, set);
+
+    // A pattern starts at the first position and after every final one.
+    for (int j = 0; j < p->npos; j++) {
+	if (j == 0 || p->elems[j - 1].final) {
+	    SETBIT(set, j);
+	}
+    }
+
+    closure(p, set);
+    p->init = dfa_add(p, set);
+}
+
+// dfa_add returns the state with the positions set, adding it if needed.
+// It returns -1 if the DFA is full.
+static int dfa_add(Pat *p, uint64_t *set)
+{
+    int j = hash(set, p->nwords) & (p->captable - 1);
+
+    for (; p->table[j]; j = (j + 1) & (p->captable - 1)) {
+	int d = p->table[j] - 1;
+	if (!memcmp(p->sets + d * p->nwords, set,
+		    sizeof(uint64_t) * p->nwords)) {
+	    return d;
+	}
+    }
+
+    if (p->nstates == NSTATES) {
+	return -1;
+    }
+
+    if (p->nstates == p->capstates) {
+	p->capstates = p->capstates ? p->capstates * 2 : 16;
+	p->sets = realloc(p->sets,
+			  sizeof(uint64_t) * p->nwords * p->capstates);
+	p->next = realloc(p->next, sizeof(int) * p->ncls * p->capstates);
+	p->accept = realloc(p->accept, sizeof(int) * p->capstates);
+    }
+
+    int d = p->nstates++;
+    memcpy(p->sets + d * p->nwords, set, sizeof(uint64_t) * p->nwords);
+    memset(p->next + d * p->ncls, -1, sizeof(int) * p->ncls);
+
+    p->accept[d] = -1;
+    for (int i = 0; i < p->npos; i++) {
+	Elem *e = &p->elems[i];
+	if (e->final && BIT(set, i)
+	    && (p->accept[d] < 0 || e->arm < p->accept[d])) {
+	    p->accept[d] = e->arm;
+	}
+    }
+
+    p->table[j] = d + 1;
+    return d;
+}
+
+// dfa_step returns the state reached from the state d through the bytes of
+// the class k, building it on first use. When the DFA is full it starts
+// over from the start state, so the memory used stays bounded.
+static int dfa_step(Pat *p, int d, int k)
+{
+    uint64_t set[p->nwords];
+    memset(set, 0, sizeof(set));
+
+    uint64_t *cur = p->sets + d * p->nwords;
+    int c = p->rep[k];
+
+    for (int w = 0; w < p->nwords; w++) {
+	for (uint64_t bits = cur[w]; bits; bits &= bits - 1) {
+	    int j = w * 64 + __builtin_ctzll(bits);
+	    Elem *e = &p->elems[j];
+
+	    if (e->final) {
+		continue;
+	    }
+
+	    if (e->star) {
+		SETBIT(set, j);
+	    } else if (BIT(e->set, c)) {
+		SETBIT(set, j + 1);
+	    }
+	}
+    }
+
+    closure(p, set);
+
+    int to = dfa_add(p, set);
+    if (to < 0) {
+	dfa_reset(p);
+	return dfa_add(p, set);
+    }
+
+    p->next[d * p->ncls + k] = to;
+    return to;
+}
+
+// closure adds to set the positions that follow a '*' in set, since a '*'
+// may match nothing.
+static void closure(Pat *p, uint64_t *set)
+{
+    for (int j = 0; j < p->npos; j++) {
+	if (p->elems[j].star && BIT(set, j)) {
+	    SETBIT(set, j + 1);
+	}
+    }
+}
+
+// hash returns a hash of the n words of set.
+static uint64_t hash(uint64_t *set, int n)
+{
+    uint64_t h = 0;
+
+    for (int i = 0; i < n; i++) {
+	h = (h ^ set[i]) * 0x9e3779b97f4a7c15ULL;
+	h ^= h >> 29;
+    }
+
+    return h;
+}
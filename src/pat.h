@@ -0,0 +1,73 @@
+//
+// pat.h - pattern matching automaton
+//
+
+#ifndef PAT_H
+#define PAT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Elem is a position in a pattern: the set of bytes matched there, or a
+// '*'. The position past the end of a pattern is final and tells the arm
+// of the pattern.
+typedef struct __sElem {
+    uint64_t set[4];
+    bool star;
+    bool final;
+    int arm;
+} Elem;
+
+// Edge is an entry of the open addressing table holding the edges of the
+// trie of literal patterns. An entry with a negative key is free.
+typedef struct __sEdge {
+    int64_t key;		// node << 8 | byte
+    int to;
+} Edge;
+
+// Pat matches a word against a list of patterns in a single pass over its
+// bytes, and tells the arm of the first pattern that matches. Patterns
+// without any '*', '?' or '[' go in a trie; the others are run together as
+// a DFA built lazily from their positions, one state at a time.
+typedef struct __sPat {
+
+    // The trie of literal patterns. Node 0 is the root; tarm holds the
+    // arm of the literal pattern ending at each node, or -1.
+    Edge *edges;
+    size_t nedges;
+    size_t capedges;
+    int *tarm;
+    int ntnodes;
+
+    // The positions of the other patterns.
+    Elem *elems;
+    int npos;
+    int nwords;			// number of words of a set of positions
+
+    // Bytes that no pattern tells apart share a class, so that a state
+    // only needs a transition for each class. rep holds a byte of each.
+    uint8_t cls[256];
+    uint8_t rep[256];
+    int ncls;
+
+    // The DFA states. State 0 is the dead state. For state d, sets holds
+    // its positions at d * nwords, next its transitions at d * ncls (-1
+    // until first taken), and accept the lowest arm it accepts, or -1.
+    uint64_t *sets;
+    int *next;
+    int *accept;
+    int nstates;
+    int capstates;
+    int *table;			// state + 1 by hash of positions, 0 if free
+    int captable;
+    int init;			// start state
+
+} Pat;
+
+Pat *pat_compile(const char **, const int *, size_t);
+int pat_match(Pat *, const char *);
+bool pat_literal(const char *);
+void pat_free(Pat *);
+
+#endif
@@ -0,0 +1,1078 @@
+//
+// repl.c - interactive input loop
+//
+// Commands typed at a terminal are read in raw mode, a whole chunk at a
+// time: whatever is available, a single keystroke as well as a paste,
+// comes in with one read and is echoed with one write. The bytes go
+// through a ring buffer that lasts as long as the shell, so that what is
+// typed ahead of a command, or an escape sequence cut short by a read, is
+// kept for the next line.
+//
+// Each line is scanned once, as it is entered, and the state of the scan
+// is carried over to the next line. A command is only handed to the
+// parser once it is complete: with no quote, compound command or
+// substitution left open, and no trailing '|', '&&', '||' or '\'.
+// Otherwise the next line is read after the PS2 prompt.
+//
+// The complete commands that parse are added to the history. Up and Down
+// recall the entries that start with the line as typed, and Ctrl-R
+// searches them for what is typed next, the most recent first. Tab
+// completes the name of a command.
+//
+// Before the first prompt, the commands of the file named by ENV are run,
+// as those of a script.
+//
+// With XSH_LATENCY set, the time from reading keystrokes to echoing them
+// and the time from reading an Enter to running the command are measured,
+// and summed up on the standard error when the shell exits.
+//
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "repl.h"
+#include "lex.h"
+#include "parse.h"
+#include "exec.h"
+#include "expand.h"
+#include "vm.h"
+#include "var.h"
+#include "str.h"
+#include "hist.h"
+#include "cmds.h"
+
+#define RINGSIZE 4096		// a power of two
+#define ESC 0x1b
+#define DEL 0x7f
+#define LISTMAX 100		// most command names listed by Tab
+#define FOUNDMIN 64		// entries recalled by Up at first
+#define KEY 0x100		// an escape sequence of no use
+#define UP 0x101
+#define DOWN 0x102
+
+typedef struct __sScan Scan;
+typedef struct __sSamples Samples;
+
+int repl_run(bool);
+static bool edit(Str *);
+static void enter(Str *, Str *);
+static void redraw(Str *, const char *);
+static void recall(Str *, bool);
+static void more(void);
+static void forget(void);
+static bool isearch(int, Str *);
+static void isearch_show(Str *, bool);
+static void history(void);
+static void profile(void);
+static bool complete(Str *);
+static size_t escape(void);
+static int at(size_t);
+static ssize_t fill(void);
+static void flush(Str *);
+static void raw(bool);
+static void scan(Scan *, const char *, size_t, bool);
+static void scan_word(Scan *, const char *, size_t);
+static void scan_close(Scan *, char);
+static bool scan_complete(Scan *);
+static void scan_reset(Scan *);
+static const char *prompt(const char *, const char *);
+static void sample(Samples *, struct timespec *);
+static void summary(void);
+static void summary_of(const char *, Samples *);
+static int compare(const void *, const void *);
+static void interrupt(int);
+static void uncatch(void);
+
+// ---------------------------------------------------------------------------
+
+// Scan is the state of the scan of the lines of a command.
+struct __sScan {
+    char quote;			// '\'', '"', '`' or '}' of "${" while in one
+    bool word;			// whether a word goes on from the last line
+    bool cmd;			// whether the next word is in command position
+    bool redir;			// whether the next word is a filename
+    bool pat;			// whether in the patterns of a case_item
+    bool more;			// whether the line ends with '|', '&&', '||', '\'
+
+    // open holds what closes each open construct, innermost last: 'f' for
+    // fi, 'd' for done, 'E' for the 'in' of a case, 'e' for esac, '}' for
+    // a brace_group, ')' for a subshell and 's' for a "$(".
+    Str open;
+};
+
+// Samples holds latencies, in nanoseconds.
+struct __sSamples {
+    uint64_t *v;
+    size_t n;
+    size_t cap;
+};
+
+static char ring[RINGSIZE];
+static size_t head;		// next byte to take; both only ever grow
+static size_t tail;		// next byte to fill
+
+static bool tty;		// whether the input is a terminal
+static struct termios cooked;	// its mode before it was made raw
+
+static Scan sc;
+static Str line;		// the line being edited
+static const char *shown;	// prompt in front of it
+
+static bool browsing;		// whether Up or Down was the last key
+static Str typed;		// the line as typed before
+static uint64_t *found;		// entries starting with it, the latest first
+static size_t nfound;
+static size_t maxfound;		// entries asked for, more once all were shown
+static size_t pick;		// 1 + index in found of the entry shown, or 0
+static uint64_t walk;		// entry shown when typed is empty
+
+static bool searching;		// whether in a Ctrl-R search
+static Str query;
+static uint64_t hit;		// entry found, or HIST_NONE
+
+static bool timing;		// whether the latencies are measured
+static struct timespec readat;	// when the last chunk was read
+static bool fresh;		// whether its echo is not written yet
+static struct timespec entered;	// when the last command was completed
+static Samples echoes;
+static Samples execs;
+
+// repl_run reads commands from the standard input and runs them one at a
+// time, compiled to bytecode if bytecode is set, until the end of the
+// input. It returns the status of the last command.
+int repl_run(bool bytecode)
+{
+    tty = tcgetattr(0, &cooked) == 0;
+    exec_setinteractive(true);
+
+    // The shell outlives an interrupt of the command it runs. The
+    // commands get the default action back with exec, and the subshells
+    // as they are forked.
+    struct sigaction sa = {.sa_handler = interrupt };
+    sigaction(SIGINT, &sa, NULL);
+    pthread_atfork(NULL, NULL, uncatch);
+
+    const char *lat = getenv("XSH_LATENCY");
+    if (lat && *lat) {
+	timing = true;
+	atexit(summary);
+    }
+
+    Str cmd;
+    str_init(&cmd);
+    str_init(&line);
+    str_init(&sc.open);
+    str_init(&typed);
+    str_init(&query);
+    history();
+    profile();
+
+    for (;;) {
+	cmd.len = 0;
+	if (!edit(&cmd)) {
+	    break;
+	}
+
+	Node *prog;
+	if (parser_parse_text(str_cstr(&cmd), &prog) || !prog) {
+	    continue;
+	}
+
+	hist_add(cmd.s, cmd.len - 1);
+	cmds_refresh();
+
+	if (timing) {
+	    sample(&execs, &entered);
+	}
+
+	int st;
+	if (bytecode) {
+	    Code *code = vm_compile(prog);
+	    st = vm_run(code);
+	    vm_free(code);
+	} else {
+	    st = exec_node(prog);
+	}
+	ast_free(prog);
+
+	// The terminal echoed the ^C that stopped the command, but not a
+	// newline.
+	if (tty && st == 128 + SIGINT) {
+	    write(2, "\n", 1);
+	}
+    }
+
+    str_free(&cmd);
+    return exec_status();
+}
+
+// edit reads a complete command into cmd, line by line, and returns false
+// at the end of the input. Lines are edited in raw mode, with the terminal
+// echo done here.
+static bool edit(Str *cmd)
+{
+    Str out;
+    str_init(&out);
+    scan_reset(&sc);
+    line.len = 0;
+    shown = prompt("PS1", "$ ");
+    str_puts(&out, shown);
+    raw(true);
+
+    bool done = false;
+    bool eof = false;
+
+    while (!done && !eof) {
+	while (!done && head < tail) {
+	    int c = at(0);
+
+	    if (c == ESC) {
+		// Escape sequences, as sent by the arrow keys, are taken
+		// whole, once they are read whole.
+		size_t n = escape();
+		if (!n) {
+		    break;
+		}
+
+		int last = n == 3 ? at(2) : 0;
+		c = last == 'A' ? UP : last == 'B' ? DOWN : KEY;
+		head += n;
+	    } else {
+		head++;
+	    }
+
+	    if (searching && isearch(c, &out)) {
+		continue;
+	    }
+
+	    if (c != UP && c != DOWN) {
+		forget();
+	    }
+
+	    switch (c) {
+
+	    default:
+		if ((c >= ' ' && c < KEY) || c == '\t') {
+		    str_putc(&line, c);
+		    str_putc(&out, c);
+		}
+		break;
+
+	    case '\t':
+		// A Tab pasted, rather than typed, is not a completion.
+		if (head < tail || !complete(&out)) {
+		    str_putc(&line, c);
+		    str_putc(&out, c);
+		}
+		break;
+
+	    case UP:
+	    case DOWN:
+		recall(&out, c == UP);
+		break;
+
+	    case CTRL('R'):
+		searching = true;
+		query.len = 0;
+		hit = HIST_NONE;
+		isearch_show(&out, false);
+		break;
+
+	    case '\r':
+	    case '\n':
+		str_putc(&out, '\n');
+		enter(cmd, &out);
+		done = scan_complete(&sc);
+		break;
+
+	    case DEL:
+	    case CTRL('H'):
+		// A character encoded in UTF-8 takes as many bytes as it
+		// has, but a single column.
+		while (line.len > 0
+		       && (line.s[line.len - 1] & 0xc0) == 0x80) {
+		    line.len--;
+		}
+
+		if (line.len > 0) {
+		    line.len--;
+		    str_puts(&out, "\b \b");
+		}
+		break;
+
+	    case CTRL('U'):
+		line.len = 0;
+		str_puts(&out, "\r");
+		str_puts(&out, shown);
+		str_puts(&out, "\x1b[K");
+		break;
+
+	    case CTRL('C'):
+		cmd->len = 0;
+		line.len = 0;
+		scan_reset(&sc);
+		str_puts(&out, "^C\n");
+		shown = prompt("PS1", "$ ");
+		str_puts(&out, shown);
+		break;
+
+	    case CTRL('D'):
+		eof = cmd->len == 0 && line.len == 0;
+		break;
+	    }
+	}
+
+	flush(&out);
+
+	if (!done && !eof && fill() <= 0) {
+	    // A last line without a newline still counts.
+	    if (line.len > 0) {
+		enter(cmd, &out);
+	    }
+
+	    done = cmd->len > 0;
+	    eof = true;
+	}
+    }
+
+    forget();
+    searching = false;
+    raw(false);
+    if (eof && tty) {
+	write(2, "\n", 1);
+    }
+
+    str_free(&out);
+    entered = readat;
+    return done;
+}
+
+// enter adds the line being edited to cmd, and the prompt of the next line
+// to out if the command goes on.
+static void enter(Str *cmd, Str *out)
+{
+    str_putn(cmd, line.s, line.len);
+    str_putc(cmd, '\n');
+
+    // An entry recalled from the history may have several lines.
+    for (size_t i = 0, j; i <= line.len; i = j + 1) {
+	const char *nl = memchr(line.s + i, '\n', line.len - i);
+	j = nl ? (size_t) (nl - line.s) : line.len;
+	scan(&sc, line.s + i, j - i, true);
+    }
+
+    line.len = 0;
+
+    if (!scan_complete(&sc)) {
+	shown = prompt("PS2", "> ");
+	str_puts(out, shown);
+    }
+}
+
+// redraw replaces the line shown with text, the newlines of which are
+// shown as spaces, after the prompt lead.
+static void redraw(Str *out, const char *lead)
+{
+    str_puts(out, "\r");
+    str_puts(out, lead);
+
+    for (size_t i = 0; i < line.len; i++) {
+	str_putc(out, line.s[i] == '\n' ? ' ' : line.s[i]);
+    }
+
+    str_puts(out, "\x1b[K");
+}
+
+// recall replaces the line being edited with the entry of the history
+// before the one shown if up is set, or after it, among those that start
+// with the line as typed. Past the latest, the line is back as typed. The
+// entries are looked up FOUNDMIN at first, and four times as many each
+// time the oldest of them is passed.
+static void recall(Str *out, bool up)
+{
+    if (!browsing) {
+	browsing = true;
+	typed.len = 0;
+	str_putn(&typed, line.s, line.len);
+	pick = 0;
+	walk = hist_end();
+	maxfound = FOUNDMIN;
+	found = malloc(sizeof(uint64_t) * maxfound);
+	nfound = typed.len ? hist_prefix(typed.s, typed.len, maxfound,
+					 found) : 0;
+    }
+
+    const char *text = NULL;
+
+    if (typed.len && up && pick == nfound && nfound == maxfound) {
+	more();
+    }
+
+    if (typed.len) {
+	if (up ? pick == nfound : pick == 0) {
+	    return;
+	}
+
+	pick += up ? 1 : -1;
+	text = pick ? hist_text(found[pick - 1]) : NULL;
+    } else {
+	uint64_t o = up ? hist_prev(walk) : hist_next(walk);
+	if (up && o == HIST_NONE) {
+	    return;
+	}
+
+	walk = o != HIST_NONE ? o : hist_end();
+	text = o != HIST_NONE ? hist_text(o) : NULL;
+    }
+
+    line.len = 0;
+    if (text) {
+	str_puts(&line, text);
+    } else {
+	str_putn(&line, typed.s, typed.len);
+    }
+
+    redraw(out, shown);
+}
+
+// more looks up more of the entries recalled. The entry shown is found
+// again among them, as entries added by other shells meanwhile come first.
+static void more(void)
+{
+    uint64_t at = pick ? found[pick - 1] : HIST_NONE;
+
+    maxfound *= 4;
+    found = realloc(found, sizeof(uint64_t) * maxfound);
+    nfound = hist_prefix(typed.s, typed.len, maxfound, found);
+
+    for (size_t i = 0; i < nfound; i++) {
+	if (found[i] == at) {
+	    pick = i + 1;
+	    break;
+	}
+    }
+}
+
+// forget ends the browsing of the history by recall().
+static void forget(void)
+{
+    if (browsing) {
+	browsing = false;
+	free(found);
+	found = NULL;
+	nfound = 0;
+    }
+}
+
+// isearch handles the key c in a Ctrl-R search, and returns true if it
+// was taken. The characters typed are searched for, from the entry found
+// back; ^R finds an older entry and ^G gives up. Any other key ends the
+// search with the entry found as the line, and is left to be handled as
+// usual.
+static bool isearch(int c, Str *out)
+{
+    uint64_t before;
+
+    switch (c) {
+
+    case CTRL('R'):
+	before = hit;
+	break;
+
+    case DEL:
+    case CTRL('H'):
+	while (query.len > 0 && (query.s[query.len - 1] & 0xc0) == 0x80) {
+	    query.len--;
+	}
+
+	if (query.len > 0) {
+	    query.len--;
+	}
+
+	before = HIST_NONE;
+	hit = HIST_NONE;
+	break;
+
+    case CTRL('G'):
+	searching = false;
+	redraw(out, shown);
+	return true;
+
+    default:
+	if ((c < ' ' || c >= KEY) && c != '\t') {
+	    searching = false;
+	    if (hit != HIST_NONE) {
+		line.len = 0;
+		str_puts(&line, hist_text(hit));
+	    }
+	    redraw(out, shown);
+	    return false;
+	}
+
+	str_putc(&query, c);
+	before = hit != HIST_NONE ? hit + 1 : HIST_NONE;
+	break;
+    }
+
+    uint64_t o = hist_search(query.s, query.len, before);
+
+    // An older entry the same as the one found is no news.
+    while (c == CTRL('R') && o != HIST_NONE && hit != HIST_NONE
+	   && !strcmp(hist_text(o), hist_text(hit))) {
+	o = hist_search(query.s, query.len, o);
+    }
+
+    if (o != HIST_NONE) {
+	hit = o;
+    }
+
+    isearch_show(out, o == HIST_NONE && query.len > 0);
+    return true;
+}
+
+// isearch_show shows the query of a Ctrl-R search and the entry found, if
+// any, saying so if failed is set.
+static void isearch_show(Str *out, bool failed)
+{
+    str_puts(out, "\r");
+    str_puts(out, failed ? "(failed search)`" : "(search)`");
+    str_putn(out, query.s, query.len);
+    str_puts(out, "': ");
+
+    if (hit != HIST_NONE) {
+	for (const char *p = hist_text(hit); *p; p++) {
+	    str_putc(out, *p == '\n' ? ' ' : *p);
+	}
+    }
+
+    str_puts(out, "\x1b[K");
+}
+
+// complete completes the command name at the end of the line being
+// edited, as far as the names starting with it agree, or lists them if
+// they don't. It returns false if the line does not end with a command
+// name.
+static bool complete(Str *out)
+{
+    size_t w = line.len;
+    while (w > 0 && !strchr(" \t\n;&|()<>", line.s[w - 1])) {
+	w--;
+    }
+
+    for (size_t i = w; i < line.len; i++) {
+	if (strchr("/\\'\"`$=", line.s[i])) {
+	    return false;
+	}
+    }
+
+    Scan s = sc;
+    str_init(&s.open);
+    str_putn(&s.open, sc.open.s, sc.open.len);
+    scan(&s, line.s, w, false);
+    bool cmd = s.cmd && !s.redir && !s.quote && !s.pat;
+    str_free(&s.open);
+
+    if (w == line.len || !cmd) {
+	return false;
+    }
+
+    cmds_refresh();
+
+    Str ext;
+    str_init(&ext);
+    size_t count = cmds_complete(line.s + w, line.len - w, &ext);
+
+    if (count == 1) {
+	str_putc(&ext, ' ');
+    }
+
+    if (count == 0) {
+	str_putc(out, '\a');
+    } else if (ext.len) {
+	str_putn(&line, ext.s, ext.len);
+	str_putn(out, ext.s, ext.len);
+    } else {
+	ext.len = 0;
+	size_t n = cmds_list(line.s + w, line.len - w, &ext, LISTMAX);
+
+	str_putc(out, '\n');
+	for (const char *p = ext.s; n--; p += strlen(p) + 1) {
+	    str_puts(out, p);
+	    str_puts(out, n ? "  " : "");
+	}
+
+	if (count > LISTMAX) {
+	    char more[32];
+	    snprintf(more, sizeof(more), "  (%zu more)", count - LISTMAX);
+	    str_puts(out, more);
+	}
+
+	str_putc(out, '\n');
+	redraw(out, shown);
+    }
+
+    str_free(&ext);
+    return true;
+}
+
+// history opens the history named by HISTFILE, or ~/.xsh_history.
+static void history(void)
+{
+    const char *path = var_get("HISTFILE");
+    if (path && *path) {
+	hist_open(path);
+	return;
+    }
+
+    const char *home = var_get("HOME");
+    if (home && *home) {
+	Str s;
+	str_init(&s);
+	str_puts(&s, home);
+	str_puts(&s, "/.xsh_history");
+	hist_open(str_cstr(&s));
+	str_free(&s);
+    }
+}
+
+// profile runs the commands of the file named by ENV, after parameter
+// expansion, if there is one.
+static void profile(void)
+{
+    const char *env = var_get("ENV");
+    if (!env || !*env) {
+	return;
+    }
+
+    Str path;
+    str_init(&path);
+    if (expand_word(env, &path, 0) == 0 && path.len
+	&& exec_file(path.s) < 0 && errno != ENOENT) {
+	perror(path.s);
+    }
+
+    str_free(&path);
+}
+
+// escape returns the length of the escape sequence at the start of the
+// ring, or 0 if it is not whole yet.
+static size_t escape(void)
+{
+    int c = at(1);
+    if (c < 0) {
+	return 0;
+    }
+
+    if (c != '[' && c != 'O') {
+	return 2;
+    }
+
+    for (size_t i = 2;; i++) {
+	c = at(i);
+	if (c < 0) {
+	    return 0;
+	}
+
+	if (c >= 0x40 && c <= 0x7e) {
+	    return i + 1;
+	}
+    }
+}
+
+// at returns the byte i places after the next one to take from the ring,
+// or -1 if it is not read yet.
+static int at(size_t i)
+{
+    if (head + i >= tail) {
+	return -1;
+    }
+
+    return (unsigned char) ring[(head + i) & (RINGSIZE - 1)];
+}
+
+// fill reads whatever input is available into the free part of the ring,
+// with a single system call even when it wraps around. It returns the
+// number of bytes read, 0 at the end of the input, or -1 on error.
+static ssize_t fill(void)
+{
+    size_t free = RINGSIZE - (tail - head);
+    size_t off = tail & (RINGSIZE - 1);
+    size_t first = RINGSIZE - off < free ? RINGSIZE - off : free;
+
+    struct iovec iov[2] = {
+	{ring + off, first},
+	{ring, free - first},
+    };
+
+    ssize_t n;
+    while ((n = readv(0, iov, 2)) < 0 && errno == EINTR) {
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &readat);
+    if (n > 0) {
+	tail += n;
+	fresh = true;
+    }
+
+    return n;
+}
+
+// flush writes out to the terminal, in a single write, and empties it.
+// The first write after a read is the echo of what was read.
+static void flush(Str *out)
+{
+    if (!out->len) {
+	return;
+    }
+
+    if (tty) {
+	write(2, out->s, out->len);
+
+	if (timing && fresh) {
+	    sample(&echoes, &readat);
+	}
+    }
+
+    fresh = false;
+    out->len = 0;
+}
+
+// raw puts the terminal in raw mode if on is set, or back in the mode it
+// was in. In raw mode, input is given as it is typed, without echo, and
+// the control characters reach the shell as they are.
+static void raw(bool on)
+{
+    if (!tty) {
+	return;
+    }
+
+    struct termios t = cooked;
+    if (on) {
+	t.c_iflag &= ~(ICRNL | INLCR | IXON | ISTRIP);
+	t.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+	t.c_cc[VMIN] = 1;
+	t.c_cc[VTIME] = 0;
+    }
+
+    tcsetattr(0, TCSADRAIN, &t);
+}
+
+// scan goes on with the scan sc of a command with the n bytes of the line
+// s, without its newline, or with the start of a line that goes on after
+// a separator if eol is not set.
+static void scan(Scan *sc, const char *s, size_t n, bool eol)
+{
+    size_t w = sc->word ? 0 : n;	// start of the word being scanned
+    bool plain = !sc->word;		// whether it has no quote in it
+
+    sc->more = false;
+
+    for (size_t i = 0; i < n + eol; i++) {
+	char c = i < n ? s[i] : '\n';
+
+	if (sc->quote) {
+	    if (c == '\\' && sc->quote != '\'' && i + 1 < n) {
+		i++;
+	    } else if (c == sc->quote) {
+		sc->quote = 0;
+	    }
+	    continue;
+	}
+
+	if (!strchr(" \t\n;&|<>()", c)) {
+	    if (w == n) {
+		if (c == '#') {
+		    break;
+		}
+
+		w = i;
+		plain = true;
+		sc->more = false;
+	    }
+
+	    if (c == '\\') {
+		plain = false;
+		if (i + 1 == n) {
+		    sc->more = true;
+		    break;
+		}
+		i++;
+	    } else if (c == '\'' || c == '"' || c == '`') {
+		plain = false;
+		sc->quote = c;
+	    } else if (c == '$' && i + 1 < n && s[i + 1] == '{') {
+		plain = false;
+		sc->quote = '}';
+		i++;
+	    } else if (c == '$' && i + 1 < n && s[i + 1] == '(') {
+		str_putc(&sc->open, 's');
+		sc->cmd = true;
+		sc->pat = false;
+		w = n;
+		i++;
+	    }
+	    continue;
+	}
+
+	// The end of a word.
+	if (w != n) {
+	    if (plain) {
+		scan_word(sc, s + w, i - w);
+	    } else {
+		sc->cmd = sc->cmd && sc->redir;
+		sc->redir = false;
+	    }
+	    w = n;
+	}
+
+	char d = i + 1 < n ? s[i + 1] : '\0';
+
+	switch (c) {
+
+	case ';':
+	    if (d == ';') {
+		i++;
+		sc->pat = sc->open.len && sc->open.s[sc->open.len - 1] == 'e';
+		sc->cmd = !sc->pat;
+	    } else {
+		sc->cmd = !sc->pat;
+	    }
+	    break;
+
+	case '&':
+	case '|':
+	    if (sc->pat) {
+		break;
+	    }
+
+	    if (d == c) {
+		i++;
+		sc->more = true;
+	    } else {
+		sc->more = c == '|';
+	    }
+
+	    sc->cmd = true;
+	    break;
+
+	case '<':
+	case '>':
+	    if (d && strchr("<>&|", d)) {
+		i++;
+	    }
+	    sc->redir = true;
+	    break;
+
+	case '(':
+	    sc->more = false;
+	    if (sc->cmd && !sc->pat) {
+		str_putc(&sc->open, ')');
+	    }
+	    break;
+
+	case ')':
+	    if (sc->pat) {
+		sc->pat = false;
+		sc->cmd = true;
+	    } else if (sc->open.len && (sc->open.s[sc->open.len - 1] == ')'
+					|| sc->open.s[sc->open.len - 1] ==
+					's')) {
+		bool subst = sc->open.s[--sc->open.len] == 's';
+		sc->cmd = false;
+
+		// The word around a "$(" goes on after it.
+		if (subst && i + 1 < n && !strchr(" \t;&|<>()", s[i + 1])) {
+		    w = i + 1;
+		    plain = false;
+		}
+	    }
+	    break;
+
+	case '\n':
+	    sc->cmd = sc->cmd || !sc->pat;
+	    break;
+	}
+
+	if (!strchr(" \t<>", c)) {
+	    sc->redir = false;
+	}
+    }
+
+    sc->word = sc->quote != 0;
+}
+
+// scan_word goes on with the scan sc of a command with the unquoted word
+// w of n bytes.
+static void scan_word(Scan *sc, const char *w, size_t n)
+{
+    char top = sc->open.len ? sc->open.s[sc->open.len - 1] : 0;
+    char buf[8] = "";
+
+    if (n < sizeof(buf)) {
+	memcpy(buf, w, n);
+	buf[n] = '\0';
+    }
+
+    if (sc->redir) {
+	sc->redir = false;
+	return;
+    }
+
+    if (sc->pat) {
+	if (!strcmp(buf, "esac")) {
+	    scan_close(sc, 'e');
+	}
+	return;
+    }
+
+    if (top == 'E' && !strcmp(buf, "in")) {
+	sc->open.s[sc->open.len - 1] = 'e';
+	sc->pat = true;
+	sc->cmd = false;
+	return;
+    }
+
+    if (!sc->cmd) {
+	sc->cmd = top == 'd' && !strcmp(buf, "do");
+	return;
+    }
+
+    if (!strcmp(buf, "if")) {
+	str_putc(&sc->open, 'f');
+    } else if (!strcmp(buf, "while") || !strcmp(buf, "until")) {
+	str_putc(&sc->open, 'd');
+    } else if (!strcmp(buf, "for")) {
+	str_putc(&sc->open, 'd');
+	sc->cmd = false;
+    } else if (!strcmp(buf, "case")) {
+	str_putc(&sc->open, 'E');
+	sc->cmd = false;
+    } else if (!strcmp(buf, "{")) {
+	str_putc(&sc->open, '}');
+    } else if (!strcmp(buf, "fi")) {
+	scan_close(sc, 'f');
+    } else if (!strcmp(buf, "done")) {
+	scan_close(sc, 'd');
+    } else if (!strcmp(buf, "esac")) {
+	scan_close(sc, 'e');
+    } else if (!strcmp(buf, "}")) {
+	scan_close(sc, '}');
+    } else if (strcmp(buf, "then") && strcmp(buf, "else")
+	       && strcmp(buf, "elif") && strcmp(buf, "do")
+	       && strcmp(buf, "!") && strcmp(buf, "time")) {
+	// A word of a simple command; only its assignments come before
+	// the command name.
+	size_t i = 0;
+	while (i < n && (isalpha((unsigned char) w[i]) || w[i] == '_'
+			 || (i && isdigit((unsigned char) w[i])))) {
+	    i++;
+	}
+	sc->cmd = i > 0 && i < n && w[i] == '=';
+    }
+}
+
+// scan_close closes the innermost construct of sc if it is closed by c,
+// or by the esac of a case with no 'in' yet.
+static void scan_close(Scan *sc, char c)
+{
+    char top = sc->open.len ? sc->open.s[sc->open.len - 1] : 0;
+
+    if (top == c || (c == 'e' && top == 'E')) {
+	sc->open.len--;
+    }
+
+    sc->cmd = false;
+    sc->pat = false;
+}
+
+// scan_complete checks whether the command scanned by sc is complete.
+static bool scan_complete(Scan *sc)
+{
+    return !sc->quote && !sc->more && !sc->open.len;
+}
+
+// scan_reset starts the scan sc of a new command.
+static void scan_reset(Scan *sc)
+{
+    sc->quote = 0;
+    sc->word = false;
+    sc->cmd = true;
+    sc->redir = false;
+    sc->pat = false;
+    sc->more = false;
+    sc->open.len = 0;
+}
+
+// prompt returns the value of the variable name, or def if it is unset.
+static const char *prompt(const char *name, const char *def)
+{
+    const char *p = var_get(name);
+    return p ? p : def;
+}
+
+// sample adds the time elapsed since t to s.
+static void sample(Samples *s, struct timespec *t)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (s->n == s->cap) {
+	s->cap = s->cap ? s->cap * 2 : 256;
+	s->v = realloc(s->v, sizeof(uint64_t) * s->cap);
+    }
+
+    s->v[s->n++] = (now.tv_sec - t->tv_sec) * 1000000000LL
+	+ now.tv_nsec - t->tv_nsec;
+}
+
+// summary prints the latencies measured.
+static void summary(void)
+{
+    summary_of("keystroke to echo", &echoes);
+    summary_of("enter to exec", &execs);
+}
+
+// summary_of prints the median, the 99th percentile and the largest of the
+// latencies s, what.
+static void summary_of(const char *what, Samples *s)
+{
+    if (!s->n) {
+	return;
+    }
+
+    qsort(s->v, s->n, sizeof(uint64_t), compare);
+    fprintf(stderr, "%-17s %6zu samples  p50 %8.1fus  p99 %8.1fus  "
+	    "max %8.1fus\n", what, s->n, s->v[s->n / 2] / 1e3,
+	    s->v[s->n * 99 / 100] / 1e3, s->v[s->n - 1] / 1e3);
+}
+
+// compare orders two latencies for qsort.
+static int compare(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+// interrupt catches SIGINT for the shell, which ignores it.
+static void interrupt(int sig)
+{
+    (void) sig;
+}
+
+// uncatch gives SIGINT its default action back in a child process.
+static void uncatch(void)
+{
+    signal(SIGINT, SIG_DFL);
+}
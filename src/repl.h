@@ -0,0 +1,12 @@
+//
+// repl.h - interactive input loop
+//
+
+#ifndef REPL_H
+#define REPL_H
+
+#include <stdbool.h>
+
+int repl_run(bool);
+
+#endif
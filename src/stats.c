@@ -0,0 +1,246 @@
+//
+// stats.c - per-command statistics
+//
+// When XSH_STATS names a file, every command the shell waits for is
+// recorded there: when it started, its real, user and system time, its
+// largest resident set size and its exit status. The file is a ring of
+// fixed-size binary records mapped shared, so that writing one costs no
+// system call, the subshells write to the same ring as the shell, and the
+// records of a run survive it, however it ended. The latest NSTATS of
+// them are kept. 'xsh -S file' prints them.
+//
+// Records are claimed with an atomic increment of the count in the header,
+// so that shells sharing the file don't write over each other. The seq of
+// a record is set last, which lets a reader skip a record being written.
+//
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "stats.h"
+
+#define NSTATS 4096
+#define VERSION 1
+#define MAGIC "xshstats"
+
+void stats_open(const char *);
+bool stats_active(void);
+void stats_begin(Usage *);
+void stats_end(Usage *);
+void stats_add(const char *, pid_t, int, const Usage *);
+int stats_dump(const char *);
+static void *map(int, bool);
+static int64_t nsecs(struct timespec);
+static int64_t usecs(struct timeval);
+
+// ---------------------------------------------------------------------------
+
+// Head is found at the start of the file, followed by cap records.
+typedef struct __sHead {
+    char magic[8];
+    uint32_t version;
+    uint32_t size;		// of a record
+    uint64_t cap;
+    uint64_t next;		// number of records ever claimed
+} Head;
+
+// Stat is the record of a command.
+typedef struct __sStat {
+    uint64_t seq;		// its number plus one, 0 while being written
+    int64_t start;		// CLOCK_REALTIME, in nanoseconds
+    int64_t real;		// in nanoseconds
+    int64_t user;		// in microseconds
+    int64_t sys;		// in microseconds
+    int64_t maxrss;		// in kilobytes
+    int32_t pid;		// the shell's for a builtin
+    int32_t status;
+    char name[32];		// the command name, cut if longer
+} Stat;
+
+static Head *head;		// NULL unless recording
+static Stat *ring;
+
+// stats_open starts recording to the file path, which is made if it is
+// empty or does not exist. A file that is not a ring of records is left
+// alone.
+void stats_open(const char *path)
+{
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+	perror(path);
+	return;
+    }
+
+    // Shells starting at once must not both set up the file.
+    flock(fd, LOCK_EX);
+    head = map(fd, true);
+    flock(fd, LOCK_UN);
+    close(fd);
+
+    if (!head) {
+	fprintf(stderr, "%s: not a statistics file\n", path);
+	return;
+    }
+
+    ring = (Stat *) (head + 1);
+}
+
+// stats_active checks whether commands are being recorded.
+bool stats_active(void)
+{
+    return head != NULL;
+}
+
+// stats_begin starts measuring u for a command run in the shell process.
+void stats_begin(Usage *u)
+{
+    clock_gettime(CLOCK_MONOTONIC, &u->start);
+    getrusage(RUSAGE_SELF, &u->ru);
+}
+
+// stats_end completes u, started by stats_begin(), with the time the shell
+// used since.
+void stats_end(Usage *u)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    clock_gettime(CLOCK_MONOTONIC, &u->end);
+
+    timersub(&ru.ru_utime, &u->ru.ru_utime, &u->ru.ru_utime);
+    timersub(&ru.ru_stime, &u->ru.ru_stime, &u->ru.ru_stime);
+    u->ru.ru_maxrss = ru.ru_maxrss;
+}
+
+// stats_add records the command name run by the process pid, that ended
+// with the status st after using u.
+void stats_add(const char *name, pid_t pid, int st, const Usage *u)
+{
+    if (!head) {
+	return;
+    }
+
+    uint64_t seq = __atomic_fetch_add(&head->next, 1, __ATOMIC_RELAXED);
+    Stat *s = &ring[seq % head->cap];
+    __atomic_store_n(&s->seq, 0, __ATOMIC_RELAXED);
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    s->real = nsecs(u->end) - nsecs(u->start);
+    s->start = nsecs(now) - s->real;
+    s->user = usecs(u->ru.ru_utime);
+    s->sys = usecs(u->ru.ru_stime);
+    s->maxrss = u->ru.ru_maxrss;
+    s->pid = pid;
+    s->status = st;
+    strncpy(s->name, name, sizeof(s->name) - 1);
+    s->name[sizeof(s->name) - 1] = '\0';
+
+    __atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+// stats_dump prints the records of the file path, oldest first, one per
+// line. It returns the exit status of 'xsh -S'.
+int stats_dump(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+	perror(path);
+	return 1;
+    }
+
+    Head *h = map(fd, false);
+    close(fd);
+    if (!h) {
+	fprintf(stderr, "%s: not a statistics file\n", path);
+	return 1;
+    }
+
+    Stat *r = (Stat *) (h + 1);
+    uint64_t next = __atomic_load_n(&h->next, __ATOMIC_ACQUIRE);
+    uint64_t first = next > h->cap ? next - h->cap : 0;
+
+    printf("%-23s %10s %10s %10s %10s %7s %6s  %s\n", "start", "real",
+	   "user", "sys", "maxrss", "pid", "status", "command");
+
+    for (uint64_t i = first; i < next; i++) {
+	Stat s = r[i % h->cap];
+	if (s.seq != i + 1) {
+	    continue;
+	}
+
+	time_t sec = s.start / 1000000000;
+	struct tm tm;
+	char date[32];
+	localtime_r(&sec, &tm);
+	strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+
+	printf("%s.%03d %10.6f %10.6f %10.6f %9ldk %7d %6d  %s\n", date,
+	       (int) (s.start / 1000000 % 1000), s.real / 1e9, s.user / 1e6,
+	       s.sys / 1e6, (long) s.maxrss, s.pid, s.status, s.name);
+    }
+
+    munmap(h, sizeof(Head) + h->cap * sizeof(Stat));
+    return 0;
+}
+
+// map maps the file fd, shared and writable if write is set, and returns
+// its head, or NULL if it is not a ring of records. An empty file is made
+// into an empty ring when write is set.
+static void *map(int fd, bool write)
+{
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+	return NULL;
+    }
+
+    Head h = { MAGIC, VERSION, sizeof(Stat), NSTATS, 0 };
+    bool empty = st.st_size == 0;
+
+    if (empty && (!write || ftruncate(fd, sizeof(Head)
+				      + NSTATS * sizeof(Stat)) < 0)) {
+	return NULL;
+    }
+
+    if (!empty && (pread(fd, &h, sizeof(Head), 0) != sizeof(Head)
+		   || memcmp(h.magic, MAGIC, 8) || h.version != VERSION
+		   || h.size != sizeof(Stat) || h.cap == 0
+		   || (uint64_t) st.st_size
+		   < sizeof(Head) + h.cap * sizeof(Stat))) {
+	return NULL;
+    }
+
+    Head *p = mmap(NULL, sizeof(Head) + h.cap * sizeof(Stat),
+		   write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd,
+		   0);
+    if (p == MAP_FAILED) {
+	return NULL;
+    }
+
+    if (empty) {
+	*p = h;
+    }
+
+    return p;
+}
+
+// nsecs returns ts in nanoseconds.
+static int64_t nsecs(struct timespec ts)
+{
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// usecs returns tv in microseconds.
+static int64_t usecs(struct timeval tv)
+{
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
@@ -0,0 +1,19 @@
+//
+// stats.h - per-command statistics
+//
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include "jobs.h"
+
+void stats_open(const char *);
+bool stats_active(void);
+void stats_begin(Usage *);
+void stats_end(Usage *);
+void stats_add(const char *, pid_t, int, const Usage *);
+int stats_dump(const char *);
+
+#endif
@@ -0,0 +1,104 @@
+//
+// str.c - small-buffer strings
+//
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "str.h"
+
+void str_init(Str *);
+void str_free(Str *);
+void str_grow(Str *, size_t);
+void str_putn(Str *, const char *, size_t);
+void str_puts(Str *, const char *);
+char *str_cstr(Str *);
+bool str_read(Str *, int);
+
+// ---------------------------------------------------------------------------
+
+// str_init makes str an empty string held in its small buffer.
+void str_init(Str *str)
+{
+    str->s = str->small;
+    str->len = 0;
+    str->cap = STR_SMALL;
+}
+
+// str_free frees the heap buffer of str, if any, and empties it.
+void str_free(Str *str)
+{
+    if (str->s != str->small) {
+	free(str->s);
+    }
+
+    str_init(str);
+}
+
+// str_grow makes room for n more bytes in str.
+void str_grow(Str *str, size_t n)
+{
+    if (str->len + n <= str->cap) {
+	return;
+    }
+
+    size_t cap = str->cap * 2;
+    while (cap < str->len + n) {
+	cap *= 2;
+    }
+
+    if (str->s == str->small) {
+	str->s = malloc(cap);
+	memcpy(str->s, str->small, str->len);
+    } else {
+	str->s = realloc(str->s, cap);
+    }
+
+    str->cap = cap;
+}
+
+// str_putn appends the n bytes at s to str.
+void str_putn(Str *str, const char *s, size_t n)
+{
+    str_grow(str, n);
+    memcpy(str->s + str->len, s, n);
+    str->len += n;
+}
+
+// str_puts appends the string s to str.
+void str_puts(Str *str, const char *s)
+{
+    str_putn(str, s, strlen(s));
+}
+
+// str_cstr returns the bytes of str followed by a '\0', which is not part
+// of its length.
+char *str_cstr(Str *str)
+{
+    str_grow(str, 1);
+    str->s[str->len] = '\0';
+    return str->s;
+}
+
+// str_read appends the data of fd up to its end to str, and returns false
+// on a read error, with errno set.
+bool str_read(Str *str, int fd)
+{
+    for (;;) {
+	str_grow(str, 4096);
+
+	ssize_t n = read(fd, str->s + str->len, str->cap - str->len);
+	if (n < 0 && errno == EINTR) {
+	    continue;
+	}
+
+	if (n <= 0) {
+	    return n == 0;
+	}
+
+	str->len += n;
+    }
+}
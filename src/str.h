@@ -0,0 +1,42 @@
+//
+// str.h - small-buffer strings
+//
+
+#ifndef STR_H
+#define STR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define STR_SMALL 64
+
+// Str is a growable string. Up to STR_SMALL bytes are kept in the struct
+// itself, so that short strings never touch the heap; only longer ones are
+// moved to a heap buffer. s points to whichever of the two is in use, so a
+// Str must not be copied, only passed by pointer.
+typedef struct __sStr {
+    char *s;
+    size_t len;
+    size_t cap;
+    char small[STR_SMALL];
+} Str;
+
+void str_init(Str *);
+void str_free(Str *);
+void str_grow(Str *, size_t);
+void str_putn(Str *, const char *, size_t);
+void str_puts(Str *, const char *);
+char *str_cstr(Str *);
+bool str_read(Str *, int);
+
+// str_putc appends c to str.
+static inline void str_putc(Str *str, char c)
+{
+    if (str->len == str->cap) {
+	str_grow(str, 1);
+    }
+
+    str->s[str->len++] = c;
+}
+
+#endif
@@ -0,0 +1,155 @@
+//
+// table.c - open addressing hash tables
+//
+// The tables of variables, command substitutions, jobs and image words
+// are all this one: entries stored inline, probed linearly from the slot
+// of their hash, and kept at most three quarters full. An entry is deleted
+// by shifting back those after it in its run, so that no tombstone is
+// left for lookups to step over.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "table.h"
+
+uint64_t table_hash(const void *, size_t);
+void *table_find(Table *, uint64_t, const void *,
+		 bool (*)(const void *, const void *));
+void *table_add(Table *, uint64_t);
+void table_delete(Table *, void *);
+void *table_at(Table *, size_t);
+void table_clear(Table *);
+static void resize(Table *, size_t);
+static uint64_t *slot(Table *, size_t);
+
+// ---------------------------------------------------------------------------
+
+// table_hash returns the FNV-1a hash of the len bytes at p, made 1 if it is
+// 0 so that it never marks a free entry.
+uint64_t table_hash(const void *p, size_t len)
+{
+    const unsigned char *s = p;
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < len; i++) {
+	h = (h ^ s[i]) * 0x100000001b3ULL;
+    }
+
+    return h ? h : 1;
+}
+
+// table_find returns the entry of hash h for which same(entry, key) holds,
+// or NULL if there is none.
+void *table_find(Table *t, uint64_t h, const void *key,
+		 bool (*same)(const void *, const void *))
+{
+    for (size_t i = h; t->cap; i++) {
+	uint64_t *e = slot(t, i);
+
+	if (!*e) {
+	    break;
+	}
+
+	if (*e == h && same(e, key)) {
+	    return e;
+	}
+    }
+
+    return NULL;
+}
+
+// table_add returns a new zeroed entry of hash h, to be filled by the
+// caller. It does not look for an entry of the same key.
+void *table_add(Table *t, uint64_t h)
+{
+    // Keep the table at most three quarters full.
+    if (4 * (t->count + 1) > 3 * t->cap) {
+	resize(t, t->cap ? t->cap * 2 : 64);
+    }
+
+    size_t i = h;
+    while (*slot(t, i)) {
+	i++;
+    }
+
+    uint64_t *e = slot(t, i);
+    memset(e, 0, t->size);
+    *e = h;
+    t->count++;
+    return e;
+}
+
+// table_delete removes the entry e from t. The entries after it in its run
+// are shifted back, so that no lookup stops short of them.
+void table_delete(Table *t, void *e)
+{
+    size_t hole = ((char *) e - t->slots) / t->size;
+
+    for (size_t i = hole + 1;; i++) {
+	uint64_t *next = slot(t, i);
+	if (!*next) {
+	    break;
+	}
+
+	// next may fill the hole if the hole is not before its own slot.
+	size_t home = *next;
+	if (((i - home) & (t->cap - 1)) >= ((i - hole) & (t->cap - 1))) {
+	    memcpy(slot(t, hole), next, t->size);
+	    hole = i & (t->cap - 1);
+	}
+    }
+
+    memset(slot(t, hole), 0, t->size);
+    t->count--;
+}
+
+// table_at returns the entry in slot i of t, or NULL if it is free.
+void *table_at(Table *t, size_t i)
+{
+    uint64_t *e = slot(t, i);
+    return *e ? e : NULL;
+}
+
+// table_clear removes every entry of t, keeping its slots.
+void table_clear(Table *t)
+{
+    if (t->cap) {
+	memset(t->slots, 0, t->cap * t->size);
+    }
+
+    t->count = 0;
+}
+
+// resize moves the entries of t to a table of n slots.
+static void resize(Table *t, size_t n)
+{
+    Table old = *t;
+
+    t->slots = calloc(n, t->size);
+    t->cap = n;
+
+    for (size_t i = 0; i < old.cap; i++) {
+	uint64_t *e = slot(&old, i);
+	if (!*e) {
+	    continue;
+	}
+
+	size_t j = *e;
+	while (*slot(t, j)) {
+	    j++;
+	}
+
+	memcpy(slot(t, j), e, t->size);
+    }
+
+    free(old.slots);
+}
+
+// slot returns the entry of t at i, wrapped around its capacity.
+static uint64_t *slot(Table *t, size_t i)
+{
+    return (uint64_t *) (t->slots + (i & (t->cap - 1)) * t->size);
+}
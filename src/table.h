@@ -0,0 +1,32 @@
+//
+// table.h - open addressing hash tables
+//
+
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Table is an open addressing table of entries of size bytes, found by the
+// hash of their key with linear probing. Every entry starts with a
+// uint64_t holding that hash, which is never 0; an entry whose hash is 0
+// is free. Entries move as the table grows or loses an entry, so a pointer
+// to one only holds until the table changes.
+typedef struct __sTable {
+    char *slots;
+    size_t size;		// of an entry
+    size_t cap;			// a power of two, 0 before the first entry
+    size_t count;
+} Table;
+
+uint64_t table_hash(const void *, size_t);
+void *table_find(Table *, uint64_t, const void *,
+		 bool (*)(const void *, const void *));
+void *table_add(Table *, uint64_t);
+void table_delete(Table *, void *);
+void *table_at(Table *, size_t);
+void table_clear(Table *);
+
+#endif
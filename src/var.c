@@ -0,0 +1,306 @@
+//
+// var.c - shell variables
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "var.h"
+#include "table.h"
+
+extern char **environ;
+
+// Var is a single shell variable, an entry of the open addressing table
+// that holds them. Its value is kept as the "name=value" string handed to
+// the commands run by the shell, so that making their environment only
+// takes pointers.
+typedef struct __sVar {
+    uint64_t hash;
+    char *name;
+    size_t len;			// length of name
+    char *env;			// "name=value", or NULL if unset
+    size_t size;		// size of env if owned, 0 otherwise
+    bool exported;
+} Var;
+
+// Local is the previous state of a variable assigned by var_local().
+typedef struct __sLocal {
+    char *name;
+    char *value;		// NULL if it was unset
+    bool exported;
+} Local;
+
+void var_init(int, char **);
+void var_set(const char *, const char *);
+const char *var_get(const char *);
+void var_unset(const char *);
+void var_export(const char *);
+char **var_environ(void);
+size_t var_mark(void);
+void var_local(const char *, const char *);
+void var_restore(size_t);
+const char *var_arg(int);
+int var_nargs(void);
+pid_t var_pid(void);
+static void import(void);
+static Var *lookup(const char *, size_t, bool);
+static bool same(const void *, const void *);
+
+// ---------------------------------------------------------------------------
+
+static Table vars = {.size = sizeof(Var) };
+
+// envp is the environment of the commands, rebuilt by var_environ() only
+// when dirty tells an exported variable changed since the last time.
+static char **envp;
+static size_t capenvp;
+static bool dirty = true;
+
+static Local *locals;
+static size_t nlocals;
+static size_t caplocals;
+
+static bool imported;		// whether the environment is in the table
+
+static char **args;		// $0 and the positional parameters
+static int nargs;		// number of positional parameters
+static pid_t pid;		// process ID of the shell
+
+// var_init sets $0 to argv[0] and the positional parameters to the rest of
+// the argc words of argv. It has to be called once, before any other
+// function listed in "var.h".
+//
+// The environment is imported as exported variables only once a variable
+// is looked up, so that a shell that runs a command without a variable
+// does not hash them all: until then, it is handed to the commands as it
+// is.
+void var_init(int argc, char **argv)
+{
+    args = argv;
+    nargs = argc - 1;
+    pid = getpid();
+}
+
+// var_set assigns value to the variable name, creating it if needed.
+void var_set(const char *name, const char *value)
+{
+    Var *v = lookup(name, strlen(name), true);
+    size_t size = v->len + strlen(value) + 2;
+
+    // Reuse the string of the old value when the new one fits, as for the
+    // variable of a for_clause.
+    if (size > v->size) {
+	if (v->size) {
+	    free(v->env);
+	}
+
+	v->env = malloc(size);
+	v->size = size;
+    }
+
+    memcpy(v->env, v->name, v->len);
+    v->env[v->len] = '=';
+    strcpy(v->env + v->len + 1, value);
+
+    if (v->exported) {
+	dirty = true;
+    }
+}
+
+// var_get returns the value of the variable name, or NULL if it is unset.
+const char *var_get(const char *name)
+{
+    Var *v = lookup(name, strlen(name), false);
+    return v && v->env ? v->env + v->len + 1 : NULL;
+}
+
+// var_unset unsets the variable name, which is no longer exported.
+void var_unset(const char *name)
+{
+    Var *v = lookup(name, strlen(name), false);
+    if (!v) {
+	return;
+    }
+
+    if (v->exported && v->env) {
+	dirty = true;
+    }
+
+    if (v->size) {
+	free(v->env);
+    }
+
+    v->env = NULL;
+    v->size = 0;
+    v->exported = false;
+}
+
+// var_export marks the variable name to be passed in the environment of
+// the commands run by the shell.
+void var_export(const char *name)
+{
+    Var *v = lookup(name, strlen(name), true);
+
+    if (!v->exported) {
+	v->exported = true;
+	dirty = v->env || dirty;
+    }
+}
+
+// var_environ returns the NULL-terminated environment of the commands run
+// by the shell. It is only built again when an exported variable changed,
+// so running many commands costs nothing here.
+char **var_environ(void)
+{
+    if (!imported) {
+	return environ;
+    }
+
+    if (!dirty) {
+	return envp;
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < vars.cap; i++) {
+	Var *v = table_at(&vars, i);
+	n += v && v->exported && v->env;
+    }
+
+    if (n + 1 > capenvp) {
+	capenvp = (n + 1) * 2;
+	envp = realloc(envp, sizeof(char *) * capenvp);
+    }
+
+    n = 0;
+    for (size_t i = 0; i < vars.cap; i++) {
+	Var *v = table_at(&vars, i);
+	if (v && v->exported && v->env) {
+	    envp[n++] = v->env;
+	}
+    }
+
+    envp[n] = NULL;
+    dirty = false;
+    return envp;
+}
+
+// var_mark returns the mark to give to var_restore() to undo the calls to
+// var_local() made from now on.
+size_t var_mark(void)
+{
+    return nlocals;
+}
+
+// var_local assigns value to the variable name until var_restore() is
+// called, as for the assignments in front of a builtin.
+void var_local(const char *name, const char *value)
+{
+    if (nlocals == caplocals) {
+	caplocals = caplocals ? caplocals * 2 : 8;
+	locals = realloc(locals, sizeof(Local) * caplocals);
+    }
+
+    Var *v = lookup(name, strlen(name), false);
+    Local *l = &locals[nlocals++];
+    l->name = strdup(name);
+    l->value = v && v->env ? strdup(v->env + v->len + 1) : NULL;
+    l->exported = v && v->exported;
+
+    var_set(name, value);
+}
+
+// var_restore puts back the variables assigned by var_local() since mark.
+void var_restore(size_t mark)
+{
+    while (nlocals > mark) {
+	Local *l = &locals[--nlocals];
+
+	if (l->value) {
+	    var_set(l->name, l->value);
+	} else {
+	    var_unset(l->name);
+	}
+
+	if (l->exported) {
+	    var_export(l->name);
+	}
+
+	free(l->name);
+	free(l->value);
+    }
+}
+
+// var_arg returns the positional parameter i, $0 for i = 0, or NULL if
+// there is no such parameter.
+const char *var_arg(int i)
+{
+    return args && i >= 0 && i <= nargs ? args[i] : NULL;
+}
+
+// var_nargs returns the number of positional parameters, $#.
+int var_nargs(void)
+{
+    return nargs;
+}
+
+// var_pid returns the process ID of the shell, $$. It is the same in every
+// subshell.
+pid_t var_pid(void)
+{
+    return pid;
+}
+
+// import adds the variables of the environment to the table, exported.
+static void import(void)
+{
+    imported = true;
+
+    for (char **e = environ; e && *e; e++) {
+	char *eq = strchr(*e, '=');
+	if (!eq || eq == *e) {
+	    continue;
+	}
+
+	// The strings of the environment are used as they are until the
+	// variables change.
+	Var *v = lookup(*e, eq - *e, true);
+	if (v->size) {
+	    free(v->env);
+	}
+
+	v->env = *e;
+	v->size = 0;
+	v->exported = true;
+    }
+}
+
+// lookup returns the variable of the len bytes at name. If there is none,
+// it is added unset when create is set, or NULL is returned.
+static Var *lookup(const char *name, size_t len, bool create)
+{
+    if (!imported) {
+	import();
+    }
+
+    uint64_t h = table_hash(name, len);
+    Var key = {.name = (char *) name, .len = len };
+    Var *v = table_find(&vars, h, &key, same);
+    if (v || !create) {
+	return v;
+    }
+
+    v = table_add(&vars, h);
+    v->name = strndup(name, len);
+    v->len = len;
+    return v;
+}
+
+// same tells whether the variables a and b have the same name.
+static bool same(const void *a, const void *b)
+{
+    const Var *x = a, *y = b;
+    return x->len == y->len && !memcmp(x->name, y->name, x->len);
+}
@@ -0,0 +1,24 @@
+//
+// var.h - shell variables
+//
+
+#ifndef VAR_H
+#define VAR_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+void var_init(int, char **);
+void var_set(const char *, const char *);
+const char *var_get(const char *);
+void var_unset(const char *);
+void var_export(const char *);
+char **var_environ(void);
+size_t var_mark(void);
+void var_local(const char *, const char *);
+void var_restore(size_t);
+const char *var_arg(int);
+int var_nargs(void);
+pid_t var_pid(void);
+
+#endif
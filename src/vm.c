@@ -0,0 +1,606 @@
+//
+// vm.c - bytecode compiler and virtual machine
+//
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "vm.h"
+#include "exec.h"
+#include "builtin.h"
+#include "var.h"
+#include "expand.h"
+
+#define NLOOPS 64
+
+Code *vm_compile(Node *);
+int vm_run(Code *);
+void vm_free(Code *);
+static int push(Op, int, int, Node *);
+static void patch(int, int);
+static int target(void);
+static void compile_node(Node *);
+static void compile_simple(Node *);
+static bool compile_jump(Node *, bool);
+static void compile_if(Node *);
+static void compile_loop(Node *);
+static void compile_for(Node *);
+static void compile_case(Node *);
+static void loop_enter(void);
+static void loop_leave(Node *, size_t, int, int, int);
+
+// ---------------------------------------------------------------------------
+
+// Loop is a loop being compiled. The break and continue instructions found
+// in its body are jumps whose target is only known once the whole loop has
+// been compiled.
+typedef struct __sLoop {
+    int redirs;			// OpRedir nesting at the start of the loop
+    int *breaks;		// OpJmp to patch with the end of the loop
+    size_t nbreaks;
+    int *conts;			// OpJmp to patch with the next iteration
+    size_t nconts;
+} Loop;
+
+static Code *code;
+static Loop loops[NLOOPS];
+static int nloops;
+static int redirs;		// current OpRedir nesting
+
+// dynamic is set when a break or continue of the outermost loop being
+// compiled can't be turned into a jump, as when its count is not a
+// literal number. That loop is then left to the tree-walking interpreter.
+static bool dynamic;
+
+// vm_compile compiles the tree n into bytecode. The tree must outlive the
+// bytecode, as the instructions point into it.
+Code *vm_compile(Node *n)
+{
+    code = calloc(1, sizeof(Code));
+    nloops = 0;
+    redirs = 0;
+
+    compile_node(n);
+    push(OpHalt, 0, 0, NULL);
+    return code;
+}
+
+// push appends an instruction to the code being compiled and returns its
+// index.
+static int push(Op op, int a, int b, Node *n)
+{
+    if (code->len == code->cap) {
+	code->cap = code->cap ? code->cap * 2 : 64;
+	code->insts = realloc(code->insts, sizeof(Inst) * code->cap);
+    }
+
+    Inst *inst = &code->insts[code->len];
+    inst->op = op;
+    inst->a = a;
+    inst->b = b;
+    inst->n = n;
+    inst->fn = NULL;
+    return code->len++;
+}
+
+// patch sets the jump target of the instruction at i.
+static void patch(int i, int to)
+{
+    code->insts[i].a = to;
+}
+
+// target reserves an entry in Code->targets and returns its index.
+static int target(void)
+{
+    if (code->ntargets == code->captargets) {
+	code->captargets = code->captargets ? code->captargets * 2 : 16;
+	code->targets =
+	    realloc(code->targets, sizeof(int) * code->captargets);
+    }
+
+    return code->ntargets++;
+}
+
+// compile_node compiles n, wrapped between an OpRedir and an OpUnredir if
+// it is a compound command with a redirect_list.
+static void compile_node(Node *n)
+{
+    if (!n) {
+	return;
+    }
+
+    int redir = -1;
+    if (n->type != NSimple && n->redir) {
+	redir = push(OpRedir, 0, 0, n);
+
+	if (++redirs > code->nredirs) {
+	    code->nredirs = redirs;
+	}
+    }
+
+    switch (n->type) {
+
+    case NSimple:
+	compile_simple(n);
+	break;
+
+    case NPipe:
+	push(OpPipe, 0, 0, n);
+	break;
+
+    case NNot:
+	compile_node(n->left);
+	push(OpNot, 0, 0, NULL);
+	break;
+
+    case NAnd:
+    case NOr:
+	compile_node(n->left);
+	int skip = push(n->type == NAnd ? OpJnz : OpJz, 0, 0, NULL);
+	compile_node(n->right);
+	patch(skip, code->len);
+	break;
+
+    case NList:
+	for (Node *item = n; item; item = item->right) {
+	    if (item->bg) {
+		push(OpAsync, 0, 0, item->left);
+	    } else {
+		compile_node(item->left);
+	    }
+	}
+	break;
+
+    case NBrace:
+	compile_node(n->left);
+	break;
+
+    case NSubshell:
+	push(OpSubshell, 0, 0, n);
+	break;
+
+    case NIf:
+	compile_if(n);
+	break;
+
+    case NWhile:
+    case NUntil:
+	compile_loop(n);
+	break;
+
+    case NFor:
+	compile_for(n);
+	break;
+
+    case NCase:
+	compile_case(n);
+	break;
+
+    case NTime:
+	dynamic = dynamic || nloops > 0;
+	push(OpTree, 0, 0, n);
+	break;
+    }
+
+    if (redir >= 0) {
+	push(OpUnredir, 0, 0, NULL);
+	redirs--;
+	patch(redir, code->len);
+    }
+}
+
+// compile_simple compiles the simple command n. Builtins are looked up once
+// here rather than every time the command runs, which needs a first word
+// that expands to itself. Otherwise, the command is left to the
+// tree-walking interpreter; and as it may turn out to be a break or a
+// continue, so is the outermost loop around it.
+static void compile_simple(Node *n)
+{
+    if (n->argc == 0) {
+	push(OpTree, 0, 0, n);
+	return;
+    }
+
+    if (!expand_literal(n->argv[0])) {
+	dynamic = dynamic || nloops > 0;
+	push(OpTree, 0, 0, n);
+	return;
+    }
+
+    if (!strcmp(n->argv[0], "break") && compile_jump(n, true)) {
+	return;
+    }
+
+    if (!strcmp(n->argv[0], "continue") && compile_jump(n, false)) {
+	return;
+    }
+
+    Builtin fn = builtin_lookup(n->argv[0]);
+    if (!fn) {
+	push(OpSpawn, 0, 0, n);
+	return;
+    }
+
+    int i = push(OpBuiltin, 0, 0, n);
+    code->insts[i].fn = fn;
+}
+
+// compile_jump compiles the break or continue n into a jump out of the
+// loop it refers to, undoing the redirections performed since the start
+// of that loop. It returns false if n has to run as a builtin instead.
+static bool compile_jump(Node *n, bool brk)
+{
+    if (nloops == 0) {
+	return false;
+    }
+
+    // The count must be a literal positive number.
+    int levels = 1;
+    if (n->argc == 2) {
+	const char *s = n->argv[1];
+	levels = *s && strspn(s, "0123456789") == strlen(s) ? atoi(s) : 0;
+    }
+
+    if (n->redir || n->argc > 2 || levels < 1) {
+	dynamic = true;
+	return false;
+    }
+
+    if (levels > nloops) {
+	levels = nloops;
+    }
+
+    Loop *loop = &loops[nloops - levels];
+    for (int i = redirs; i > loop->redirs; i--) {
+	push(OpUnredir, 0, 0, NULL);
+    }
+
+    push(OpStatus, 0, 0, NULL);
+    int jmp = push(OpJmp, 0, 0, NULL);
+
+    if (brk) {
+	loop->breaks = realloc(loop->breaks,
+			       sizeof(int) * (loop->nbreaks + 1));
+	loop->breaks[loop->nbreaks++] = jmp;
+    } else {
+	loop->conts = realloc(loop->conts,
+			      sizeof(int) * (loop->nconts + 1));
+	loop->conts[loop->nconts++] = jmp;
+    }
+
+    return true;
+}
+
+// compile_if compiles the if_clause or else_part n. The status is zero if
+// no condition holds and there is no else part.
+static void compile_if(Node *n)
+{
+    compile_node(n->left);
+    int els = push(OpJnz, 0, 0, NULL);
+
+    compile_node(n->right);
+    int end = push(OpJmp, 0, 0, NULL);
+
+    patch(els, code->len);
+    if (n->els) {
+	compile_node(n->els);
+    } else {
+	push(OpStatus, 0, 0, NULL);
+    }
+
+    patch(end, code->len);
+}
+
+// compile_loop compiles the while_clause or until_clause n:
+//
+//          OpZero    last
+//   top:   <condition>
+//          OpJnz     done          (OpJz for until)
+//          <do_group>
+//   cont:  OpSave    last
+//          OpJmp     top
+//   done:  OpLoad    last
+//   break:
+static void compile_loop(Node *n)
+{
+    if (nloops == NLOOPS) {
+	push(OpTree, 0, 0, n);
+	return;
+    }
+
+    size_t start = code->len;
+    int last = code->nslots++;
+
+    loop_enter();
+    push(OpZero, last, 0, NULL);
+
+    int top = code->len;
+    compile_node(n->left);
+    int exit = push(n->type == NWhile ? OpJnz : OpJz, 0, 0, NULL);
+    compile_node(n->right);
+
+    loop_leave(n, start, last, top, exit);
+}
+
+// compile_for compiles the for_clause n:
+//
+//          OpZero    last
+//          OpForInit index, last
+//   top:   OpForNext index, done
+//          <do_group>
+//   cont:  OpSave    last
+//          OpJmp     top
+//   done:  OpLoad    last
+//   break:
+static void compile_for(Node *n)
+{
+    if (nloops == NLOOPS) {
+	push(OpTree, 0, 0, n);
+	return;
+    }
+
+    size_t start = code->len;
+    int index = code->nslots++;
+    int last = code->nslots++;
+
+    loop_enter();
+    push(OpZero, last, 0, NULL);
+    push(OpForInit, index, last, n);
+
+    int top = push(OpForNext, index, 0, n);
+    compile_node(n->right);
+
+    loop_leave(n, start, last, top, top);
+}
+
+// loop_enter starts the compilation of a loop.
+static void loop_enter(void)
+{
+    if (nloops == 0) {
+	dynamic = false;
+    }
+
+    Loop *loop = &loops[nloops++];
+    loop->redirs = redirs;
+    loop->nbreaks = 0;
+    loop->nconts = 0;
+}
+
+// loop_leave ends the compilation of the loop n that started at start,
+// emitting its cont, done and break parts and making the instruction at
+// exit jump to done. The outermost loop is replaced by an OpTree if any of
+// its break or continue could not be compiled.
+static void loop_leave(Node *n, size_t start, int last, int top, int exit)
+{
+    Loop *loop = &loops[--nloops];
+
+    for (size_t i = 0; i < loop->nconts; i++) {
+	patch(loop->conts[i], code->len);
+    }
+
+    push(OpSave, last, 0, NULL);
+    push(OpJmp, top, 0, NULL);
+    int done = push(OpLoad, last, 0, NULL);
+
+    if (code->insts[exit].op == OpForNext) {
+	code->insts[exit].b = done;
+    } else {
+	patch(exit, done);
+    }
+
+    for (size_t i = 0; i < loop->nbreaks; i++) {
+	patch(loop->breaks[i], code->len);
+    }
+
+    if (nloops == 0 && dynamic) {
+	code->len = start;
+	push(OpTree, 0, 0, n);
+    }
+}
+
+// compile_case compiles the case_clause n into an OpCase followed by the
+// body of every case_item, each one ending with a jump past the others.
+static void compile_case(Node *n)
+{
+    int first = code->ntargets;
+    for (CaseItem *item = n->items; item; item = item->next) {
+	target();
+    }
+    target();
+
+    push(OpCase, first, 0, n);
+
+    int k = first;
+    int nends = 0;
+    int *ends = malloc(sizeof(int) * (code->ntargets - first));
+
+    for (CaseItem *item = n->items; item; item = item->next, k++) {
+	code->targets[k] = code->len;
+	push(OpStatus, 0, 0, NULL);
+	compile_node(item->body);
+	ends[nends++] = push(OpJmp, 0, 0, NULL);
+    }
+
+    code->targets[k] = code->len;
+    push(OpStatus, 0, 0, NULL);
+
+    for (int i = 0; i < nends; i++) {
+	patch(ends[i], code->len);
+    }
+
+    free(ends);
+}
+
+// vm_run runs code and returns its exit status. Dispatch is threaded: every
+// instruction jumps straight to the handler of the next one.
+int vm_run(Code *code)
+{
+    static const void *labels[] = {
+	[OpHalt] = &&op_halt,
+	[OpTree] = &&op_tree,
+	[OpBuiltin] = &&op_builtin,
+	[OpSpawn] = &&op_spawn,
+	[OpPipe] = &&op_pipe,
+	[OpAsync] = &&op_async,
+	[OpSubshell] = &&op_subshell,
+	[OpRedir] = &&op_redir,
+	[OpUnredir] = &&op_unredir,
+	[OpJmp] = &&op_jmp,
+	[OpJz] = &&op_jz,
+	[OpJnz] = &&op_jnz,
+	[OpNot] = &&op_not,
+	[OpStatus] = &&op_status,
+	[OpSave] = &&op_save,
+	[OpLoad] = &&op_load,
+	[OpZero] = &&op_zero,
+	[OpForInit] = &&op_forinit,
+	[OpForNext] = &&op_fornext,
+	[OpCase] = &&op_case,
+    };
+
+#define DISPATCH() goto *labels[pc->op]
+
+    int *slots = calloc(code->nslots + 1, sizeof(int));
+    Fields *lists = malloc(sizeof(Fields) * (code->nslots + 1));
+    char **words = NULL;
+    int *marks = malloc(sizeof(int) * (code->nredirs + 1));
+    int nmarks = 0;
+    int status = exec_status();
+    Inst *insts = code->insts;
+    Inst *pc = insts;
+
+    for (int i = 0; i < code->nslots; i++) {
+	fields_init(&lists[i]);
+    }
+
+    DISPATCH();
+
+  op_tree:
+    status = exec_node(pc->n);
+    pc++;
+    DISPATCH();
+
+  op_builtin:
+    status = exec_builtin(pc->fn, pc->n);
+    pc++;
+    DISPATCH();
+
+  op_spawn:
+    status = exec_spawn(pc->n);
+    pc++;
+    DISPATCH();
+
+  op_pipe:
+    status = exec_pipe(pc->n);
+    pc++;
+    DISPATCH();
+
+  op_async:
+    status = exec_async(pc->n);
+    pc++;
+    DISPATCH();
+
+  op_subshell:
+    status = exec_subshell(pc->n);
+    pc++;
+    DISPATCH();
+
+  op_redir:
+    marks[nmarks] = exec_redirect(pc->n->redir);
+    if (marks[nmarks] < 0) {
+	exec_setstatus(status = 1);
+	pc = insts + pc->a;
+	DISPATCH();
+    }
+    nmarks++;
+    pc++;
+    DISPATCH();
+
+  op_unredir:
+    exec_unredirect(marks[--nmarks]);
+    pc++;
+    DISPATCH();
+
+  op_jmp:
+    pc = insts + pc->a;
+    DISPATCH();
+
+  op_jz:
+    pc = status == 0 ? insts + pc->a : pc + 1;
+    DISPATCH();
+
+  op_jnz:
+    pc = status != 0 ? insts + pc->a : pc + 1;
+    DISPATCH();
+
+  op_not:
+    exec_setstatus(status = !status);
+    pc++;
+    DISPATCH();
+
+  op_status:
+    exec_setstatus(status = pc->a);
+    pc++;
+    DISPATCH();
+
+  op_save:
+    slots[pc->a] = status;
+    pc++;
+    DISPATCH();
+
+  op_load:
+    exec_setstatus(status = slots[pc->a]);
+    pc++;
+    DISPATCH();
+
+  op_zero:
+    slots[pc->a] = 0;
+    pc++;
+    DISPATCH();
+
+  op_forinit:
+    fields_free(&lists[pc->a]);
+    if (exec_wordlist(pc->n, &lists[pc->a]) < 0) {
+	fields_free(&lists[pc->a]);
+	slots[pc->b] = 1;
+    }
+    fields_argv(&lists[pc->a]);
+    slots[pc->a] = 0;
+    pc++;
+    DISPATCH();
+
+  op_fornext:
+    words = lists[pc->a].argv;
+    if (!words[slots[pc->a]]) {
+	pc = insts + pc->b;
+	DISPATCH();
+    }
+    var_set(pc->n->name, words[slots[pc->a]++]);
+    pc++;
+    DISPATCH();
+
+  op_case:
+    pc = insts + code->targets[pc->a + exec_match(pc->n)];
+    DISPATCH();
+
+  op_halt:
+    for (int i = 0; i < code->nslots; i++) {
+	fields_free(&lists[i]);
+    }
+    free(lists);
+    free(slots);
+    free(marks);
+    return status;
+
+#undef DISPATCH
+}
+
+// vm_free frees code, but not the tree it was compiled from.
+void vm_free(Code *code)
+{
+    free(code->insts);
+    free(code->targets);
+    free(code);
+}
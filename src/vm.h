@@ -0,0 +1,72 @@
+//
+// vm.h - bytecode compiler and virtual machine
+//
+
+#ifndef VM_H
+#define VM_H
+
+#include <stddef.h>
+#include "ast.h"
+#include "builtin.h"
+
+typedef enum {
+    OpHalt,			// stop
+    OpTree,			// walk n with exec_node()
+    OpBuiltin,			// run the builtin fn with the words of n
+    OpSpawn,			// run the external command n
+    OpPipe,			// run the pipe_sequence n
+    OpAsync,			// run n in the background
+    OpSubshell,			// run the subshell n
+    OpRedir,			// perform the redirect_list of n, or jump to a
+    OpUnredir,			// undo the innermost OpRedir
+    OpJmp,			// jump to a
+    OpJz,			// jump to a if the status is zero
+    OpJnz,			// jump to a if the status is not zero
+    OpNot,			// negate the status
+    OpStatus,			// set the status to a
+    OpSave,			// save the status in slot a
+    OpLoad,			// set the status to slot a
+    OpZero,			// set slot a to zero
+    OpForInit,			// expand the wordlist of n into slot a
+    OpForNext,			// assign the next word of slot a, or jump to b
+    OpCase,			// jump to the target of the matching item of n
+} Op;
+
+// Inst is a single instruction. Which operands are meaningful depends on
+// the opcode, as described above. Jump targets are instruction indexes.
+typedef struct __sInst {
+    Op op;
+    int a;
+    int b;
+    Node *n;
+    Builtin fn;
+} Inst;
+
+// Code is the bytecode compiled from a tree.
+typedef struct __sCode {
+
+    // insts holds the instructions, ending with an OpHalt.
+    Inst *insts;
+    size_t len;
+    size_t cap;
+
+    // targets holds the jump tables of the OpCase instructions. The
+    // operand a of an OpCase is the index of its first target; there is
+    // one target for each case_item plus one for no match.
+    int *targets;
+    size_t ntargets;
+    size_t captargets;
+
+    // nslots is the number of integer slots used by the loops.
+    int nslots;
+
+    // nredirs is the deepest nesting of OpRedir instructions.
+    int nredirs;
+
+} Code;
+
+Code *vm_compile(Node *);
+int vm_run(Code *);
+void vm_free(Code *);
+
+#endif
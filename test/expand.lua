@@ -0,0 +1,161 @@
+local ffi = require('ffi')
+local expand = ffi.load('test/expand.so')
+
+ffi.cdef [[
+
+typedef struct __sStr {
+	char *s;
+	size_t len;
+	size_t cap;
+	char small[64];
+} Str;
+
+typedef struct __sField {
+	const char *lit;
+	size_t off;
+} Field;
+
+typedef struct __sFields {
+	Str buf;
+	Field *list;
+	size_t n;
+	size_t cap;
+	Field small[8];
+	char **argv;
+	size_t capargv;
+	char *smallv[9];
+} Fields;
+
+void fields_init(Fields *);
+void fields_free(Fields *);
+char **fields_argv(Fields *);
+int expand_words(const char **, size_t, Fields *);
+void var_init(int, const char **);
+void var_set(const char *, const char *);
+void var_unset(const char *);
+
+]]
+
+local vars = {
+	x = "a  b",
+	e = "",
+	f = "foo.tar.gz",
+	s = " lead trail ",
+	y = "a::b:",
+	HOME = "/home/u",
+}
+
+local tests = {
+	-- Field splitting.
+	{word = "$x", want = {"a", "b"}},
+	{word = [["$x"]], want = {"a  b"}},
+	{word = "$e", want = {}},
+	{word = [["$e"]], want = {""}},
+	{word = "$s", want = {"lead", "trail"}},
+	{word = [[x$s"y"]], want = {"x", "lead", "trail", "y"}},
+	{word = "$u", want = {}},
+	{word = "${u:-d e}", want = {"d", "e"}},
+	{word = [[${u:-"d e"}]], want = {"d e"}},
+	{word = [["${u:-d e}"]], want = {"d e"}},
+	{word = "${u-$x}", want = {"a", "b"}},
+	{word = "${f:+set}", want = {"set"}},
+	{word = "${e:+set}", want = {}},
+	{word = "$y", ifs = ":", want = {"a", "", "b"}},
+	{word = "$x", ifs = ":", want = {"a  b"}},
+
+	-- Positional parameters, set to "a b" and "c".
+	{word = "$@", want = {"a", "b", "c"}},
+	{word = [["$@"]], want = {"a b", "c"}},
+	{word = "$*", want = {"a", "b", "c"}},
+	{word = [["$*"]], want = {"a b c"}},
+	{word = [["$*"]], ifs = ":", want = {"a b:c"}},
+	{word = [["x$@y"]], want = {"xa b", "cy"}},
+	{word = "$#", want = {"2"}},
+
+	-- Trims and lengths.
+	{word = "${#f}", want = {"10"}},
+	{word = "${f%.*}", want = {"foo.tar"}},
+	{word = "${f%%.*}", want = {"foo"}},
+	{word = "${f#*.}", want = {"tar.gz"}},
+	{word = "${f##*.}", want = {"gz"}},
+	{word = [[${f%".gz"}]], want = {"foo.tar"}},
+
+	-- Tilde expansion.
+	{word = "~", want = {"/home/u"}},
+	{word = "~/x", want = {"/home/u/x"}},
+	{word = [["~"]], want = {"~"}},
+	{word = "a~", want = {"a~"}},
+	{word = "x=~", want = {"x=~"}},
+
+	-- Command substitution.
+	{word = "$(echo $(echo in))", want = {"in"}},
+	{word = [["$(echo "a  b")"]], want = {"a  b"}},
+	{word = [["$(echo \"$f\")"]], want = {[["foo.tar.gz"]]}},
+	{word = "$(echo a; echo b)", want = {"a", "b"}},
+	{word = "$(case a in a) echo x;; esac)", want = {"x"}},
+	{word = "`echo q`", want = {"q"}},
+
+	-- Pathname expansion.
+	{word = "src/ast.?", want = {"src/ast.c", "src/ast.h"}},
+	{word = [["src/ast.?"]], want = {"src/ast.?"}},
+	{word = "src/ast.\\?", want = {"src/ast.?"}},
+	{word = "src/*.nope", want = {"src/*.nope"}},
+}
+
+-- Without positional parameters, "$@" makes no field at all.
+local noargs = {
+	{word = [["$@"]], want = {}},
+	{word = [["x$@y"]], want = {"xy"}},
+	{word = "$#", want = {"0"}},
+}
+
+local function check(k, t)
+	if t.ifs then
+		expand.var_set("IFS", t.ifs)
+	end
+
+	local f = ffi.new("Fields")
+	expand.fields_init(f)
+
+	local words = ffi.new("const char *[1]", {t.word})
+	local rc = expand.expand_words(words, 1, f)
+	local argv = expand.fields_argv(f)
+
+	local got = {}
+	local i = 0
+	while argv[i] ~= nil do
+		got[#got + 1] = "<" .. ffi.string(argv[i]) .. ">"
+		i = i + 1
+	end
+
+	local want = {}
+	for _, w in pairs(t.want) do
+		want[#want + 1] = "<" .. w .. ">"
+	end
+
+	if rc ~= 0 or table.concat(got) ~= table.concat(want) then
+		print(string.format("\texpand_words test at k=%d: got=%d %s, \z
+			want=0 %s", k, rc, table.concat(got), table.concat(want)))
+	end
+
+	expand.fields_free(f)
+	if t.ifs then
+		expand.var_unset("IFS")
+	end
+end
+
+local args = ffi.new("const char *[3]", {"xsh", "a b", "c"})
+expand.var_init(3, args)
+for name, value in pairs(vars) do
+	expand.var_set(name, value)
+end
+
+print '\texpand test:'
+for k, t in pairs(tests) do
+	check(k, t)
+end
+
+expand.var_init(1, args)
+for k, t in pairs(noargs) do
+	check(k, t)
+end
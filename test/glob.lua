@@ -0,0 +1,81 @@
+local ffi = require('ffi')
+local glob = ffi.load('test/glob.so')
+
+ffi.cdef [[
+
+typedef struct __sStr {
+	char *s;
+	size_t len;
+	size_t cap;
+	char small[64];
+} Str;
+
+void str_init(Str *);
+void str_free(Str *);
+int glob_expand(const char *, Str *);
+
+]]
+
+local dir = "test/glob.d"
+local files = {"a.c", "b.c", "c.h", ".hidden.c", "sub/d.c", "sub/e.txt"}
+
+local tests = {
+	{pat = "*.c", want = {"a.c", "b.c"}},
+	{pat = ".*.c", want = {".hidden.c"}},
+	{pat = "?.h", want = {"c.h"}},
+	{pat = "[ab].c", want = {"a.c", "b.c"}},
+	{pat = "[!a].c", want = {"b.c"}},
+	{pat = "*.[ch]", want = {"a.c", "b.c", "c.h"}},
+	{pat = "*/*.c", want = {"sub/d.c"}},
+	{pat = "s*/e.*", want = {"sub/e.txt"}},
+	{pat = "sub/*", want = {"sub/d.c", "sub/e.txt"}},
+	{pat = "*/", want = {"sub/"}},
+	{pat = "*.x", want = {}},
+	{pat = "\\*.c", want = {}},
+	{pat = "b\\.c", want = {"b.c"}},
+}
+
+-- expand returns the pathnames matched by the pattern pat within dir,
+-- without dir in front of them.
+local function expand(pat)
+	local out = ffi.new("Str")
+	glob.str_init(out)
+
+	local n = glob.glob_expand(dir .. "/" .. pat, out)
+	local got = {}
+	local off = 0
+	while off < out.len do
+		local name = ffi.string(out.s + off)
+		got[#got + 1] = name:sub(#dir + 2)
+		off = off + #name + 1
+	end
+
+	glob.str_free(out)
+	return n, got
+end
+
+local function check(k, pat, want)
+	local n, got = expand(pat)
+	local s = table.concat(got, " ")
+
+	if n ~= #want or s ~= table.concat(want, " ") then
+		print(string.format("\tglob_expand test at k=%d: got=%d {%s}, \z
+			want=%d {%s}", k, n, s, #want, table.concat(want, " ")))
+	end
+end
+
+os.execute("rm -rf " .. dir .. " && mkdir -p " .. dir .. "/sub")
+for _, f in pairs(files) do
+	io.open(dir .. "/" .. f, "w"):close()
+end
+
+print '\tglob test:'
+for k, t in pairs(tests) do
+	check(k, t.pat, t.want)
+end
+
+-- A listing read before is not used once the directory has changed.
+io.open(dir .. "/f.c", "w"):close()
+check(#tests + 1, "*.c", {"a.c", "b.c", "f.c"})
+
+os.execute("rm -rf " .. dir)
@@ -38,6 +38,7 @@ typedef enum {
     TLBrace,			// {
     TRBrace,			// }
     TBang,			// !
+    TTime,			// time
 } TokenType;
 
 TokenType keyw_typeof(const char *);
@@ -61,6 +62,7 @@ TokenType = {
     TLBrace = 31,
     TRBrace = 32,
     TBang = 33,
+    TTime = 34,
 }
 
 local tests = {
@@ -79,6 +81,7 @@ local tests = {
 	{keyword = "{", want = TokenType.TLBrace},
 	{keyword = "}", want = TokenType.TRBrace},
 	{keyword = "!", want = TokenType.TBang},
+	{keyword = "time", want = TokenType.TTime},
 	{keyword = "i", want = TokenType.TWord},
 	{keyword = "t", want = TokenType.TWord},
 	{keyword = "e", want = TokenType.TWord},
@@ -87,6 +90,7 @@ local tests = {
 	{keyword = "c", want = TokenType.TWord},
 	{keyword = "w", want = TokenType.TWord},
 	{keyword = "u", want = TokenType.TWord},
+	{keyword = "tim", want = TokenType.TWord},
 }
 
 print '\tkeyw test:'
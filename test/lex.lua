@@ -41,7 +41,11 @@ typedef enum {
 	TLBrace,    // {
 	TRBrace,    // }
 	TBang,      // !
+	TTime,      // time
 	TIn,        // in
+	TLParen,    // (
+	TRParen,    // )
+	TError,     // word with a quote or substitution left open
 } TokenType;
 
 typedef struct __sToken {
@@ -90,7 +94,11 @@ TokenType = {
 	TLBrace = 31,
 	TRBrace = 32,
 	TBang = 33,
-	TIn = 34,
+	TTime = 34,
+	TIn = 35,
+	TLParen = 36,
+	TRParen = 37,
+	TError = 38,
 }
 
 local tests = {
@@ -124,7 +132,98 @@ local tests = {
 	{input = "{", tokens = {{type = TokenType.TLBrace, text = "{"}}},
 	{input = "}", tokens = {{type = TokenType.TRBrace, text = "}"}}},
 	{input = "!", tokens = {{type = TokenType.TBang, text = "!"}}},
+	{input = "time", tokens = {{type = TokenType.TTime, text = "time"}}},
 	{input = "in", tokens = {{type = TokenType.TWord, text = "in"}}},
+	{input = "(", tokens = {{type = TokenType.TLParen, text = "("}}},
+	{input = ")", tokens = {{type = TokenType.TRParen, text = ")"}}},
+	{input = "#comment", tokens = {{type = TokenType.TEOF, text = ""}}},
+	{
+		input = "word;word&word|word(word)done;fi&&",
+		tokens = {
+			{type = TokenType.TWord, text = "word"},
+			{type = TokenType.TSemi, text = ";"},
+			{type = TokenType.TWord, text = "word"},
+			{type = TokenType.TAnd, text = "&"},
+			{type = TokenType.TWord, text = "word"},
+			{type = TokenType.TOr, text = "|"},
+			{type = TokenType.TWord, text = "word"},
+			{type = TokenType.TLParen, text = "("},
+			{type = TokenType.TWord, text = "word"},
+			{type = TokenType.TRParen, text = ")"},
+			{type = TokenType.TDone, text = "done"},
+			{type = TokenType.TSemi, text = ";"},
+			{type = TokenType.TFi, text = "fi"},
+			{type = TokenType.TAndIf, text = "&&"},
+		}
+	},
+	{
+		input = [[echo "a b;c" 'd e|f' ${g:-h i} $(j; k) \ l#m 2x>o]],
+		tokens = {
+			{type = TokenType.TWord, text = "echo"},
+			{type = TokenType.TWord, text = "\"a b;c\""},
+			{type = TokenType.TWord, text = "'d e|f'"},
+			{type = TokenType.TWord, text = "${g:-h i}"},
+			{type = TokenType.TWord, text = "$(j; k)"},
+			{type = TokenType.TWord, text = "\\ l#m"},
+			{type = TokenType.TWord, text = "2x"},
+			{type = TokenType.TGreat, text = ">"},
+			{type = TokenType.TWord, text = "o"},
+			{type = TokenType.TEOF, text = ""},
+		}
+	},
+	{
+		input = [["a $(b ")" `c`) d"e`f g`]],
+		tokens = {
+			{type = TokenType.TWord, text = [["a $(b ")" `c`) d"e`f g`]]},
+			{type = TokenType.TEOF, text = ""},
+		}
+	},
+	{
+		input = [[echo $(case a in a) echo x;; esac) y]],
+		tokens = {
+			{type = TokenType.TWord, text = "echo"},
+			{type = TokenType.TWord, text = "$(case a in a) echo x;; esac)"},
+			{type = TokenType.TWord, text = "y"},
+			{type = TokenType.TEOF, text = ""},
+		}
+	},
+	{
+		input = [[x=$(case "$y" in (a|b) echo ")";; *) case c in c) (d);; esac
+		esac # ) not the end
+		)z w]],
+		tokens = {
+			{type = TokenType.TWord, text = [[x=$(case "$y" in (a|b) echo ")";; *) case c in c) (d);; esac
+		esac # ) not the end
+		)z]]},
+			{type = TokenType.TWord, text = "w"},
+			{type = TokenType.TEOF, text = ""},
+		}
+	},
+	{
+		input = [[$(echo case in a) b]],
+		tokens = {
+			{type = TokenType.TWord, text = "$(echo case in a)"},
+			{type = TokenType.TWord, text = "b"},
+			{type = TokenType.TEOF, text = ""},
+		}
+	},
+	{
+		input = [[echo "a b]],
+		tokens = {
+			{type = TokenType.TWord, text = "echo"},
+			{type = TokenType.TError, text = [["a b]]},
+			{type = TokenType.TEOF, text = ""},
+		}
+	},
+	{input = "'a", tokens = {{type = TokenType.TError, text = "'a"}}},
+	{input = "`a", tokens = {{type = TokenType.TError, text = "`a"}}},
+	{input = "${a", tokens = {{type = TokenType.TError, text = "${a"}}},
+	{input = "$(a", tokens = {{type = TokenType.TError, text = "$(a"}}},
+	{input = [["$(a"]], tokens = {{type = TokenType.TError, text = [["$(a"]]}}},
+	{
+		input = [[$(case a in a) b]],
+		tokens = {{type = TokenType.TError, text = [[$(case a in a) b]]}},
+	},
 	{
 		input = [[
 		for word in word word word
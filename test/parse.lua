@@ -0,0 +1,245 @@
+local ffi = require('ffi')
+local parse = ffi.load('test/parse.so')
+
+ffi.cdef [[
+
+typedef enum {
+	NSimple,    // simple_command
+	NPipe,      // pipe_sequence
+	NNot,       // Bang pipe_sequence
+	NAnd,       // and_or AND_IF
+	NOr,        // and_or OR_IF
+	NList,      // list, term
+	NBrace,     // brace_group
+	NSubshell,  // subshell
+	NIf,        // if_clause, else_part
+	NWhile,     // while_clause
+	NUntil,     // until_clause
+	NFor,       // for_clause
+	NCase,      // case_clause
+	NTime,      // Time pipeline
+} NodeType;
+
+typedef struct __sRedir {
+	int type;   // TokenType, TLess to TLobber
+	int fd;
+	char *word;
+	struct __sRedir *next;
+} Redir;
+
+typedef struct __sNode Node;
+
+typedef struct __sCaseItem {
+	char **pats;
+	size_t npats;
+	Node *body;
+	struct __sCaseItem *next;
+} CaseItem;
+
+struct __sNode {
+	NodeType type;
+	char **assigns;
+	size_t nassigns;
+	char **argv;
+	size_t argc;
+	Redir *redir;
+	Node *left;
+	Node *right;
+	Node *els;
+	char *name;
+	bool bg;
+	bool in;
+	CaseItem *items;
+	void *pat;
+};
+
+size_t parser_parse_text(const char *, Node **);
+void ast_free(Node *);
+bool alias_set(const char *, size_t, const char *);
+
+]]
+
+local names = {
+	[0] = "simple", "pipe", "not", "and", "or", "list", "brace",
+	"subshell", "if", "while", "until", "for", "case", "time",
+}
+
+local ops = {
+	[10] = "<", ">", "<<", ">>", "<&", ">&", "<>", "<<-", ">|",
+}
+
+-- show writes the tree n as "(type fields children)": the fields are the
+-- name, the words and the redirections, and the case items as
+-- "[patterns body]"; the children are left, right and els, when not NULL.
+local function show(n)
+	local s = "(" .. names[n.type]
+
+	if n.bg then
+		s = s .. "&"
+	end
+	if n.name ~= nil then
+		s = s .. " " .. ffi.string(n.name)
+	end
+	if n.type == ffi.C.NFor and n["in"] then
+		s = s .. " in"
+	end
+	for i = 0, tonumber(n.nassigns) - 1 do
+		s = s .. " " .. ffi.string(n.assigns[i])
+	end
+	for i = 0, tonumber(n.argc) - 1 do
+		s = s .. " " .. ffi.string(n.argv[i])
+	end
+
+	local r = n.redir
+	while r ~= nil do
+		local fd = r.fd >= 0 and tostring(r.fd) or ""
+		s = s .. " " .. fd .. ops[r.type] .. ffi.string(r.word)
+		r = r.next
+	end
+
+	local item = n.items
+	while item ~= nil do
+		local pats = {}
+		for i = 0, tonumber(item.npats) - 1 do
+			pats[#pats + 1] = ffi.string(item.pats[i])
+		end
+
+		local body = item.body ~= nil and show(item.body) or "-"
+		s = s .. " [" .. table.concat(pats, "|") .. " " .. body .. "]"
+		item = item.next
+	end
+
+	for _, k in ipairs({"left", "right", "els"}) do
+		if n[k] ~= nil then
+			s = s .. " " .. show(n[k])
+		end
+	end
+
+	return s .. ")"
+end
+
+local tests = {
+	{input = "a b", want = "(list (simple a b))"},
+	{
+		input = "a; b & c",
+		want = "(list (simple a) (list& (simple b) (list (simple c))))",
+	},
+	{
+		input = "a | b | c",
+		want = "(list (pipe (simple a) (pipe (simple b) (pipe (simple c)))))",
+	},
+	{
+		input = "! a && b || c",
+		want = "(list (or (and (not (simple a)) (simple b)) (simple c)))",
+	},
+	{
+		input = "if a; then b; elif c; then d; else e; fi",
+		want = "(list (if (list (simple a)) (list (simple b)) \z
+			(if (list (simple c)) (list (simple d)) (list (simple e)))))",
+	},
+	{
+		input = "while a; do b; done",
+		want = "(list (while (list (simple a)) (list (simple b))))",
+	},
+	{
+		input = "until a; do b; done",
+		want = "(list (until (list (simple a)) (list (simple b))))",
+	},
+	{
+		input = "while a\ndo\n\tb\ndone",
+		want = "(list (while (list (simple a)) (list (simple b))))",
+	},
+	{
+		input = "for i in x y; do echo $i; done",
+		want = "(list (for i in x y (list (simple echo $i))))",
+	},
+	{
+		input = "for i do b; done",
+		want = "(list (for i (list (simple b))))",
+	},
+	{
+		input = "for i in 1; do while a; do b; done; done",
+		want = "(list (for i in 1 (list (while (list (simple a)) \z
+			(list (simple b))))))",
+	},
+	{
+		input = "case $x in a|b) c;; (*) d;; e) ;; esac",
+		want = "(list (case $x [a|b (list (simple c))] \z
+			[* (list (simple d))] [e -]))",
+	},
+	{
+		input = "{ a; b; } >f",
+		want = "(list (brace >f (list (simple a) (list (simple b)))))",
+	},
+	{
+		input = "(a; b) 2>&1 <g",
+		want = "(list (subshell 2>&1 <g (list (simple a) \z
+			(list (simple b)))))",
+	},
+	{input = "x=1 y=2 env", want = "(list (simple x=1 y=2 env))"},
+	{
+		input = "a 2>&1 >>f <&3 >|g",
+		want = "(list (simple a 2>&1 >>f <&3 >|g))",
+	},
+	{
+		input = "time a | b",
+		want = "(list (time (pipe (simple a) (pipe (simple b)))))",
+	},
+	{input = "if a; then", nerr = 1},
+	{input = "a; fi", nerr = 1},
+	{input = "(a", nerr = 1},
+	{input = "echo \"a", nerr = 1},
+}
+
+-- The words in command position are replaced by the tokens of the alias
+-- they name, as is the word after an alias ending with a blank.
+local aliases = {
+	{name = "ll", value = "ls -l "},
+	{name = "gx", value = "grep x"},
+	{name = "cond", value = "if true; then"},
+	{name = "e", value = "echo e "},
+	{name = "ls", value = "ls -F"},
+	{name = "none", value = ""},
+}
+
+local spliced = {
+	{input = "ls", want = "(list (simple ls -F))"},
+	{input = "ll", want = "(list (simple ls -F -l))"},
+	{input = "ll gx", want = "(list (simple ls -F -l grep x))"},
+	{input = "x=1 ll", want = "(list (simple x=1 ls -F -l))"},
+	{input = "none ll", want = "(list (simple ls -F -l))"},
+	{input = "echo ll", want = "(list (simple echo ll))"},
+	{input = "e e", want = "(list (simple echo e echo e))"},
+	{
+		input = "cond a; fi",
+		want = "(list (if (list (simple true)) (list (simple a))))",
+	},
+}
+
+local function check(k, tt)
+	local root = ffi.new("Node *[1]")
+	local nerr = tonumber(parse.parser_parse_text(tt.input, root))
+
+	if nerr ~= (tt.nerr or 0) then
+		print(string.format("\tparser_parse_text nerr test at k=%d: \z
+			got=%d, want=%d", k, nerr, tt.nerr or 0))
+	elseif tt.want and show(root[0]) ~= tt.want then
+		print(string.format("\tparser_parse_text test at k=%d: \z
+			got=%s, want=%s", k, show(root[0]), tt.want))
+	end
+
+	parse.ast_free(root[0])
+end
+
+print '\tparse test:'
+for k, tt in pairs(tests) do
+	check(k, tt)
+end
+
+for _, a in pairs(aliases) do
+	parse.alias_set(a.name, #a.name, a.value)
+end
+
+for k, tt in pairs(spliced) do
+	check(k, tt)
+end
@@ -0,0 +1,73 @@
+local ffi = require('ffi')
+local pat = ffi.load('test/pat.so')
+
+ffi.cdef [[
+
+typedef struct __sPat Pat;
+
+Pat *pat_compile(const char **, const int *, size_t);
+int pat_match(Pat *, const char *);
+bool pat_literal(const char *);
+void pat_free(Pat *);
+
+]]
+
+local tests = {
+	{pats = {"foo", "bar"}, word = "bar", want = 1},
+	{pats = {"foo", "bar"}, word = "ba", want = -1},
+	{pats = {"foo", "bar"}, word = "barr", want = -1},
+	{pats = {"*", "foo"}, word = "foo", want = 0},
+	{pats = {"foo", "*"}, word = "foo", want = 0},
+	{pats = {"fo?", "foo"}, word = "foo", want = 0},
+	{pats = {"*.c", "*.h"}, word = "main.h", want = 1},
+	{pats = {"*.c", "*.h"}, word = "main.o", want = -1},
+	{pats = {"a*b*c"}, word = "aXbYbZc", want = 0},
+	{pats = {"a*b*c"}, word = "aXbYbZ", want = -1},
+	{pats = {"[abc]x"}, word = "bx", want = 0},
+	{pats = {"[!abc]x"}, word = "bx", want = -1},
+	{pats = {"[!abc]x"}, word = "dx", want = 0},
+	{pats = {"[a-c]"}, word = "c", want = 0},
+	{pats = {"[]a]"}, word = "]", want = 0},
+	{pats = {"[[:digit:]]*"}, word = "7up", want = 0},
+	{pats = {"[[:digit:]]*"}, word = "up", want = -1},
+	{pats = {"[ab"}, word = "[ab", want = 0},
+	{pats = {"\\*"}, word = "*", want = 0},
+	{pats = {"\\*"}, word = "x", want = -1},
+	{pats = {""}, word = "", want = 0},
+	{pats = {"?"}, word = "", want = -1},
+}
+
+local literals = {
+	{pat = "foo", want = true},
+	{pat = "f\\*o", want = true},
+	{pat = "f*o", want = false},
+	{pat = "f?o", want = false},
+	{pat = "f[o]", want = false},
+}
+
+print '\tpat test:'
+for k, t in pairs(tests) do
+	local pats = ffi.new("const char *[?]", #t.pats, t.pats)
+	local arms = ffi.new("int[?]", #t.pats)
+	for i = 0, #t.pats - 1 do
+		arms[i] = i
+	end
+
+	local p = pat.pat_compile(pats, arms, #t.pats)
+	local got = pat.pat_match(p, t.word)
+	pat.pat_free(p)
+
+	if got ~= t.want then
+		print(string.format("\tpat_match test at k=%d: got=%d, \z
+			want=%d", k, got, t.want))
+	end
+end
+
+for k, t in pairs(literals) do
+	local got = pat.pat_literal(t.pat)
+
+	if got ~= t.want then
+		print(string.format("\tpat_literal test at k=%d: got=%s, \z
+			want=%s", k, tostring(got), tostring(t.want)))
+	end
+end